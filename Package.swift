@@ -48,5 +48,16 @@ let package = Package(
             ]
         )
         
+        ,.testTarget(
+            name: "dotveepTests"
+            ,dependencies: ["dotveep", "VPKProtobuf"]
+            ,path: "Tests/dotveepTests"
+            ,cSettings: [
+                .unsafeFlags(
+                    ["-fno-objc-arc"]
+                )
+            ]
+        )
+        
     ]
 )
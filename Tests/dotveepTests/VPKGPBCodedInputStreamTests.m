@@ -0,0 +1,483 @@
+//
+//  VPKGPBCodedInputStreamTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#import "VPKGPBCodedInputStream.h"
+#import "VPKGPBCodedOutputStream.h"
+#import "VPKGPBCodedOutputStream_PackagePrivate.h"
+#import "VPKGPBUtilities.h"
+#import "VPKGPBWireFormat.h"
+#import "VPKPTestVeeps.h"
+
+// Window sizes smaller than most fields, around the size of one, and larger
+// than the whole test veep.
+static const size_t kBufferSizes[] = {1, 7, 64, 4096, 1 << 20};
+
+static NSData *EncodedData(void (^block)(VPKGPBCodedOutputStream *output)) {
+  NSOutputStream *memory = [NSOutputStream outputStreamToMemory];
+  [memory open];
+  VPKGPBCodedOutputStream *output = [[VPKGPBCodedOutputStream alloc] initWithOutputStream:memory];
+  block(output);
+  [output flush];
+  [output release];
+  NSData *data = [memory propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+  [memory close];
+  return data;
+}
+
+// Writes data to a new temporary file and returns it opened for reading.
+static int OpenTemporaryFileWithData(NSData *data) {
+  NSString *path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  if (![data writeToFile:path atomically:NO]) {
+    return -1;
+  }
+  int fd = open(path.fileSystemRepresentation, O_RDONLY);
+  unlink(path.fileSystemRepresentation);
+  return fd;
+}
+
+// Strings on either side of the length from which parsed strings keep their
+// UTF-8 bytes, using UTF-8 sequences of every width.
+static NSArray<NSString *> *TestStrings(void) {
+  return @[
+    @"", @"short", @"fifteen bytes..", @"exactly 16 bytes", @"Café ☕ 東京",
+    @"Café ☕ 東京 and more",
+    [@"" stringByPaddingToLength:5000 withString:@"ascii " startingAtIndex:0],
+    [@"" stringByPaddingToLength:5000 withString:@"東京😀é" startingAtIndex:0],
+    [NSString stringWithFormat:@"%C after a NUL, long", (unichar)0]
+  ];
+}
+
+@interface VPKGPBCodedInputStreamTests : XCTestCase
+@end
+
+@implementation VPKGPBCodedInputStreamTests
+
+#pragma mark - Streaming
+
+- (void)testInputStreamParseMatchesDataParse {
+  VPKPVeep *veep = VPKPTestVeep(200);
+  NSData *data = [veep data];
+  for (size_t i = 0; i < sizeof(kBufferSizes) / sizeof(kBufferSizes[0]); ++i) {
+    NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+    VPKGPBCodedInputStream *input =
+        [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:kBufferSizes[i]];
+    NSError *error = nil;
+    VPKPVeep *parsed = [VPKPVeep parseFromCodedInputStream:input
+                                         extensionRegistry:nil
+                                                     error:&error];
+    XCTAssertNil(error, @"bufferSize %zu", kBufferSizes[i]);
+    XCTAssertEqualObjects(parsed, veep, @"bufferSize %zu", kBufferSizes[i]);
+    [input release];
+  }
+}
+
+- (void)testFileDescriptorParseMatchesDataParse {
+  VPKPVeep *veep = VPKPTestVeep(200);
+  NSData *data = [veep data];
+  for (size_t i = 0; i < sizeof(kBufferSizes) / sizeof(kBufferSizes[0]); ++i) {
+    int fd = OpenTemporaryFileWithData(data);
+    XCTAssertGreaterThanOrEqual(fd, 0);
+    VPKGPBCodedInputStream *input =
+        [[VPKGPBCodedInputStream alloc] initWithFileDescriptor:fd bufferSize:kBufferSizes[i]];
+    NSError *error = nil;
+    VPKPVeep *parsed = [VPKPVeep parseFromCodedInputStream:input
+                                         extensionRegistry:nil
+                                                     error:&error];
+    XCTAssertNil(error, @"bufferSize %zu", kBufferSizes[i]);
+    XCTAssertEqualObjects(parsed, veep, @"bufferSize %zu", kBufferSizes[i]);
+    [input release];
+    // The stream leaves the descriptor open.
+    XCTAssertEqual(close(fd), 0);
+  }
+}
+
+- (void)testLimitsAcrossRefills {
+  NSMutableData *blob = [NSMutableData dataWithLength:100];
+  memset(blob.mutableBytes, 0xA5, blob.length);
+  NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeInt32:1 value:300];
+    [output writeString:2 value:@"refilled, and refilled again"];
+    [output writeTag:3 format:VPKGPBWireFormatLengthDelimited];
+    NSData *nested = EncodedData(^(VPKGPBCodedOutputStream *nestedOutput) {
+      [nestedOutput writeSInt64:1 value:-5];
+      [nestedOutput writeBytes:2 value:blob];
+      [nestedOutput writeFixed64:3 value:UINT64_MAX - 1];
+    });
+    [output writeUInt32NoTag:(uint32_t)nested.length];
+    [output writeRawData:nested];
+    [output writeBool:4 value:YES];
+  });
+
+  for (size_t i = 0; i < sizeof(kBufferSizes) / sizeof(kBufferSizes[0]); ++i) {
+    NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+    VPKGPBCodedInputStream *input =
+        [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:kBufferSizes[i]];
+    XCTAssertEqual([input readTag], (int32_t)VPKGPBWireFormatMakeTag(1, VPKGPBWireFormatVarint));
+    XCTAssertEqual([input readInt32], 300);
+    XCTAssertEqual([input readTag],
+                   (int32_t)VPKGPBWireFormatMakeTag(2, VPKGPBWireFormatLengthDelimited));
+    XCTAssertEqualObjects([input readString], @"refilled, and refilled again");
+    XCTAssertEqual([input readTag],
+                   (int32_t)VPKGPBWireFormatMakeTag(3, VPKGPBWireFormatLengthDelimited));
+    size_t oldLimit = [input pushLimit:[input readUInt32]];
+    XCTAssertEqual([input readTag], (int32_t)VPKGPBWireFormatMakeTag(1, VPKGPBWireFormatVarint));
+    XCTAssertEqual([input readSInt64], -5);
+    XCTAssertEqual([input readTag],
+                   (int32_t)VPKGPBWireFormatMakeTag(2, VPKGPBWireFormatLengthDelimited));
+    XCTAssertEqualObjects([input readBytes], blob);
+    XCTAssertEqual([input readTag],
+                   (int32_t)VPKGPBWireFormatMakeTag(3, VPKGPBWireFormatFixed64));
+    XCTAssertEqual([input readFixed64], UINT64_MAX - 1);
+    // The limit ends the nested message although the source has more bytes.
+    XCTAssertTrue([input isAtEnd]);
+    XCTAssertEqual([input readTag], 0);
+    [input popLimit:oldLimit];
+    XCTAssertFalse([input isAtEnd]);
+    XCTAssertEqual([input readTag], (int32_t)VPKGPBWireFormatMakeTag(4, VPKGPBWireFormatVarint));
+    XCTAssertTrue([input readBool]);
+    XCTAssertTrue([input isAtEnd]);
+    XCTAssertEqual([input position], data.length);
+    [input release];
+  }
+}
+
+- (void)testSkippedFieldsAcrossRefills {
+  VPKPVeep *veep = VPKPTestVeep(50);
+  NSData *data = [veep data];
+  NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+  VPKGPBCodedInputStream *input =
+      [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:16];
+  NSUInteger fieldCount = 0;
+  while (YES) {
+    int32_t tag = [input readTag];
+    if (tag == 0) {
+      break;
+    }
+    XCTAssertTrue([input skipField:tag]);
+    ++fieldCount;
+  }
+  XCTAssertEqual(fieldCount, 1 + veep.trackElementsArray_Count);
+  XCTAssertEqual([input position], data.length);
+  [input release];
+}
+
+- (void)testFailedReadIsReported {
+  int fds[2];
+  XCTAssertEqual(pipe(fds), 0);
+  // Reading the write end of a pipe fails with EBADF.
+  VPKGPBCodedInputStream *input =
+      [[VPKGPBCodedInputStream alloc] initWithFileDescriptor:fds[1] bufferSize:64];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseFromCodedInputStream:input extensionRegistry:nil error:&error];
+  XCTAssertNil(parsed);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorReadFailed);
+  [input release];
+  close(fds[0]);
+  close(fds[1]);
+}
+
+- (void)testTruncatedInputStreamFails {
+  NSData *data = [VPKPTestVeep(20) data];
+  NSData *truncated = [data subdataWithRange:NSMakeRange(0, data.length - 3)];
+  NSInputStream *stream = [NSInputStream inputStreamWithData:truncated];
+  VPKGPBCodedInputStream *input =
+      [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:32];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseFromCodedInputStream:input extensionRegistry:nil error:&error];
+  XCTAssertNil(parsed);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  [input release];
+}
+
+- (void)testInputStreamEndingInsideElementFails {
+  // A track element claiming 100 bytes, of which only a complete empty rect
+  // field arrives.
+  NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeTag:VPKPVeep_FieldNumber_TrackElementsArray
+              format:VPKGPBWireFormatLengthDelimited];
+    [output writeUInt32NoTag:100];
+    [output writeTag:VPKPVeepTrackElement_FieldNumber_Rect format:VPKGPBWireFormatLengthDelimited];
+    [output writeUInt32NoTag:0];
+  });
+
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseFromData:data error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+
+  error = nil;
+  NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+  VPKGPBCodedInputStream *input =
+      [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:64];
+  XCTAssertNil([VPKPVeep parseFromCodedInputStream:input extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidSize);
+  [input release];
+}
+
+#pragma mark - Varints
+
+static const uint64_t kVarintValues[] = {
+    0,
+    1,
+    127,
+    128,
+    300,
+    16383,
+    16384,
+    (1ULL << 21) - 1,
+    1ULL << 21,
+    (1ULL << 28) - 1,
+    1ULL << 28,
+    UINT32_MAX,
+    1ULL << 35,
+    1ULL << 42,
+    1ULL << 49,
+    1ULL << 56,
+    (uint64_t)INT64_MAX,
+    (uint64_t)INT64_MIN,
+    (uint64_t)-1,
+    0x0123456789ABCDEFULL,
+};
+
+- (void)testVarintValuesWithAndWithoutRoomForTheFastPath {
+  for (size_t i = 0; i < sizeof(kVarintValues) / sizeof(kVarintValues[0]); ++i) {
+    uint64_t value = kVarintValues[i];
+    NSData *alone = EncodedData(^(VPKGPBCodedOutputStream *output) {
+      [output writeUInt64NoTag:value];
+    });
+    XCTAssertEqual(alone.length, VPKGPBComputeRawVarint64Size((int64_t)value));
+    NSMutableData *padded = [NSMutableData dataWithData:alone];
+    [padded increaseLengthBy:16];
+
+    // The value alone leaves less than a whole varint's worth of bytes after
+    // its start unless it is ten bytes long; padded, the fast path can read
+    // all of it.
+    for (NSData *data in @[ alone, padded ]) {
+      VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+      XCTAssertEqual([input readUInt64], value, @"%llu", value);
+      XCTAssertEqual([input position], alone.length);
+      [input release];
+    }
+    NSInputStream *stream = [NSInputStream inputStreamWithData:alone];
+    VPKGPBCodedInputStream *input =
+        [[VPKGPBCodedInputStream alloc] initWithInputStream:stream bufferSize:1];
+    XCTAssertEqual([input readUInt64], value, @"%llu", value);
+    XCTAssertTrue([input isAtEnd]);
+    [input release];
+  }
+}
+
+- (void)testSignExtendedInt32 {
+  for (int32_t value = -3; value <= 3; ++value) {
+    NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+      [output writeInt32NoTag:value];
+      [output writeInt32NoTag:INT32_MIN];
+    });
+    VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+    XCTAssertEqual([input readInt32], value);
+    XCTAssertEqual([input readInt32], INT32_MIN);
+    XCTAssertTrue([input isAtEnd]);
+    [input release];
+  }
+}
+
+- (void)testOverlongVarintFails {
+  // Eleven bytes with the continuation bit set, then a terminator; with and
+  // without the fast path's room after it.
+  NSMutableData *overlong = [NSMutableData data];
+  uint8_t tag = (uint8_t)VPKGPBWireFormatMakeTag(VPKPVeepHeader_FieldNumber_OriginalContentWidth,
+                                                 VPKGPBWireFormatVarint);
+  [overlong appendBytes:&tag length:1];
+  for (int i = 0; i < 11; ++i) {
+    uint8_t b = 0xFF;
+    [overlong appendBytes:&b length:1];
+  }
+  uint8_t end = 0x01;
+  [overlong appendBytes:&end length:1];
+  NSMutableData *padded = [NSMutableData dataWithData:overlong];
+  [padded increaseLengthBy:16];
+
+  for (NSData *data in @[ overlong, padded ]) {
+    NSError *error = nil;
+    XCTAssertNil([VPKPVeepHeader parseFromData:data error:&error]);
+    XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+    XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidVarInt);
+  }
+}
+
+- (void)testTruncatedVarintFails {
+  const uint8_t bytes[] = {
+      (uint8_t)VPKGPBWireFormatMakeTag(VPKPVeepHeader_FieldNumber_OriginalContentWidth,
+                                       VPKGPBWireFormatVarint),
+      0x80, 0x80, 0x80};
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeepHeader parseFromData:[NSData dataWithBytes:bytes length:sizeof(bytes)]
+                                       error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+}
+
+- (void)testPerformanceReadVarints {
+  const NSUInteger count = 1000000;
+  uint32_t seed = 1;
+  NSMutableData *values = [NSMutableData dataWithLength:count * sizeof(uint64_t)];
+  uint64_t *words = values.mutableBytes;
+  for (NSUInteger i = 0; i < count; ++i) {
+    // Spread the values over every encoded length.
+    uint64_t value = ((uint64_t)VPKPTestRandom(&seed) << 32) | VPKPTestRandom(&seed);
+    words[i] = value >> (VPKPTestRandom(&seed) % 64);
+  }
+  NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    for (NSUInteger i = 0; i < count; ++i) {
+      [output writeUInt64NoTag:words[i]];
+    }
+  });
+  [self measureBlock:^{
+    VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+    uint64_t sum = 0;
+    for (NSUInteger i = 0; i < count; ++i) {
+      sum += [input readUInt64];
+    }
+    XCTAssertTrue([input isAtEnd]);
+    XCTAssertNotEqual(sum, 0ULL);
+    [input release];
+  }];
+}
+
+- (void)testPerformanceParseVeep {
+  NSData *data = [VPKPTestVeep(10000) data];
+  [self measureBlock:^{
+    @autoreleasepool {
+      XCTAssertNotNil([VPKPVeep parseFromData:data error:NULL]);
+    }
+  }];
+}
+
+#pragma mark - Strings
+
+- (void)testStringsRoundTrip {
+  for (NSString *string in TestStrings()) {
+    VPKPVeepHeader *header = [VPKPVeepHeader message];
+    header.title = string;
+    NSData *data = [header data];
+    NSError *error = nil;
+    VPKPVeepHeader *parsed = [VPKPVeepHeader parseFromData:data error:&error];
+    XCTAssertNil(error, @"%@", string);
+    NSString *title = parsed.title;
+    XCTAssertEqualObjects(title, string);
+    XCTAssertEqualObjects(string, title);
+    XCTAssertEqual(title.hash, string.hash, @"%@", string);
+    XCTAssertEqual(title.length, string.length, @"%@", string);
+    XCTAssertEqual([title lengthOfBytesUsingEncoding:NSUTF8StringEncoding],
+                   [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding], @"%@", string);
+    XCTAssertEqual(strcmp(title.UTF8String, string.UTF8String), 0, @"%@", string);
+    XCTAssertEqualObjects([[title copy] autorelease], string);
+    XCTAssertEqualObjects([[title mutableCopy] autorelease], string);
+    XCTAssertEqualObjects(@{title : @YES}[string], @YES, @"%@", string);
+    XCTAssertEqualObjects([parsed data], data, @"%@", string);
+  }
+}
+
+- (void)testParsedStringsWriteBackAsRead {
+  VPKPVeepHeader *header = [VPKPVeepHeader message];
+  [header.alternativeContentUrlsArray addObjectsFromArray:TestStrings()];
+  NSData *data = [header data];
+  VPKPVeepHeader *parsed = [VPKPVeepHeader parseFromData:data error:NULL];
+  XCTAssertEqualObjects(parsed, header);
+  XCTAssertEqual([parsed serializedSize], data.length);
+  XCTAssertEqualObjects([parsed data], data);
+  XCTAssertEqualObjects(VPKGPBMessageDataInOnePass(parsed), data);
+  VPKGPBCodedOutputStream *growable = [VPKGPBCodedOutputStream growableStreamWithCapacity:0];
+  [parsed writeToCodedOutputStream:growable];
+  XCTAssertEqualObjects([growable takeWrittenData], data);
+  // The parsed strings can be written into other messages too.
+  VPKPVeepHeader *copied = [VPKPVeepHeader message];
+  [copied.alternativeContentUrlsArray addObjectsFromArray:parsed.alternativeContentUrlsArray];
+  XCTAssertEqualObjects([copied data], data);
+}
+
+- (void)testInvalidUTF8IsRejected {
+  // Padded to make long strings, or left as they are.
+  const char *sequences[] = {
+      "\xFF",             // Never valid.
+      "\xC0\x80",         // Overlong NUL.
+      "\xE0\x80\xAF",     // Overlong '/'.
+      "\xE2\x82",         // Truncated.
+      "\x82",             // Lone continuation byte.
+      "\xED\xA0\x80",     // Surrogate.
+      "\xF4\x90\x80\x80", // Past U+10FFFF.
+  };
+  for (size_t i = 0; i < sizeof(sequences) / sizeof(sequences[0]); ++i) {
+    NSData *sequence = [NSData dataWithBytes:sequences[i] length:strlen(sequences[i])];
+    // Long strings are validated here; short ones by NSString, which is only
+    // relied on for the forms that are invalid in any UTF-8.
+    BOOL checkShort = (i < 5);
+    for (NSNumber *padding in @[ @0, @32 ]) {
+      if (!checkShort && padding.unsignedIntegerValue == 0) {
+        continue;
+      }
+      NSMutableData *bytes = [NSMutableData dataWithLength:padding.unsignedIntegerValue];
+      memset(bytes.mutableBytes, 'a', bytes.length);
+      [bytes appendData:sequence];
+      NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+        [output writeBytes:VPKPVeepHeader_FieldNumber_Title value:bytes];
+      });
+      NSError *error = nil;
+      XCTAssertNil([VPKPVeepHeader parseFromData:data error:&error], @"%zu %@", i, padding);
+      XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+      XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidUTF8, @"%zu %@", i, padding);
+    }
+  }
+}
+
+- (void)testPerformanceParseAndWriteLongStrings {
+  VPKPVeepHeader *header = [VPKPVeepHeader message];
+  for (NSUInteger i = 0; i < 1000; ++i) {
+    [header.alternativeContentUrlsArray
+        addObject:[NSString stringWithFormat:@"https://example.com/東京/%lu/content.mp4",
+                                             (unsigned long)i]];
+  }
+  NSData *data = [header data];
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 100; ++i) {
+      @autoreleasepool {
+        [[VPKPVeepHeader parseFromData:data error:NULL] data];
+      }
+    }
+  }];
+}
+
+#pragma mark - Input Stream Ownership
+
+- (void)testOpensAndClosesUnopenedInputStream {
+  NSInputStream *stream = [NSInputStream inputStreamWithData:[VPKPTestVeep(1) data]];
+  XCTAssertEqual(stream.streamStatus, NSStreamStatusNotOpen);
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithInputStream:stream];
+  XCTAssertNotEqual(stream.streamStatus, NSStreamStatusNotOpen);
+  [input release];
+  XCTAssertEqual(stream.streamStatus, NSStreamStatusClosed);
+}
+
+- (void)testLeavesCallerOpenedInputStreamOpen {
+  NSData *data = [VPKPTestVeep(1) data];
+  NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+  [stream open];
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithInputStream:stream];
+  [input release];
+  XCTAssertEqual(stream.streamStatus, NSStreamStatusOpen);
+  // Nothing was read, so the caller can still read all of it.
+  uint8_t byte;
+  XCTAssertEqual([stream read:&byte maxLength:1], 1);
+  XCTAssertEqual(byte, ((const uint8_t *)data.bytes)[0]);
+  [stream close];
+}
+
+@end
@@ -0,0 +1,306 @@
+//
+//  VPKGPBCodedOutputStreamTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#include <unistd.h>
+
+#import "VPKGPBCodedOutputStream.h"
+#import "VPKPTestVeeps.h"
+
+// Joins segments into one buffer, counting them in segmentCount and noting in
+// refersTo whether any of them points at the given bytes.
+static NSData *JoinedSegments(dispatch_data_t segments, size_t *segmentCount,
+                              const void *referenced, BOOL *refersTo) {
+  NSMutableData *joined = [NSMutableData data];
+  __block size_t count = 0;
+  __block BOOL found = NO;
+  dispatch_data_apply(segments, ^bool(__unused dispatch_data_t region, __unused size_t offset,
+                                      const void *buffer, size_t size) {
+    [joined appendBytes:buffer length:size];
+    ++count;
+    found = found || (referenced != NULL && buffer == referenced);
+    return true;
+  });
+  if (segmentCount) {
+    *segmentCount = count;
+  }
+  if (refersTo) {
+    *refersTo = found;
+  }
+  return joined;
+}
+
+// Where AppendToSink() writes, how often it was called, and whether it
+// should fail instead.
+typedef struct {
+  NSMutableData *data;
+  NSUInteger calls;
+  BOOL fails;
+} Sink;
+
+static BOOL AppendToSink(void *context, const void *bytes, size_t length) {
+  Sink *sink = context;
+  ++sink->calls;
+  if (sink->fails) {
+    errno = ENOSPC;
+    return NO;
+  }
+  [sink->data appendBytes:bytes length:length];
+  return YES;
+}
+
+@interface VPKGPBCodedOutputStreamTests : XCTestCase
+@end
+
+@implementation VPKGPBCodedOutputStreamTests
+
+// Creates an empty file in the temporary directory and opens it for writing.
+// The descriptor is closed and the file removed at the end of the test.
+- (int)openTemporaryFile:(NSString **)path {
+  NSString *template =
+      [NSTemporaryDirectory() stringByAppendingPathComponent:@"VPKGPBCodedOutputStream.XXXXXX"];
+  char *name = strdup(template.fileSystemRepresentation);
+  int fd = mkstemp(name);
+  XCTAssertGreaterThanOrEqual(fd, 0);
+  NSString *created =
+      [[NSFileManager defaultManager] stringWithFileSystemRepresentation:name length:strlen(name)];
+  free(name);
+  [self addTeardownBlock:^{
+    close(fd);
+    [[NSFileManager defaultManager] removeItemAtPath:created error:NULL];
+  }];
+  *path = created;
+  return fd;
+}
+
+#pragma mark - Growable
+
+- (void)testGrowableStreamMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  // Grows from a single byte, through a 4 KB bytes field and many strings.
+  VPKGPBCodedOutputStream *output = [[VPKGPBCodedOutputStream alloc] initGrowableWithCapacity:1];
+  [veep writeToCodedOutputStream:output];
+  XCTAssertEqualObjects([output takeWrittenData], [veep data]);
+
+  // Each take only returns what was written since the last one.
+  VPKPVeepHeader *header = veep.header;
+  [header writeToCodedOutputStream:output];
+  XCTAssertEqualObjects([output takeWrittenData], [header data]);
+  XCTAssertEqualObjects([output takeWrittenData], [NSData data]);
+  [output release];
+}
+
+- (void)testGrowableStreamBatchesMessages {
+  VPKGPBCodedOutputStream *output = [VPKGPBCodedOutputStream growableStreamWithCapacity:0];
+  NSMutableData *expected = [NSMutableData data];
+  for (NSUInteger i = 0; i < 1000; ++i) {
+    VPKPVeepTrackElement *element = VPKPTestTrackElement(i);
+    [element writeDelimitedToCodedOutputStream:output];
+    [expected appendData:[element delimitedData]];
+  }
+  [output flush];
+  XCTAssertEqualObjects([output takeWrittenData], expected);
+}
+
+- (void)testTakeWrittenDataRequiresGrowableStream {
+  NSMutableData *data = [NSMutableData dataWithLength:16];
+  VPKGPBCodedOutputStream *output = [VPKGPBCodedOutputStream streamWithData:data];
+  XCTAssertThrowsSpecificNamed([output takeWrittenData], NSException,
+                               NSInternalInconsistencyException);
+}
+
+- (void)testPerformanceGrowableStreamBatch {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 10000; ++i) {
+    [elements addObject:VPKPTestTrackElement(i)];
+  }
+  [self measureBlock:^{
+    @autoreleasepool {
+      VPKGPBCodedOutputStream *output = [VPKGPBCodedOutputStream growableStreamWithCapacity:0];
+      for (VPKPVeepTrackElement *element in elements) {
+        [element writeDelimitedToCodedOutputStream:output];
+      }
+      [output takeWrittenData];
+    }
+  }];
+}
+
+#pragma mark - Segmented
+
+- (void)testSegmentedStreamMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(20);
+  NSData *thumbnail = veep.header.thumbnailData;
+  VPKGPBCodedOutputStream *output =
+      [[VPKGPBCodedOutputStream alloc] initSegmentedWithReferenceThreshold:1024];
+  [veep writeToCodedOutputStream:output];
+  size_t count = 0;
+  BOOL refersToThumbnail = NO;
+  NSData *joined =
+      JoinedSegments([output takeWrittenSegments], &count, thumbnail.bytes, &refersToThumbnail);
+  XCTAssertEqualObjects(joined, [veep data]);
+  // The fields before the thumbnail, the thumbnail itself, and the rest.
+  XCTAssertGreaterThanOrEqual(count, (size_t)3);
+  XCTAssertTrue(refersToThumbnail);
+
+  // Each take only returns what was written since the last one.
+  XCTAssertEqual(dispatch_data_get_size([output takeWrittenSegments]), (size_t)0);
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(1);
+  [element writeToCodedOutputStream:output];
+  XCTAssertEqualObjects(JoinedSegments([output takeWrittenSegments], NULL, NULL, NULL),
+                        [element data]);
+  [output release];
+}
+
+- (void)testSegmentedStreamWritesLongStrings {
+  VPKPVeepHeader *header = [VPKPVeepHeader message];
+  header.identifier = @"short";
+  header.title = [@"" stringByPaddingToLength:5000 withString:@"title " startingAtIndex:0];
+  header.description_p = [@"Café ☕ " stringByPaddingToLength:5000
+                                                   withString:@"東京"
+                                              startingAtIndex:0];
+  NSData *data = [header data];
+  VPKGPBCodedOutputStream *output =
+      [VPKGPBCodedOutputStream segmentedStreamWithReferenceThreshold:1024];
+  [header writeToCodedOutputStream:output];
+  XCTAssertEqualObjects(JoinedSegments([output takeWrittenSegments], NULL, NULL, NULL), data);
+
+  // Strings from a parse are referenced from their UTF-8 bytes.
+  VPKPVeepHeader *parsed = [VPKPVeepHeader parseFromData:data error:NULL];
+  [parsed writeToCodedOutputStream:output];
+  XCTAssertEqualObjects(JoinedSegments([output takeWrittenSegments], NULL, NULL, NULL), data);
+}
+
+- (void)testSegmentsWrittenToFileDescriptor {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSString *path = nil;
+  int fd = [self openTemporaryFile:&path];
+  VPKGPBCodedOutputStream *output =
+      [VPKGPBCodedOutputStream segmentedStreamWithReferenceThreshold:256];
+  [veep writeToCodedOutputStream:output];
+  [output writeSegmentsToFileDescriptor:fd];
+  // Nothing is left to write a second time.
+  [output writeSegmentsToFileDescriptor:fd];
+  XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [veep data]);
+}
+
+- (void)testTakeWrittenSegmentsRequiresSegmentedStream {
+  VPKGPBCodedOutputStream *growable = [VPKGPBCodedOutputStream growableStreamWithCapacity:0];
+  XCTAssertThrowsSpecificNamed([growable takeWrittenSegments], NSException,
+                               NSInternalInconsistencyException);
+  VPKGPBCodedOutputStream *segmented =
+      [VPKGPBCodedOutputStream segmentedStreamWithReferenceThreshold:0];
+  XCTAssertThrowsSpecificNamed([segmented takeWrittenData], NSException,
+                               NSInternalInconsistencyException);
+}
+
+- (void)testPerformanceSegmentedStreamOfLargeBytes {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  veep.header.thumbnailData = [NSMutableData dataWithLength:16 * 1024 * 1024];
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 100; ++i) {
+      @autoreleasepool {
+        VPKGPBCodedOutputStream *output =
+            [VPKGPBCodedOutputStream segmentedStreamWithReferenceThreshold:0];
+        [veep writeToCodedOutputStream:output];
+        [output takeWrittenSegments];
+      }
+    }
+  }];
+}
+
+#pragma mark - Sinks
+
+- (void)testFileDescriptorStreamMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  for (NSNumber *bufferSize in @[ @0, @1, @7, @4096, @(1 << 20) ]) {
+    NSString *path = nil;
+    int fd = [self openTemporaryFile:&path];
+    VPKGPBCodedOutputStream *output =
+        [[VPKGPBCodedOutputStream alloc] initWithFileDescriptor:fd
+                                                     bufferSize:bufferSize.unsignedIntegerValue];
+    [veep writeToCodedOutputStream:output];
+    [output flush];
+    XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [veep data], @"%@", bufferSize);
+    // The descriptor stays open.
+    [output release];
+    XCTAssertEqual(write(fd, "x", 1), (ssize_t)1);
+  }
+
+  NSString *path = nil;
+  int fd = [self openTemporaryFile:&path];
+  @autoreleasepool {
+    // Flushed when released.
+    [veep writeToCodedOutputStream:[VPKGPBCodedOutputStream streamWithFileDescriptor:fd
+                                                                          bufferSize:0]];
+  }
+  XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [veep data]);
+}
+
+- (void)testWriteFunctionStreamMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSData *data = [veep data];
+  Sink sink = {[NSMutableData data], 0, NO};
+  VPKGPBCodedOutputStream *output =
+      [[VPKGPBCodedOutputStream alloc] initWithWriteFunction:AppendToSink
+                                                     context:&sink
+                                                  bufferSize:1024];
+  [veep writeToCodedOutputStream:output];
+  [output flush];
+  XCTAssertEqualObjects(sink.data, data);
+  XCTAssertGreaterThan(sink.calls, (NSUInteger)1);
+  [output release];
+}
+
+- (void)testWriteFunctionFailureRaises {
+  Sink sink = {[NSMutableData data], 0, YES};
+  VPKGPBCodedOutputStream *output =
+      [[VPKGPBCodedOutputStream alloc] initWithWriteFunction:AppendToSink
+                                                     context:&sink
+                                                  bufferSize:16];
+  @try {
+    [VPKPTestVeep(1) writeToCodedOutputStream:output];
+    XCTFail(@"The write should have failed.");
+  } @catch (NSException *exception) {
+    XCTAssertEqualObjects(exception.name, VPKGPBCodedOutputStreamException_WriteFailed);
+    XCTAssertEqualObjects(exception.reason, @(strerror(ENOSPC)));
+  }
+  XCTAssertEqual(sink.data.length, (NSUInteger)0);
+  [output release];
+}
+
+- (void)testOutputStreamWithBufferSizeMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  for (NSNumber *bufferSize in @[ @0, @1, @7, @(1 << 20) ]) {
+    NSOutputStream *memory = [NSOutputStream outputStreamToMemory];
+    [memory open];
+    VPKGPBCodedOutputStream *output =
+        [[VPKGPBCodedOutputStream alloc] initWithOutputStream:memory
+                                                   bufferSize:bufferSize.unsignedIntegerValue];
+    [veep writeToCodedOutputStream:output];
+    [output flush];
+    XCTAssertEqualObjects([memory propertyForKey:NSStreamDataWrittenToMemoryStreamKey],
+                          [veep data], @"%@", bufferSize);
+    [output release];
+  }
+}
+
+- (void)testPerformanceFileDescriptorStream {
+  VPKPVeep *veep = VPKPTestVeep(10000);
+  NSString *path = nil;
+  int fd = [self openTemporaryFile:&path];
+  [self measureBlock:^{
+    @autoreleasepool {
+      XCTAssertEqual(ftruncate(fd, 0), 0);
+      XCTAssertEqual(lseek(fd, 0, SEEK_SET), (off_t)0);
+      VPKGPBCodedOutputStream *output =
+          [VPKGPBCodedOutputStream streamWithFileDescriptor:fd bufferSize:64 * 1024];
+      [veep writeToCodedOutputStream:output];
+      [output flush];
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,508 @@
+//
+//  VPKGPBMessageParseModeTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKGPBCodedInputStream.h"
+#import "VPKGPBFieldMask.pbobjc.h"
+#import "VPKGPBStruct.pbobjc.h"
+#import "VPKGPBUtilities.h"
+#import "VPKPTestVeeps.h"
+
+// Returns YES if bytes lies within data's storage.
+static BOOL PointsInto(const void *bytes, NSData *data) {
+  const uint8_t *start = data.bytes;
+  return (const uint8_t *)bytes >= start && (const uint8_t *)bytes < start + data.length;
+}
+
+static VPKGPBFieldMask *FieldMask(NSArray<NSString *> *paths) {
+  VPKGPBFieldMask *mask = [VPKGPBFieldMask message];
+  [mask.pathsArray addObjectsFromArray:paths];
+  return mask;
+}
+
+// A list whose first value holds a list holding a value, and so on, depth
+// lists deep, followed by count shallow values.
+static VPKGPBListValue *ListWithOneDeepValue(NSUInteger depth, NSUInteger count) {
+  VPKGPBListValue *list = [VPKGPBListValue message];
+  VPKGPBListValue *innermost = list;
+  for (NSUInteger i = 1; i < depth; ++i) {
+    VPKGPBValue *value = [VPKGPBValue message];
+    [innermost.valuesArray addObject:value];
+    innermost = value.listValue;
+  }
+  for (NSUInteger i = 0; i < count; ++i) {
+    VPKGPBValue *value = [VPKGPBValue message];
+    value.numberValue = i;
+    [list.valuesArray addObject:value];
+  }
+  return list;
+}
+
+@interface VPKGPBMessageParseModeTests : XCTestCase
+@end
+
+@implementation VPKGPBMessageParseModeTests
+
+// Writes data to a new file in the temporary directory, removed at the end
+// of the test.
+- (NSString *)temporaryFileWithData:(NSData *)data {
+  NSString *path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  XCTAssertTrue([data writeToFile:path atomically:NO]);
+  [self addTeardownBlock:^{
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+  }];
+  return path;
+}
+
+#pragma mark - Aliased
+
+- (void)testAliasedParseMatchesParse {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  // Immutable, so it is aliased as is rather than copied first.
+  NSData *data = [[[veep data] copy] autorelease];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseFromAliasedData:data extensionRegistry:nil error:&error];
+  XCTAssertNil(error);
+  XCTAssertEqualObjects(parsed, veep);
+  XCTAssertEqualObjects(parsed, [VPKPVeep parseFromData:data error:NULL]);
+  XCTAssertTrue(PointsInto(parsed.header.thumbnailData.bytes, data));
+  XCTAssertEqualObjects([parsed data], data);
+}
+
+- (void)testDetachCopiesAliasedBytes {
+  VPKPVeep *veep = VPKPTestVeep(3);
+  NSData *data = [[[veep data] copy] autorelease];
+  VPKPVeep *parsed = [VPKPVeep parseFromAliasedData:data extensionRegistry:nil error:NULL];
+  VPKGPBMessageDetachAliasedBytesRecursively(parsed);
+  XCTAssertFalse(PointsInto(parsed.header.thumbnailData.bytes, data));
+  XCTAssertEqualObjects(parsed, veep);
+}
+
+- (void)testMutableInputIsCopied {
+  VPKPVeep *veep = VPKPTestVeep(3);
+  NSMutableData *data = [NSMutableData dataWithData:[veep data]];
+  VPKPVeep *parsed = [VPKPVeep parseFromAliasedData:data extensionRegistry:nil error:NULL];
+  memset(data.mutableBytes, 0, data.length);
+  XCTAssertEqualObjects(parsed, veep);
+}
+
+- (void)testAliasedParseErrors {
+  NSData *data = [VPKPTestVeep(3) data];
+  NSData *truncated = [data subdataWithRange:NSMakeRange(0, data.length / 2)];
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseFromAliasedData:truncated extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+}
+
+- (void)testPerformanceAliasedParseOfLargeBytes {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  veep.header.thumbnailData = [NSMutableData dataWithLength:16 * 1024 * 1024];
+  NSData *data = [[[veep data] copy] autorelease];
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 100; ++i) {
+      @autoreleasepool {
+        XCTAssertNotNil([VPKPVeep parseFromAliasedData:data extensionRegistry:nil error:NULL]);
+      }
+    }
+  }];
+}
+
+#pragma mark - Lazy
+
+- (void)testLazyParseMatchesParse {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSData *data = [veep data];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseLazilyFromData:data extensionRegistry:nil error:&error];
+  XCTAssertNil(error);
+  XCTAssertEqual(parsed.trackElementsArray_Count, (NSUInteger)100);
+  // Written out before and after any element is decoded.
+  XCTAssertEqualObjects([parsed data], data);
+  XCTAssertEqualObjects(parsed.trackElementsArray[42], veep.trackElementsArray[42]);
+  XCTAssertEqualObjects([parsed data], data);
+  XCTAssertEqualObjects(parsed, veep);
+  XCTAssertEqualObjects([[parsed copy] autorelease], veep);
+}
+
+- (void)testLazyArrayMutations {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  VPKPVeep *parsed = [VPKPVeep parseLazilyFromData:[veep data] extensionRegistry:nil error:NULL];
+  NSMutableArray<VPKPVeepTrackElement *> *expected = veep.trackElementsArray;
+  NSMutableArray<VPKPVeepTrackElement *> *elements = parsed.trackElementsArray;
+
+  elements[2].rect.width = 1000;
+  expected[2].rect.width = 1000;
+  [elements removeObjectAtIndex:5];
+  [expected removeObjectAtIndex:5];
+  [elements insertObject:VPKPTestTrackElement(20) atIndex:0];
+  [expected insertObject:VPKPTestTrackElement(20) atIndex:0];
+  elements[7] = VPKPTestTrackElement(21);
+  expected[7] = VPKPTestTrackElement(21);
+  [elements addObject:VPKPTestTrackElement(22)];
+  [expected addObject:VPKPTestTrackElement(22)];
+  [elements removeLastObject];
+  [expected removeLastObject];
+
+  XCTAssertEqualObjects(elements, expected);
+  XCTAssertEqualObjects([parsed data], [veep data]);
+  XCTAssertThrowsSpecificNamed(elements[elements.count], NSException, NSRangeException);
+  id nothing = nil;
+  XCTAssertThrowsSpecificNamed([elements addObject:nothing], NSException,
+                               NSInvalidArgumentException);
+}
+
+- (void)testLazyElementDecodeFailureRaisesOnAccess {
+  // One good element, then one whose header has an invalid UTF-8 title.
+  NSMutableData *data = [NSMutableData dataWithData:[VPKPTestVeep(1) data]];
+  const uint8_t badElement[] = {0x12, 0x06, 0x0A, 0x04, 0x12, 0x02, 0xFF, 0xFE};
+  [data appendBytes:badElement length:sizeof(badElement)];
+
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseFromData:data extensionRegistry:nil error:&error]);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidUTF8);
+
+  // The lazy parse only checks the framing, the element fails when decoded,
+  // and again each time it is accessed.
+  error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseLazilyFromData:data extensionRegistry:nil error:&error];
+  XCTAssertNil(error);
+  NSMutableArray<VPKPVeepTrackElement *> *elements = parsed.trackElementsArray;
+  XCTAssertEqual(elements.count, (NSUInteger)2);
+  XCTAssertEqualObjects(elements[0], VPKPTestTrackElement(0));
+  XCTAssertThrowsSpecificNamed(elements[1], NSException, VPKGPBCodedInputStreamException);
+  XCTAssertThrowsSpecificNamed(elements[1], NSException, VPKGPBCodedInputStreamException);
+  XCTAssertEqual(elements.count, (NSUInteger)2);
+  [elements removeObjectAtIndex:1];
+  XCTAssertEqualObjects([parsed data], [VPKPTestVeep(1) data]);
+}
+
+- (void)testLazyArrayFromSeveralThreads {
+  const NSUInteger count = 1000;
+  VPKPVeep *veep = VPKPTestVeep(count);
+  VPKPVeep *parsed = [VPKPVeep parseLazilyFromData:[veep data] extensionRegistry:nil error:NULL];
+  NSMutableArray<VPKPVeepTrackElement *> *elements = parsed.trackElementsArray;
+  NSArray<VPKPVeepTrackElement *> *expected = veep.trackElementsArray;
+  VPKPVeepTrackElement *extra = VPKPTestTrackElement(count);
+  // Readers decode the same elements at once while a writer appends and
+  // removes past the end.
+  __block NSUInteger mismatches = 0;
+  NSObject *lock = [[NSObject alloc] init];
+  dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^(size_t worker) {
+    for (NSUInteger i = 0; i < count; ++i) {
+      if (worker == 0) {
+        [elements addObject:extra];
+        [elements removeLastObject];
+      } else if (![elements[i] isEqual:expected[i]]) {
+        @synchronized(lock) {
+          ++mismatches;
+        }
+      }
+    }
+  });
+  [lock release];
+  XCTAssertEqual(mismatches, (NSUInteger)0);
+  XCTAssertEqual(elements.count, count);
+}
+
+- (void)testPerformanceLazyParseReadingFewElements {
+  NSData *data = [VPKPTestVeep(10000) data];
+  [self measureBlock:^{
+    @autoreleasepool {
+      VPKPVeep *parsed = [VPKPVeep parseLazilyFromData:data extensionRegistry:nil error:NULL];
+      for (NSUInteger i = 0; i < 10000; i += 1000) {
+        XCTAssertNotNil(parsed.trackElementsArray[i]);
+      }
+    }
+  }];
+}
+
+#pragma mark - Mapped Files
+
+- (void)testFileParseMatchesParse {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSString *path = [self temporaryFileWithData:[veep data]];
+  NSError *error = nil;
+  XCTAssertEqualObjects([VPKPVeep parseFromFileAtPath:path error:&error], veep);
+  XCTAssertNil(error);
+  XCTAssertEqualObjects([VPKPVeep parseFromFileAtPath:path extensionRegistry:nil error:&error],
+                        veep);
+  XCTAssertNil(error);
+}
+
+- (void)testFileMergeMatchesMerge {
+  VPKPVeep *first = VPKPTestVeep(5);
+  VPKPVeep *second = VPKPTestVeep(7);
+  NSString *path = [self temporaryFileWithData:[second data]];
+  VPKPVeep *expected = [[first copy] autorelease];
+  [expected mergeFrom:second];
+  NSError *error = nil;
+  XCTAssertTrue([first mergeFromFileAtPath:path extensionRegistry:nil error:&error]);
+  XCTAssertNil(error);
+  XCTAssertEqualObjects(first, expected);
+}
+
+- (void)testFileErrors {
+  NSError *error = nil;
+  NSString *missing = [NSTemporaryDirectory()
+      stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  XCTAssertNil([VPKPVeep parseFromFileAtPath:missing error:&error]);
+  XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+
+  NSData *data = [VPKPTestVeep(5) data];
+  NSString *truncated =
+      [self temporaryFileWithData:[data subdataWithRange:NSMakeRange(0, data.length - 5)]];
+  error = nil;
+  XCTAssertNil([VPKPVeep parseFromFileAtPath:truncated error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+
+  error = nil;
+  XCTAssertFalse([[VPKPVeep message] mergeFromFileAtPath:truncated
+                                       extensionRegistry:nil
+                                                   error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+}
+
+#pragma mark - Arena
+
+- (void)testArenaParseMatchesParse {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSData *data = [veep data];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseFromDataUsingArena:data extensionRegistry:nil error:&error];
+  XCTAssertNil(error);
+  XCTAssertEqualObjects(parsed, veep);
+  XCTAssertEqualObjects([parsed data], data);
+
+  // Messages from the arena can be mutated like any other.
+  parsed.trackElementsArray[0].header.title = @"changed";
+  [parsed.trackElementsArray addObject:VPKPTestTrackElement(100)];
+  veep.trackElementsArray[0].header.title = @"changed";
+  [veep.trackElementsArray addObject:VPKPTestTrackElement(100)];
+  XCTAssertEqualObjects(parsed, veep);
+}
+
+- (void)testArenaMessagesOutliveTheirRoot {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  VPKPVeepTrackElement *element = nil;
+  VPKPVeepHeader *header = nil;
+  @autoreleasepool {
+    VPKPVeep *parsed = [VPKPVeep parseFromDataUsingArena:[veep data]
+                                       extensionRegistry:nil
+                                                   error:NULL];
+    element = [parsed.trackElementsArray[3] retain];
+    header = [parsed.header retain];
+  }
+  XCTAssertEqualObjects(element, veep.trackElementsArray[3]);
+  [element release];
+  // The arena stays alive for the header alone.
+  XCTAssertEqualObjects(header, veep.header);
+  XCTAssertEqualObjects([[header copy] autorelease], veep.header);
+  [header release];
+}
+
+- (void)testArenaParseErrors {
+  NSData *data = [VPKPTestVeep(10) data];
+  NSData *truncated = [data subdataWithRange:NSMakeRange(0, data.length - 3)];
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseFromDataUsingArena:truncated extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+}
+
+- (void)testArenaParsesOnSeveralThreads {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSData *data = [veep data];
+  __block NSUInteger mismatches = 0;
+  NSObject *lock = [[NSObject alloc] init];
+  dispatch_apply(16, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^(size_t i) {
+    @autoreleasepool {
+      VPKPVeep *parsed = [VPKPVeep parseFromDataUsingArena:data extensionRegistry:nil error:NULL];
+      if (![parsed isEqual:veep]) {
+        @synchronized(lock) {
+          ++mismatches;
+        }
+      }
+    }
+  });
+  [lock release];
+  XCTAssertEqual(mismatches, (NSUInteger)0);
+}
+
+- (void)testPerformanceArenaParse {
+  NSData *data = [VPKPTestVeep(10000) data];
+  [self measureBlock:^{
+    // Includes releasing the messages, which the arena makes cheaper too.
+    @autoreleasepool {
+      XCTAssertNotNil([VPKPVeep parseFromDataUsingArena:data extensionRegistry:nil error:NULL]);
+    }
+  }];
+}
+
+#pragma mark - Concurrent
+
+- (void)testConcurrentParseMatchesParse {
+  // Fewer elements than one worker decodes, and several runs of them.
+  for (NSNumber *count in @[ @0, @1, @63, @64, @65, @1000 ]) {
+    VPKPVeep *veep = VPKPTestVeep(count.unsignedIntegerValue);
+    NSData *data = [veep data];
+    NSError *error = nil;
+    VPKPVeep *parsed = [VPKPVeep parseConcurrentlyFromData:data extensionRegistry:nil error:&error];
+    XCTAssertNil(error, @"%@", count);
+    XCTAssertEqualObjects(parsed, veep, @"%@", count);
+    XCTAssertEqualObjects(parsed, [VPKPVeep parseFromData:data error:NULL], @"%@", count);
+    XCTAssertEqualObjects([parsed data], data, @"%@", count);
+  }
+}
+
+- (void)testConcurrentParseOfInterleavedFields {
+  // A second header follows the first run of elements, so the two headers
+  // are merged and the elements are kept in order.
+  VPKPVeep *first = VPKPTestVeep(100);
+  VPKPVeep *second = VPKPTestVeep(100);
+  second.header.title = @"second";
+  NSMutableData *data = [NSMutableData dataWithData:[first data]];
+  [data appendData:[second data]];
+  VPKPVeep *expected = [VPKPVeep parseFromData:data error:NULL];
+  XCTAssertEqualObjects(expected.header.title, @"second");
+  XCTAssertEqual(expected.trackElementsArray_Count, (NSUInteger)200);
+  XCTAssertEqualObjects([VPKPVeep parseConcurrentlyFromData:data extensionRegistry:nil error:NULL],
+                        expected);
+}
+
+- (void)testConcurrentParseRecursionLimit {
+  // The deep value is one element, decoded by a worker of its own, and must
+  // fail as it does in the serial parse.
+  NSData *shallow = [ListWithOneDeepValue(40, 500) data];
+  NSData *deep = [ListWithOneDeepValue(60, 500) data];
+  NSError *error = nil;
+  XCTAssertEqualObjects([VPKGPBListValue parseConcurrentlyFromData:shallow
+                                                 extensionRegistry:nil
+                                                             error:&error],
+                        [VPKGPBListValue parseFromData:shallow error:NULL]);
+  XCTAssertNil(error);
+
+  XCTAssertNil([VPKGPBListValue parseFromData:deep error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorRecursionDepthExceeded);
+  error = nil;
+  XCTAssertNil([VPKGPBListValue parseConcurrentlyFromData:deep extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorRecursionDepthExceeded);
+}
+
+- (void)testConcurrentParseErrors {
+  // An element with an invalid UTF-8 title, well into the second run.
+  NSMutableData *data = [NSMutableData dataWithData:[VPKPTestVeep(100) data]];
+  const uint8_t badElement[] = {0x12, 0x06, 0x0A, 0x04, 0x12, 0x02, 0xFF, 0xFE};
+  [data appendBytes:badElement length:sizeof(badElement)];
+  [data appendData:[VPKPTestVeep(100) data]];
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseConcurrentlyFromData:data extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidUTF8);
+
+  // Framing errors are found before any element is decoded.
+  NSData *good = [VPKPTestVeep(100) data];
+  NSData *truncated = [good subdataWithRange:NSMakeRange(0, good.length - 3)];
+  error = nil;
+  XCTAssertNil([VPKPVeep parseConcurrentlyFromData:truncated extensionRegistry:nil error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertEqual(error.code, VPKGPBCodedInputStreamErrorInvalidSize);
+}
+
+- (void)testPerformanceSerialParseOf100000Elements {
+  NSData *data = [VPKPTestVeep(100000) data];
+  [self measureBlock:^{
+    @autoreleasepool {
+      XCTAssertNotNil([VPKPVeep parseFromData:data error:NULL]);
+    }
+  }];
+}
+
+- (void)testPerformanceConcurrentParseOf10000Elements {
+  NSData *data = [VPKPTestVeep(10000) data];
+  [self measureBlock:^{
+    @autoreleasepool {
+      XCTAssertNotNil([VPKPVeep parseConcurrentlyFromData:data extensionRegistry:nil error:NULL]);
+    }
+  }];
+}
+
+- (void)testPerformanceConcurrentParseOf100000Elements {
+  NSData *data = [VPKPTestVeep(100000) data];
+  [self measureBlock:^{
+    @autoreleasepool {
+      XCTAssertNotNil([VPKPVeep parseConcurrentlyFromData:data extensionRegistry:nil error:NULL]);
+    }
+  }];
+}
+
+#pragma mark - Field Mask
+
+- (void)testFieldMaskParsesOnlyNamedFields {
+  VPKPVeep *veep = VPKPTestVeep(20);
+  NSData *data = [veep data];
+  NSError *error = nil;
+  VPKPVeep *parsed = [VPKPVeep parseFromData:data
+                                   fieldMask:FieldMask(@[ @"header.title", @"track_elements.rect" ])
+                                       error:&error];
+  XCTAssertNil(error);
+
+  VPKPVeep *expected = [VPKPVeep message];
+  expected.header.title = veep.header.title;
+  for (VPKPVeepTrackElement *element in veep.trackElementsArray) {
+    VPKPVeepTrackElement *selected = [VPKPVeepTrackElement message];
+    if (element.dataOneOfCase == VPKPVeepTrackElement_Data_OneOfCase_Rect) {
+      selected.rect = element.rect;
+    }
+    [expected.trackElementsArray addObject:selected];
+  }
+  XCTAssertEqualObjects(parsed, expected);
+  XCTAssertNil(parsed.unknownFields);
+}
+
+- (void)testFieldMaskSelectsWholeFields {
+  VPKPVeep *veep = VPKPTestVeep(20);
+  NSData *data = [veep data];
+  // Either name of a field works, and a path inside a whole field adds
+  // nothing.
+  VPKPVeep *parsed = [VPKPVeep parseFromData:data
+                                   fieldMask:FieldMask(@[ @"header", @"header.title" ])
+                                       error:NULL];
+  XCTAssertEqualObjects(parsed.header, veep.header);
+  XCTAssertEqual(parsed.trackElementsArray_Count, (NSUInteger)0);
+
+  parsed = [VPKPVeep parseFromData:data
+                         fieldMask:FieldMask(@[ @"trackElementsArray", @"track_elements.tag" ])
+                             error:NULL];
+  XCTAssertFalse(parsed.hasHeader);
+  XCTAssertEqualObjects(parsed.trackElementsArray, veep.trackElementsArray);
+
+  parsed = [VPKPVeep parseFromData:data fieldMask:FieldMask(@[ @"header", @"track_elements" ])
+                             error:NULL];
+  XCTAssertEqualObjects(parsed, veep);
+}
+
+- (void)testFieldMaskErrors {
+  NSData *data = [VPKPTestVeep(3) data];
+  for (NSString *path in @[ @"nope", @"header.nope", @"header.title.length", @"" ]) {
+    NSError *error = nil;
+    XCTAssertNil([VPKPVeep parseFromData:data fieldMask:FieldMask(@[ path ]) error:&error],
+                 @"%@", path);
+    XCTAssertEqualObjects(error.domain, VPKGPBMessageErrorDomain, @"%@", path);
+    XCTAssertEqual(error.code, VPKGPBMessageErrorCodeOther, @"%@", path);
+  }
+
+  // Skipped fields are still framed, so malformed input fails.
+  NSData *truncated = [data subdataWithRange:NSMakeRange(0, data.length - 3)];
+  NSError *error = nil;
+  XCTAssertNil([VPKPVeep parseFromData:truncated
+                             fieldMask:FieldMask(@[ @"header.title" ])
+                                 error:&error]);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+}
+
+@end
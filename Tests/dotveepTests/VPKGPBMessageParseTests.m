@@ -0,0 +1,283 @@
+//
+//  VPKGPBMessageParseTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKGPBCodedInputStream.h"
+#import "VPKGPBCodedOutputStream.h"
+#import "VPKGPBDescriptor.h"
+#import "VPKGPBStruct.pbobjc.h"
+#import "VPKGPBType.pbobjc.h"
+#import "VPKGPBUnknownField.h"
+#import "VPKGPBUnknownFieldSet.h"
+#import "VPKGPBWireFormat.h"
+#import "VPKPTestVeeps.h"
+
+static NSData *EncodedData(void (^block)(VPKGPBCodedOutputStream *output)) {
+  NSOutputStream *memory = [NSOutputStream outputStreamToMemory];
+  [memory open];
+  VPKGPBCodedOutputStream *output = [[VPKGPBCodedOutputStream alloc] initWithOutputStream:memory];
+  block(output);
+  [output flush];
+  [output release];
+  NSData *data = [memory propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+  [memory close];
+  return data;
+}
+
+// A list holding a value holding a list, and so on, depth lists deep.
+static VPKGPBListValue *DeeplyNestedList(NSUInteger depth) {
+  VPKGPBListValue *list = [VPKGPBListValue message];
+  VPKGPBListValue *innermost = list;
+  for (NSUInteger i = 1; i < depth; ++i) {
+    VPKGPBValue *value = [VPKGPBValue message];
+    [innermost.valuesArray addObject:value];
+    innermost = value.listValue;
+  }
+  VPKGPBValue *leaf = [VPKGPBValue message];
+  leaf.stringValue = @"leaf";
+  [innermost.valuesArray addObject:leaf];
+  return list;
+}
+
+// Malformed inputs, the class to parse each as, and the error each fails
+// with.
+typedef struct {
+  const char *name;
+  const uint8_t *bytes;
+  size_t length;
+  NSInteger code;
+} MalformedInput;
+
+static const uint8_t kZeroFieldNumber[] = {0x00};
+static const uint8_t kInvalidWireType[] = {0x0F, 0x00};
+static const uint8_t kInvalidUTF8[] = {0x12, 0x02, 0xFF, 0xFE};
+static const uint8_t kStringPastEnd[] = {0x12, 0x05, 'a'};
+static const uint8_t kMessagePastEnd[] = {0x0A, 0x05, 0x08, 0x01};
+
+#define MALFORMED(bytes, code) {#bytes, bytes, sizeof(bytes), code}
+static const MalformedInput kMalformedInputs[] = {
+    MALFORMED(kZeroFieldNumber, VPKGPBCodedInputStreamErrorInvalidTag),
+    MALFORMED(kInvalidWireType, VPKGPBCodedInputStreamErrorInvalidTag),
+    MALFORMED(kInvalidUTF8, VPKGPBCodedInputStreamErrorInvalidUTF8),
+    MALFORMED(kStringPastEnd, VPKGPBCodedInputStreamErrorInvalidSize),
+    MALFORMED(kMessagePastEnd, VPKGPBCodedInputStreamErrorInvalidSubsectionLimit),
+};
+#undef MALFORMED
+
+static NSData *DelimitedData(NSData *payload) {
+  return EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeBytesNoTag:payload];
+  });
+}
+
+@interface VPKGPBMessageParseTests : XCTestCase
+@end
+
+@implementation VPKGPBMessageParseTests
+
+#pragma mark - Field Lookup
+
+- (void)testFieldWithNumberFindsEveryField {
+  NSArray<Class> *classes = @[
+    [VPKPVeep class], [VPKPVeepHeader class], [VPKPVeepTrackElement class],
+    [VPKPVeepTrackHeader class], [VPKGPBType class], [VPKGPBField class]
+  ];
+  for (Class messageClass in classes) {
+    VPKGPBDescriptor *descriptor = [messageClass descriptor];
+    NSMutableIndexSet *numbers = [NSMutableIndexSet indexSet];
+    for (VPKGPBFieldDescriptor *field in descriptor.fields) {
+      XCTAssertEqual([descriptor fieldWithNumber:field.number], field, @"%@", messageClass);
+      [numbers addIndex:field.number];
+    }
+    for (uint32_t number = 0; number < 64; ++number) {
+      if (![numbers containsIndex:number]) {
+        XCTAssertNil([descriptor fieldWithNumber:number], @"%@ %u", messageClass, number);
+      }
+    }
+    XCTAssertNil([descriptor fieldWithNumber:536870911]);
+  }
+}
+
+- (void)testParsesFieldsInAnyOrder {
+  VPKPRect *rect = [VPKPRect message];
+  rect.x = 1;
+  rect.y = 2;
+  rect.width = 3;
+  rect.height = 4;
+  NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeFloat:VPKPRect_FieldNumber_Height value:4];
+    [output writeFloat:VPKPRect_FieldNumber_X value:1];
+    [output writeFloat:VPKPRect_FieldNumber_Width value:3];
+    [output writeFloat:VPKPRect_FieldNumber_Y value:2];
+  });
+  XCTAssertEqualObjects([VPKPRect parseFromData:data error:NULL], rect);
+
+  // A repeated field split up by other fields, and a oneof set twice.
+  VPKPVeepHeader *header = VPKPTestVeep(0).header;
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(0);
+  data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeString:VPKPVeepHeader_FieldNumber_AlternativeContentUrlsArray
+                  value:header.alternativeContentUrlsArray[0]];
+    [output writeString:VPKPVeepHeader_FieldNumber_Title value:@"replaced"];
+    [output writeString:VPKPVeepHeader_FieldNumber_AlternativeContentUrlsArray
+                  value:header.alternativeContentUrlsArray[1]];
+    [output writeRawData:[header data]];
+  });
+  VPKPVeepHeader *expected = [[header copy] autorelease];
+  [expected.alternativeContentUrlsArray insertObject:header.alternativeContentUrlsArray[1]
+                                             atIndex:0];
+  [expected.alternativeContentUrlsArray insertObject:header.alternativeContentUrlsArray[0]
+                                             atIndex:0];
+  XCTAssertEqualObjects([VPKPVeepHeader parseFromData:data error:NULL], expected);
+
+  data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeMessage:VPKPVeepTrackElement_FieldNumber_Rect value:VPKPTestTrackElement(1).rect];
+    [output writeRawData:[element data]];
+  });
+  VPKPVeepTrackElement *parsed = [VPKPVeepTrackElement parseFromData:data error:NULL];
+  XCTAssertEqual(parsed.dataOneOfCase, VPKPVeepTrackElement_Data_OneOfCase_DiscreteTimeRangeRect);
+  XCTAssertEqualObjects(parsed, element);
+}
+
+- (void)testUnknownNumbersAndWireTypesAreKept {
+  NSData *data = EncodedData(^(VPKGPBCodedOutputStream *output) {
+    [output writeFloat:VPKPRect_FieldNumber_X value:1.5f];
+    // A known number with the wrong wire type, and numbers the message does
+    // not have, below and past the known ones.
+    [output writeInt32:VPKPRect_FieldNumber_Y value:7];
+    [output writeFixed64:5 value:42];
+    [output writeString:100000 value:@"far away"];
+  });
+  VPKPRect *rect = [VPKPRect parseFromData:data error:NULL];
+  XCTAssertEqual(rect.x, 1.5f);
+  XCTAssertEqual(rect.y, 0.0f);
+  VPKGPBUnknownFieldSet *unknownFields = rect.unknownFields;
+  XCTAssertEqual([unknownFields countOfFields], (NSUInteger)3);
+  XCTAssertEqual([unknownFields getField:VPKPRect_FieldNumber_Y].varintList.count, (NSUInteger)1);
+  XCTAssertEqual([[unknownFields getField:5].fixed64List valueAtIndex:0], (uint64_t)42);
+  XCTAssertEqual([unknownFields getField:100000].lengthDelimitedList.count, (NSUInteger)1);
+  XCTAssertEqualObjects([rect data], data);
+}
+
+#pragma mark - Errors
+
+- (void)assertError:(NSError *)error code:(NSInteger)code name:(const char *)name {
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain, @"%s", name);
+  XCTAssertEqual(error.code, code, @"%s", name);
+}
+
+- (void)testErrorCodesFromEachEntryPoint {
+  for (size_t i = 0; i < sizeof(kMalformedInputs) / sizeof(kMalformedInputs[0]); ++i) {
+    const MalformedInput *malformed = &kMalformedInputs[i];
+    NSData *data = [NSData dataWithBytes:malformed->bytes length:malformed->length];
+    // kMessagePastEnd is a veep header cut short, the rest are header fields.
+    Class messageClass = (malformed->bytes == kMessagePastEnd) ? [VPKPVeep class]
+                                                                : [VPKPVeepHeader class];
+
+    NSError *error = nil;
+    XCTAssertNil([messageClass parseFromData:data error:&error]);
+    [self assertError:error code:malformed->code name:malformed->name];
+
+    error = nil;
+    XCTAssertNil([messageClass parseFromData:data extensionRegistry:nil error:&error]);
+    [self assertError:error code:malformed->code name:malformed->name];
+
+    error = nil;
+    XCTAssertNil([[[messageClass alloc] initWithData:data error:&error] autorelease]);
+    [self assertError:error code:malformed->code name:malformed->name];
+
+    error = nil;
+    VPKGPBCodedInputStream *input = [VPKGPBCodedInputStream streamWithData:data];
+    XCTAssertNil([messageClass parseFromCodedInputStream:input extensionRegistry:nil error:&error]);
+    [self assertError:error code:malformed->code name:malformed->name];
+
+    error = nil;
+    input = [VPKGPBCodedInputStream streamWithData:DelimitedData(data)];
+    XCTAssertNil([messageClass parseDelimitedFromCodedInputStream:input
+                                                extensionRegistry:nil
+                                                            error:&error]);
+    [self assertError:error code:malformed->code name:malformed->name];
+  }
+}
+
+- (void)testRecursionLimit {
+  NSData *shallow = [DeeplyNestedList(40) data];
+  NSData *deep = [DeeplyNestedList(60) data];
+  NSError *error = nil;
+  XCTAssertNotNil([VPKGPBListValue parseFromData:shallow error:&error]);
+  XCTAssertNil(error);
+  XCTAssertNil([VPKGPBListValue parseFromData:deep error:&error]);
+  [self assertError:error code:VPKGPBCodedInputStreamErrorRecursionDepthExceeded name:"deep"];
+
+  error = nil;
+  VPKGPBCodedInputStream *input = [VPKGPBCodedInputStream streamWithData:DelimitedData(deep)];
+  XCTAssertNil([VPKGPBListValue parseDelimitedFromCodedInputStream:input
+                                                 extensionRegistry:nil
+                                                             error:&error]);
+  [self assertError:error code:VPKGPBCodedInputStreamErrorRecursionDepthExceeded name:"deep"];
+}
+
+- (void)testDelimitedStreamAfterAFailedMessage {
+  VPKPVeepHeader *header = VPKPTestVeep(0).header;
+  NSMutableData *data = [NSMutableData dataWithData:[header delimitedData]];
+  [data appendData:DelimitedData([NSData dataWithBytes:kInvalidUTF8 length:sizeof(kInvalidUTF8)])];
+  [data appendData:[header delimitedData]];
+  VPKGPBCodedInputStream *input = [VPKGPBCodedInputStream streamWithData:data];
+
+  NSError *error = nil;
+  XCTAssertEqualObjects([VPKPVeepHeader parseDelimitedFromCodedInputStream:input
+                                                          extensionRegistry:nil
+                                                                      error:&error],
+                        header);
+  XCTAssertNil(error);
+  XCTAssertNil([VPKPVeepHeader parseDelimitedFromCodedInputStream:input
+                                                extensionRegistry:nil
+                                                            error:&error]);
+  [self assertError:error code:VPKGPBCodedInputStreamErrorInvalidUTF8 name:"invalid payload"];
+  // The bad payload was consumed whole, and its error is not carried over.
+  XCTAssertEqualObjects([VPKPVeepHeader parseDelimitedFromCodedInputStream:input
+                                                          extensionRegistry:nil
+                                                                      error:&error],
+                        header);
+  XCTAssertNil(error);
+}
+
+- (void)testTruncatedDelimitedMessage {
+  VPKPVeepHeader *header = VPKPTestVeep(0).header;
+  NSData *delimited = [header delimitedData];
+  NSMutableData *data = [NSMutableData dataWithData:delimited];
+  [data appendData:[delimited subdataWithRange:NSMakeRange(0, delimited.length - 10)]];
+  VPKGPBCodedInputStream *input = [VPKGPBCodedInputStream streamWithData:data];
+
+  NSError *error = nil;
+  XCTAssertEqualObjects([VPKPVeepHeader parseDelimitedFromCodedInputStream:input
+                                                          extensionRegistry:nil
+                                                                      error:&error],
+                        header);
+  XCTAssertNil(error);
+  XCTAssertNil([VPKPVeepHeader parseDelimitedFromCodedInputStream:input
+                                                extensionRegistry:nil
+                                                            error:&error]);
+  [self assertError:error code:VPKGPBCodedInputStreamErrorInvalidSize name:"truncated"];
+}
+
+- (void)testPerformanceRejectMalformedData {
+  // A valid header up to a bad string at the end, so each parse does some
+  // work before failing.
+  NSMutableData *data = [NSMutableData dataWithData:[VPKPTestVeep(0).header data]];
+  [data appendBytes:kInvalidUTF8 length:sizeof(kInvalidUTF8)];
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 10000; ++i) {
+      @autoreleasepool {
+        NSError *error = nil;
+        XCTAssertNil([VPKPVeepHeader parseFromData:data error:&error]);
+        XCTAssertNotNil(error);
+      }
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,218 @@
+//
+//  VPKGPBMessageWriteTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#include <stdatomic.h>
+
+#import "VPKGPBCodedInputStream.h"
+#import "VPKGPBCodedOutputStream.h"
+#import "VPKGPBDuration.pbobjc.h"
+#import "VPKGPBStruct.pbobjc.h"
+#import "VPKGPBUtilities.h"
+#import "VPKPTestVeeps.h"
+
+// Builds depth levels of lists nested in values, with width numbers and
+// strings at each level.
+static VPKGPBListValue *NestedList(NSUInteger depth, NSUInteger width) {
+  VPKGPBListValue *list = [VPKGPBListValue message];
+  for (NSUInteger i = 0; i < width; ++i) {
+    VPKGPBValue *number = [VPKGPBValue message];
+    number.numberValue = (double)i / 3;
+    [list.valuesArray addObject:number];
+    VPKGPBValue *string = [VPKGPBValue message];
+    string.stringValue = [NSString stringWithFormat:@"level %lu, item %lu",
+                                                    (unsigned long)depth, (unsigned long)i];
+    [list.valuesArray addObject:string];
+  }
+  if (depth > 1) {
+    VPKGPBValue *nested = [VPKGPBValue message];
+    nested.listValue = NestedList(depth - 1, width);
+    [list.valuesArray addObject:nested];
+  }
+  return list;
+}
+
+static NSData *WrittenToOutputStream(void (^block)(VPKGPBCodedOutputStream *output)) {
+  NSOutputStream *memory = [NSOutputStream outputStreamToMemory];
+  [memory open];
+  VPKGPBCodedOutputStream *output = [[VPKGPBCodedOutputStream alloc] initWithOutputStream:memory];
+  block(output);
+  [output flush];
+  [output release];
+  NSData *data = [memory propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+  [memory close];
+  return data;
+}
+
+@interface VPKGPBMessageWriteTests : XCTestCase
+@end
+
+@implementation VPKGPBMessageWriteTests
+
+- (void)testDataRoundTrips {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSData *data = [veep data];
+  XCTAssertEqual(data.length, [veep serializedSize]);
+  XCTAssertEqualObjects([VPKPVeep parseFromData:data error:NULL], veep);
+
+  VPKGPBListValue *list = NestedList(40, 3);
+  XCTAssertEqualObjects([VPKGPBListValue parseFromData:[list data] error:NULL], list);
+}
+
+- (void)testWritesSeeMutationsSinceLastWrite {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  NSData *before = [veep data];
+  veep.trackElementsArray[3].header.title = @"A much longer title than the one it replaces";
+  veep.trackElementsArray[4].rect.width = 0;
+  NSData *after = [veep data];
+  XCTAssertNotEqualObjects(after, before);
+  XCTAssertEqualObjects([VPKPVeep parseFromData:after error:NULL], veep);
+  XCTAssertEqualObjects([veep delimitedData],
+                        WrittenToOutputStream(^(VPKGPBCodedOutputStream *output) {
+                          [veep writeDelimitedToCodedOutputStream:output];
+                        }));
+}
+
+- (void)testSharedSubmessagesWriteOnce {
+  // The same element at several places in the tree, and the same header
+  // under elements of different sizes.
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(0);
+  VPKPVeepTrackElement *other = VPKPTestTrackElement(1);
+  other.header = element.header;
+  VPKPVeep *veep = [VPKPVeep message];
+  [veep.trackElementsArray addObject:element];
+  [veep.trackElementsArray addObject:other];
+  [veep.trackElementsArray addObject:element];
+  NSData *data = [veep data];
+  XCTAssertEqual(data.length, [veep serializedSize]);
+  VPKPVeep *parsed = [VPKPVeep parseFromData:data error:NULL];
+  XCTAssertEqualObjects(parsed, veep);
+}
+
+- (void)testWriteMessageMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(20);
+  NSData *written = WrittenToOutputStream(^(VPKGPBCodedOutputStream *output) {
+    for (VPKPVeepTrackElement *element in veep.trackElementsArray) {
+      [output writeMessage:VPKPVeep_FieldNumber_TrackElementsArray value:element];
+    }
+  });
+  VPKPVeep *elementsOnly = [[veep copy] autorelease];
+  elementsOnly.hasHeader = NO;
+  XCTAssertEqualObjects(written, [elementsOnly data]);
+}
+
+- (void)testLazyArrayMutatedWhileWriting {
+  const NSUInteger count = 200;
+  VPKPVeep *veep = [VPKPVeep parseLazilyFromData:[VPKPTestVeep(count) data]
+                               extensionRegistry:nil
+                                           error:NULL];
+  NSMutableArray<VPKPVeepTrackElement *> *elements = veep.trackElementsArray;
+  VPKPVeepTrackElement *extra = VPKPTestTrackElement(count);
+
+  // Each write must be sized and written from the same elements, whatever
+  // the other thread does in between.
+  atomic_bool stop = NO;
+  atomic_bool *stopPtr = &stop;
+  dispatch_group_t group = dispatch_group_create();
+  dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+    while (!atomic_load(stopPtr)) {
+      [elements addObject:extra];
+      [elements removeLastObject];
+    }
+  });
+  for (NSUInteger i = 0; i < 500; ++i) {
+    NSError *error = nil;
+    VPKPVeep *parsed = [VPKPVeep parseFromData:[veep data] error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue(parsed.trackElementsArray_Count == count ||
+                  parsed.trackElementsArray_Count == count + 1);
+  }
+  atomic_store(&stop, YES);
+  dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+  dispatch_release(group);
+}
+
+- (void)testPerformanceWideTree {
+  VPKPVeep *veep = VPKPTestVeep(10000);
+  [self measureBlock:^{
+    @autoreleasepool {
+      [veep data];
+    }
+  }];
+}
+
+- (void)testPerformanceDeepTree {
+  // Without the sizes recorded while sizing, every level of nesting would
+  // size everything below it again.
+  VPKGPBListValue *list = NestedList(45, 20);
+  [self measureBlock:^{
+    @autoreleasepool {
+      for (NSUInteger i = 0; i < 100; ++i) {
+        [list data];
+      }
+    }
+  }];
+}
+
+#pragma mark - One Pass
+
+- (void)testOnePassMatchesData {
+  VPKGPBValue *list = [VPKGPBValue message];
+  list.listValue = NestedList(3, 2);
+  VPKGPBValue *string = [VPKGPBValue message];
+  string.stringValue = @"☕";
+  VPKGPBValue *none = [VPKGPBValue message];
+  none.nullValue = VPKGPBNullValue_NullValue;
+  VPKGPBStruct *fields = [VPKGPBStruct message];
+  [fields.fields addEntriesFromDictionary:@{@"list" : list, @"café" : string, @"none" : none}];
+  VPKGPBDuration *negative = [VPKGPBDuration message];
+  negative.seconds = INT64_MIN;
+  negative.nanos = -1;
+  NSArray<VPKGPBMessage *> *messages = @[
+    VPKPTestVeep(100), VPKPTestVeep(0), [VPKPVeep message], NestedList(40, 3), fields, negative
+  ];
+  for (VPKGPBMessage *message in messages) {
+    XCTAssertEqualObjects(VPKGPBMessageDataInOnePass(message), [message data], @"%@",
+                          [message class]);
+  }
+}
+
+- (void)testOnePassOfParsedMessages {
+  // Unknown fields and elements that were never decoded are written too.
+  NSMutableData *data = [NSMutableData dataWithData:[VPKPTestVeep(50) data]];
+  const uint8_t unknownField[] = {0x78, 0x2A};
+  [data appendBytes:unknownField length:sizeof(unknownField)];
+  VPKPVeep *parsed = [VPKPVeep parseFromData:data error:NULL];
+  XCTAssertNotNil(parsed.unknownFields);
+  XCTAssertEqualObjects(VPKGPBMessageDataInOnePass(parsed), data);
+
+  VPKPVeep *lazy = [VPKPVeep parseLazilyFromData:data extensionRegistry:nil error:NULL];
+  XCTAssertEqualObjects(VPKGPBMessageDataInOnePass(lazy), data);
+  XCTAssertNotNil(lazy.trackElementsArray[7]);
+  XCTAssertEqualObjects(VPKGPBMessageDataInOnePass(lazy), data);
+}
+
+- (void)testPerformanceOnePassWideTree {
+  VPKPVeep *veep = VPKPTestVeep(10000);
+  [self measureBlock:^{
+    @autoreleasepool {
+      VPKGPBMessageDataInOnePass(veep);
+    }
+  }];
+}
+
+- (void)testPerformanceOnePassDeepTree {
+  VPKGPBListValue *list = NestedList(45, 20);
+  [self measureBlock:^{
+    @autoreleasepool {
+      for (NSUInteger i = 0; i < 100; ++i) {
+        VPKGPBMessageDataInOnePass(list);
+      }
+    }
+  }];
+}
+
+@end
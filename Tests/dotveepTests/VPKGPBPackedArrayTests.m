@@ -0,0 +1,185 @@
+//
+//  VPKGPBPackedArrayTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#include <float.h>
+
+#import "VPKGPBCodedInputStream.h"
+#import "VPKGPBCodedOutputStream.h"
+#import "VPKPTestPackedArrays.pbobjc.h"
+#import "VPKPTestVeeps.h"
+
+static NSData *EncodedData(void (^block)(VPKGPBCodedOutputStream *output)) {
+  VPKGPBCodedOutputStream *output = [VPKGPBCodedOutputStream growableStreamWithCapacity:0];
+  block(output);
+  return [output takeWrittenData];
+}
+
+// Values every array starts with, the ones at the edges of each encoding.
+static const int32_t kInt32Values[] = {0, 1, -1, 127, 128, -128, INT32_MAX, INT32_MIN};
+static const uint64_t kUInt64Values[] = {0, 1, 127, 128, UINT32_MAX, 1ULL << 63, UINT64_MAX};
+static const int64_t kInt64Values[] = {0, 1, -1, 63, -64, INT32_MIN, INT64_MAX, INT64_MIN};
+static const float kFloatValues[] = {0.0f, -0.0f, 1.5f, FLT_MIN, FLT_MAX, -INFINITY};
+static const double kDoubleValues[] = {0.0, -0.0, 0.1, DBL_MIN, DBL_MAX, INFINITY};
+
+#define EDGE_VALUE(VALUES, i, RANDOM) \
+  ((i) < sizeof(VALUES) / sizeof(VALUES[0]) ? VALUES[(i)] : (RANDOM))
+
+// A message with count values in every array: the edge values, then
+// pseudo random ones of every size.
+static VPKPTestPackedArrays *PackedArrays(NSUInteger count) {
+  VPKPTestPackedArrays *message = [VPKPTestPackedArrays message];
+  uint32_t seed = 0x9E3779B9;
+  for (NSUInteger i = 0; i < count; ++i) {
+    uint32_t random = VPKPTestRandom(&seed);
+    // Shifted by a random amount so values of every varint length turn up.
+    uint64_t wide = (((uint64_t)random << 32) | VPKPTestRandom(&seed)) >> (random % 64);
+    [message.int32ValuesArray addValue:EDGE_VALUE(kInt32Values, i, (int32_t)wide)];
+    [message.sint32ValuesArray addValue:EDGE_VALUE(kInt32Values, i, (int32_t)wide)];
+    [message.uint64ValuesArray addValue:EDGE_VALUE(kUInt64Values, i, wide)];
+    [message.sint64ValuesArray addValue:EDGE_VALUE(kInt64Values, i, (int64_t)wide)];
+    [message.fixed32ValuesArray addValue:EDGE_VALUE(kUInt64Values, i, random) & UINT32_MAX];
+    [message.sfixed64ValuesArray addValue:EDGE_VALUE(kInt64Values, i, (int64_t)wide)];
+    [message.floatValuesArray addValue:EDGE_VALUE(kFloatValues, i, (float)wide / random)];
+    [message.doubleValuesArray addValue:EDGE_VALUE(kDoubleValues, i, (double)wide / random)];
+    [message.boolValuesArray addValue:(random & 1)];
+  }
+  return message;
+}
+
+// Encodes message one value at a time with the scalar writers, either as
+// packed fields or as a tag and value per element.
+static NSData *EncodedValueByValue(VPKPTestPackedArrays *message, BOOL packed) {
+  return EncodedData(^(VPKGPBCodedOutputStream *output) {
+#define WRITE_VALUES(ARRAY, NUMBER, NAME)                                                   \
+  do {                                                                                     \
+    NSUInteger count = message.ARRAY.count;                                                \
+    if (count == 0) {                                                                      \
+      break;                                                                               \
+    }                                                                                      \
+    if (packed) {                                                                          \
+      NSData *payload = EncodedData(^(VPKGPBCodedOutputStream *values) {                   \
+        for (NSUInteger i = 0; i < count; ++i) {                                           \
+          [values write##NAME##NoTag:[message.ARRAY valueAtIndex:i]];                      \
+        }                                                                                  \
+      });                                                                                  \
+      [output writeTag:NUMBER format:VPKGPBWireFormatLengthDelimited];                     \
+      [output writeBytesNoTag:payload];                                                    \
+    } else {                                                                               \
+      for (NSUInteger i = 0; i < count; ++i) {                                             \
+        [output write##NAME:NUMBER value:[message.ARRAY valueAtIndex:i]];                  \
+      }                                                                                    \
+    }                                                                                      \
+  } while (0)
+    WRITE_VALUES(int32ValuesArray, VPKPTestPackedArrays_FieldNumber_Int32ValuesArray, Int32);
+    WRITE_VALUES(sint32ValuesArray, VPKPTestPackedArrays_FieldNumber_Sint32ValuesArray, SInt32);
+    WRITE_VALUES(uint64ValuesArray, VPKPTestPackedArrays_FieldNumber_Uint64ValuesArray, UInt64);
+    WRITE_VALUES(sint64ValuesArray, VPKPTestPackedArrays_FieldNumber_Sint64ValuesArray, SInt64);
+    WRITE_VALUES(fixed32ValuesArray, VPKPTestPackedArrays_FieldNumber_Fixed32ValuesArray,
+                 Fixed32);
+    WRITE_VALUES(sfixed64ValuesArray, VPKPTestPackedArrays_FieldNumber_Sfixed64ValuesArray,
+                 SFixed64);
+    WRITE_VALUES(floatValuesArray, VPKPTestPackedArrays_FieldNumber_FloatValuesArray, Float);
+    WRITE_VALUES(doubleValuesArray, VPKPTestPackedArrays_FieldNumber_DoubleValuesArray, Double);
+    WRITE_VALUES(boolValuesArray, VPKPTestPackedArrays_FieldNumber_BoolValuesArray, Bool);
+#undef WRITE_VALUES
+  });
+}
+
+@interface VPKGPBPackedArrayTests : XCTestCase
+@end
+
+@implementation VPKGPBPackedArrayTests
+
+- (void)testPackedArraysRoundTrip {
+  // Fewer values than a decode chunk, exactly one, and several.
+  for (NSNumber *count in @[ @0, @1, @8, @63, @64, @65, @1000 ]) {
+    VPKPTestPackedArrays *message = PackedArrays(count.unsignedIntegerValue);
+    NSData *data = [message data];
+    XCTAssertEqual(data.length, [message serializedSize], @"%@", count);
+    XCTAssertEqualObjects(data, EncodedValueByValue(message, YES), @"%@", count);
+    NSError *error = nil;
+    XCTAssertEqualObjects([VPKPTestPackedArrays parseFromData:data error:&error], message,
+                          @"%@", count);
+    XCTAssertNil(error, @"%@", count);
+  }
+}
+
+- (void)testPackedArraysFromInputStream {
+  // A small buffer splits the packed payloads across refills.
+  VPKPTestPackedArrays *message = PackedArrays(500);
+  NSData *data = [message data];
+  for (NSNumber *bufferSize in @[ @1, @7, @64 ]) {
+    NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+    VPKGPBCodedInputStream *input =
+        [[VPKGPBCodedInputStream alloc] initWithInputStream:stream
+                                                 bufferSize:bufferSize.unsignedIntegerValue];
+    NSError *error = nil;
+    XCTAssertEqualObjects([VPKPTestPackedArrays parseFromCodedInputStream:input
+                                                        extensionRegistry:nil
+                                                                    error:&error],
+                          message, @"%@", bufferSize);
+    XCTAssertNil(error, @"%@", bufferSize);
+    [input release];
+  }
+}
+
+- (void)testUnpackedDataParsesIntoPackedArrays {
+  VPKPTestPackedArrays *message = PackedArrays(200);
+  NSData *unpacked = EncodedValueByValue(message, NO);
+  XCTAssertEqualObjects([VPKPTestPackedArrays parseFromData:unpacked error:NULL], message);
+
+  // Packed and unpacked runs of the same field append to each other.
+  VPKPTestPackedArrays *first = PackedArrays(70);
+  VPKPTestPackedArrays *second = PackedArrays(30);
+  NSMutableData *mixed = [NSMutableData dataWithData:[first data]];
+  [mixed appendData:EncodedValueByValue(second, NO)];
+  [mixed appendData:[first data]];
+  VPKPTestPackedArrays *expected = [[first copy] autorelease];
+  [expected mergeFrom:second];
+  [expected mergeFrom:first];
+  XCTAssertEqualObjects([VPKPTestPackedArrays parseFromData:mixed error:NULL], expected);
+}
+
+- (void)testMalformedPackedArrays {
+  const uint8_t kTooLong[] = {0x0A, 0x05, 0x01, 0x02};
+  const uint8_t kEndsInsideVarint[] = {0x0A, 0x02, 0x01, 0x80};
+  const uint8_t kPartialFixed[] = {0x2A, 0x06, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+  NSArray<NSData *> *inputs = @[
+    [NSData dataWithBytes:kTooLong length:sizeof(kTooLong)],
+    [NSData dataWithBytes:kEndsInsideVarint length:sizeof(kEndsInsideVarint)],
+    [NSData dataWithBytes:kPartialFixed length:sizeof(kPartialFixed)],
+  ];
+  for (NSData *input in inputs) {
+    NSError *error = nil;
+    XCTAssertNil([VPKPTestPackedArrays parseFromData:input error:&error], @"%@", input);
+    XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain, @"%@", input);
+  }
+}
+
+- (void)testPerformanceWritePackedArrays {
+  VPKPTestPackedArrays *message = PackedArrays(100000);
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 10; ++i) {
+      @autoreleasepool {
+        [message data];
+      }
+    }
+  }];
+}
+
+- (void)testPerformanceParsePackedArrays {
+  NSData *data = [PackedArrays(100000) data];
+  [self measureBlock:^{
+    for (NSUInteger i = 0; i < 10; ++i) {
+      @autoreleasepool {
+        XCTAssertNotNil([VPKPTestPackedArrays parseFromData:data error:NULL]);
+      }
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  VPKGPBUtilitiesTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKGPBDescriptor.h"
+#import "VPKGPBUtilities.h"
+#import "VPKPTestVeeps.h"
+
+// A veep of count elements unlike VPKPTestVeep(count): every element sets the
+// other member of each oneof, and the header leaves most fields unset.
+static VPKPVeep *ShiftedVeep(NSUInteger count) {
+  VPKPVeep *veep = [VPKPVeep message];
+  veep.header.title = @"shifted";
+  for (NSUInteger i = 0; i < count; ++i) {
+    [veep.trackElementsArray addObject:VPKPTestTrackElement(i + 1)];
+  }
+  return veep;
+}
+
+// The fields of the veep messages whose objects a parse may reuse.
+static NSSet<VPKGPBFieldDescriptor *> *VeepReusableFields(void) {
+  VPKGPBDescriptor *veep = [VPKPVeep descriptor];
+  VPKGPBDescriptor *element = [VPKPVeepTrackElement descriptor];
+  return [NSSet setWithObjects:[veep fieldWithNumber:VPKPVeep_FieldNumber_Header],
+                               [veep fieldWithNumber:VPKPVeep_FieldNumber_TrackElementsArray],
+                               [element fieldWithNumber:VPKPVeepTrackElement_FieldNumber_Header],
+                               [element fieldWithNumber:VPKPVeepTrackElement_FieldNumber_Rect],
+                               [element fieldWithNumber:
+                                            VPKPVeepTrackElement_FieldNumber_DiscreteTimeRangeRect],
+                               nil];
+}
+
+@interface VPKGPBUtilitiesTests : XCTestCase
+@end
+
+@implementation VPKGPBUtilitiesTests
+
+#pragma mark - Clear For Reuse
+
+- (void)testClearForReuseWithoutReusableFieldsKeepsReferences {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  VPKPVeep *message = [VPKPVeep parseFromData:[veep data] error:NULL];
+  VPKPVeepHeader *header = [message.header retain];
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [message.trackElementsArray retain];
+  VPKPVeepTrackElement *element = [elements[3] retain];
+
+  VPKGPBMessageClearForReuse(message, [NSSet set]);
+  XCTAssertEqualObjects(message, [VPKPVeep message]);
+  [message mergeFromData:[ShiftedVeep(20) data] extensionRegistry:nil];
+  XCTAssertEqualObjects(message, ShiftedVeep(20));
+
+  // What was obtained before the clear is as it was.
+  XCTAssertEqualObjects(header, veep.header);
+  XCTAssertEqualObjects(elements, veep.trackElementsArray);
+  XCTAssertEqualObjects(element, veep.trackElementsArray[3]);
+  XCTAssertNotEqual(message.header, header);
+  XCTAssertNotEqual(message.trackElementsArray, elements);
+  XCTAssertEqual([message.trackElementsArray indexOfObjectIdenticalTo:element],
+                 (NSUInteger)NSNotFound);
+  [element release];
+  [elements release];
+  [header release];
+}
+
+- (void)testClearForReuseReparsesLikeAParse {
+  NSSet<VPKGPBFieldDescriptor *> *reusable = VeepReusableFields();
+  VPKPVeep *message = [VPKPVeep message];
+  // Growing, shrinking, and changing the oneof members set.
+  NSArray<VPKPVeep *> *veeps = @[
+    VPKPTestVeep(50), VPKPTestVeep(200), ShiftedVeep(30), VPKPTestVeep(0), [VPKPVeep message],
+    ShiftedVeep(300), VPKPTestVeep(100)
+  ];
+  for (VPKPVeep *veep in veeps) {
+    VPKGPBMessageClearForReuse(message, reusable);
+    XCTAssertEqualObjects(message, [VPKPVeep message]);
+    XCTAssertFalse(message.hasHeader);
+    NSData *data = [veep data];
+    [message mergeFromData:data extensionRegistry:nil];
+    XCTAssertEqualObjects(message, [VPKPVeep parseFromData:data error:NULL]);
+    XCTAssertEqualObjects([message data], data);
+  }
+}
+
+- (void)testClearForReuseReusesOptedInObjects {
+  VPKPVeep *message = [VPKPVeep parseFromData:[VPKPTestVeep(10) data] error:NULL];
+  VPKPVeepHeader *header = message.header;
+  NSMutableArray<VPKPVeepTrackElement *> *elements = message.trackElementsArray;
+  VPKPVeepTrackElement *element = elements[0];
+
+  VPKGPBMessageClearForReuse(message, VeepReusableFields());
+  [message mergeFromData:[VPKPTestVeep(10) data] extensionRegistry:nil];
+  XCTAssertEqual(message.header, header);
+  XCTAssertEqual(message.trackElementsArray, elements);
+  XCTAssertNotEqual([elements indexOfObjectIdenticalTo:element], (NSUInteger)NSNotFound);
+  XCTAssertEqualObjects(message, VPKPTestVeep(10));
+}
+
+@end
@@ -0,0 +1,93 @@
+// Written by hand in the form protoc generates for this proto3 message, as no
+// message in the tree has repeated scalar fields:
+//
+//   message TestPackedArrays {
+//     repeated int32 int32_values = 1;
+//     repeated sint32 sint32_values = 2;
+//     repeated uint64 uint64_values = 3;
+//     repeated sint64 sint64_values = 4;
+//     repeated fixed32 fixed32_values = 5;
+//     repeated sfixed64 sfixed64_values = 6;
+//     repeated float float_values = 7;
+//     repeated double double_values = 8;
+//     repeated bool bool_values = 9;
+//   }
+//
+// Repeated scalar fields are packed by default in proto3.
+// clang-format off
+
+#import "VPKGPBProtocolBuffers.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+CF_EXTERN_C_BEGIN
+
+NS_ASSUME_NONNULL_BEGIN
+
+#pragma mark - VPKPTestPackedArraysRoot
+
+VPKGPB_FINAL @interface VPKPTestPackedArraysRoot : VPKGPBRootObject
+@end
+
+#pragma mark - VPKPTestPackedArrays
+
+typedef VPKGPB_ENUM(VPKPTestPackedArrays_FieldNumber) {
+  VPKPTestPackedArrays_FieldNumber_Int32ValuesArray = 1,
+  VPKPTestPackedArrays_FieldNumber_Sint32ValuesArray = 2,
+  VPKPTestPackedArrays_FieldNumber_Uint64ValuesArray = 3,
+  VPKPTestPackedArrays_FieldNumber_Sint64ValuesArray = 4,
+  VPKPTestPackedArrays_FieldNumber_Fixed32ValuesArray = 5,
+  VPKPTestPackedArrays_FieldNumber_Sfixed64ValuesArray = 6,
+  VPKPTestPackedArrays_FieldNumber_FloatValuesArray = 7,
+  VPKPTestPackedArrays_FieldNumber_DoubleValuesArray = 8,
+  VPKPTestPackedArrays_FieldNumber_BoolValuesArray = 9,
+};
+
+VPKGPB_FINAL @interface VPKPTestPackedArrays : VPKGPBMessage
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBInt32Array *int32ValuesArray;
+/** The number of items in @c int32ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger int32ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBInt32Array *sint32ValuesArray;
+/** The number of items in @c sint32ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger sint32ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBUInt64Array *uint64ValuesArray;
+/** The number of items in @c uint64ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger uint64ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBInt64Array *sint64ValuesArray;
+/** The number of items in @c sint64ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger sint64ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBUInt32Array *fixed32ValuesArray;
+/** The number of items in @c fixed32ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger fixed32ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBInt64Array *sfixed64ValuesArray;
+/** The number of items in @c sfixed64ValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger sfixed64ValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBFloatArray *floatValuesArray;
+/** The number of items in @c floatValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger floatValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBDoubleArray *doubleValuesArray;
+/** The number of items in @c doubleValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger doubleValuesArray_Count;
+
+@property(nonatomic, readwrite, strong, null_resettable) VPKGPBBoolArray *boolValuesArray;
+/** The number of items in @c boolValuesArray without causing the container to be created. */
+@property(nonatomic, readonly) NSUInteger boolValuesArray_Count;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+CF_EXTERN_C_END
+
+#pragma clang diagnostic pop
+
+// clang-format on
@@ -0,0 +1,170 @@
+// Written by hand in the form protoc generates for the message described in
+// VPKPTestPackedArrays.pbobjc.h.
+// clang-format off
+
+#import "VPKGPBProtocolBuffers_RuntimeSupport.h"
+#import "VPKPTestPackedArrays.pbobjc.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#pragma clang diagnostic ignored "-Wdollar-in-identifier-extension"
+
+#pragma mark - Objective-C Class declarations
+// Forward declarations of Objective-C classes that we can use as
+// static values in struct initializers.
+// We don't use [Foo class] because it is not a static value.
+VPKGPBObjCClassDeclaration(VPKPTestPackedArrays);
+
+#pragma mark - VPKPTestPackedArraysRoot
+
+@implementation VPKPTestPackedArraysRoot
+
+// No extensions in the file and no imports, so no need to generate
+// +extensionRegistry.
+
+@end
+
+static VPKGPBFileDescription VPKPTestPackedArraysRoot_FileDescription = {
+  .package = "veepio.test",
+  .prefix = "VPKP",
+  .syntax = VPKGPBFileSyntaxProto3
+};
+
+#pragma mark - VPKPTestPackedArrays
+
+@implementation VPKPTestPackedArrays
+
+@dynamic int32ValuesArray, int32ValuesArray_Count;
+@dynamic sint32ValuesArray, sint32ValuesArray_Count;
+@dynamic uint64ValuesArray, uint64ValuesArray_Count;
+@dynamic sint64ValuesArray, sint64ValuesArray_Count;
+@dynamic fixed32ValuesArray, fixed32ValuesArray_Count;
+@dynamic sfixed64ValuesArray, sfixed64ValuesArray_Count;
+@dynamic floatValuesArray, floatValuesArray_Count;
+@dynamic doubleValuesArray, doubleValuesArray_Count;
+@dynamic boolValuesArray, boolValuesArray_Count;
+
+typedef struct VPKPTestPackedArrays__storage_ {
+  uint32_t _has_storage_[1];
+  VPKGPBInt32Array *int32ValuesArray;
+  VPKGPBInt32Array *sint32ValuesArray;
+  VPKGPBUInt64Array *uint64ValuesArray;
+  VPKGPBInt64Array *sint64ValuesArray;
+  VPKGPBUInt32Array *fixed32ValuesArray;
+  VPKGPBInt64Array *sfixed64ValuesArray;
+  VPKGPBFloatArray *floatValuesArray;
+  VPKGPBDoubleArray *doubleValuesArray;
+  VPKGPBBoolArray *boolValuesArray;
+} VPKPTestPackedArrays__storage_;
+
+// This method is threadsafe because it is initially called
+// in +initialize for each subclass.
++ (VPKGPBDescriptor *)descriptor {
+  static VPKGPBDescriptor *descriptor = nil;
+  if (!descriptor) {
+    VPKGPB_DEBUG_CHECK_RUNTIME_VERSIONS();
+    static VPKGPBMessageFieldDescription fields[] = {
+      {
+        .name = "int32ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Int32ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, int32ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeInt32,
+      },
+      {
+        .name = "sint32ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Sint32ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, sint32ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeSInt32,
+      },
+      {
+        .name = "uint64ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Uint64ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, uint64ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeUInt64,
+      },
+      {
+        .name = "sint64ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Sint64ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, sint64ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeSInt64,
+      },
+      {
+        .name = "fixed32ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Fixed32ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, fixed32ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeFixed32,
+      },
+      {
+        .name = "sfixed64ValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_Sfixed64ValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, sfixed64ValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeSFixed64,
+      },
+      {
+        .name = "floatValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_FloatValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, floatValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeFloat,
+      },
+      {
+        .name = "doubleValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_DoubleValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, doubleValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeDouble,
+      },
+      {
+        .name = "boolValuesArray",
+        .dataTypeSpecific.clazz = Nil,
+        .number = VPKPTestPackedArrays_FieldNumber_BoolValuesArray,
+        .hasIndex = VPKGPBNoHasBit,
+        .offset = (uint32_t)offsetof(VPKPTestPackedArrays__storage_, boolValuesArray),
+        .flags = (VPKGPBFieldFlags)(VPKGPBFieldRepeated | VPKGPBFieldPacked),
+        .dataType = VPKGPBDataTypeBool,
+      },
+    };
+    VPKGPBDescriptor *localDescriptor =
+        [VPKGPBDescriptor allocDescriptorForClass:VPKGPBObjCClass(VPKPTestPackedArrays)
+                                   messageName:@"TestPackedArrays"
+                               fileDescription:&VPKPTestPackedArraysRoot_FileDescription
+                                        fields:fields
+                                    fieldCount:(uint32_t)(sizeof(fields) / sizeof(VPKGPBMessageFieldDescription))
+                                   storageSize:sizeof(VPKPTestPackedArrays__storage_)
+                                         flags:(VPKGPBDescriptorInitializationFlags)(VPKGPBDescriptorInitializationFlag_UsesClassRefs | VPKGPBDescriptorInitializationFlag_Proto3OptionalKnown | VPKGPBDescriptorInitializationFlag_ClosedEnumSupportKnown)];
+    #if defined(DEBUG) && DEBUG
+      NSAssert(descriptor == nil, @"Startup recursed!");
+    #endif  // DEBUG
+    descriptor = localDescriptor;
+  }
+  return descriptor;
+}
+
+@end
+
+
+#pragma clang diagnostic pop
+
+// clang-format on
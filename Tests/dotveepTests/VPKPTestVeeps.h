@@ -0,0 +1,41 @@
+//
+//  VPKPTestVeeps.h
+//  dotveepTests
+//
+
+#import <Foundation/Foundation.h>
+
+#import "Veep.pbobjc.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+CF_EXTERN_C_BEGIN
+
+/**
+ * Builds a veep of count track elements that sets every kind of field the
+ * veep messages have: strings with non ASCII characters, a bytes field of a
+ * few KB, repeated strings, both members of each oneof, and nested messages.
+ * Every element carries one of a handful of track headers, so consecutive
+ * elements repeat them. The same count always builds the same veep.
+ **/
+VPKPVeep *VPKPTestVeep(NSUInteger count);
+
+/** The track element at index in every VPKPTestVeep(). */
+VPKPVeepTrackElement *VPKPTestTrackElement(NSUInteger index);
+
+/** A time of value / timescale seconds. */
+VPKPDiscreteTime *VPKPTestTime(int32_t timescale, int64_t value);
+
+/**
+ * A track element active from start for duration, both in the given
+ * timescale, and covering the given rect.
+ **/
+VPKPVeepTrackElement *VPKPTestTimedElement(int32_t timescale, int64_t start, int64_t duration,
+                                           float x, float y, float width, float height);
+
+/** Returns the next value of a repeatable pseudo random sequence. */
+uint32_t VPKPTestRandom(uint32_t *seed);
+
+CF_EXTERN_C_END
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,91 @@
+//
+//  VPKPTestVeeps.m
+//  dotveepTests
+//
+
+#import "VPKPTestVeeps.h"
+
+static const NSUInteger kTrackCount = 4;
+
+static VPKPVeepTrackHeader *TestTrackHeader(NSUInteger track) {
+  VPKPVeepTrackHeader *header = [VPKPVeepTrackHeader message];
+  header.identifier = [NSString stringWithFormat:@"track-%lu", (unsigned long)track];
+  header.title = [NSString stringWithFormat:@"Piste n°%lu", (unsigned long)track];
+  header.description_p = @"Objets repérés dans la vidéo";
+  header.URL = [NSString stringWithFormat:@"https://example.com/tracks/%lu", (unsigned long)track];
+  header.type = (VPKPVeepTrackHeader_VeepTrackType)(track % 3);
+  return header;
+}
+
+VPKPVeep *VPKPTestVeep(NSUInteger count) {
+  VPKPVeep *veep = [VPKPVeep message];
+  VPKPVeepHeader *header = veep.header;
+  header.identifier = [NSString stringWithFormat:@"veep-%lu", (unsigned long)count];
+  header.title = @"Café ☕ 東京";
+  header.description_p = @"A veep built for tests";
+  header.creatorEmail = @"tests@example.com";
+  header.contentType = @"video/mp4";
+  NSMutableData *thumbnail = [NSMutableData dataWithLength:4096];
+  uint8_t *bytes = thumbnail.mutableBytes;
+  for (NSUInteger i = 0; i < thumbnail.length; ++i) {
+    bytes[i] = (uint8_t)(i * 31 + 7);
+  }
+  header.thumbnailData = thumbnail;
+  header.originalContentUri = @"file:///videos/original.mp4";
+  header.originalContentWidth = 1920;
+  header.originalContentHeight = 1080;
+  [header.alternativeContentUrlsArray addObject:@"https://example.com/720p.mp4"];
+  [header.alternativeContentUrlsArray addObject:@"https://example.com/480p.mp4"];
+  [header.alternativeContentUrlsArray addObject:@""];
+  header.previewURL = @"https://example.com/preview.gif";
+  for (NSUInteger i = 0; i < count; ++i) {
+    [veep.trackElementsArray addObject:VPKPTestTrackElement(i)];
+  }
+  return veep;
+}
+
+VPKPVeepTrackElement *VPKPTestTrackElement(NSUInteger index) {
+  VPKPVeepTrackElement *element;
+  if (index % 2 == 0) {
+    element = VPKPTestTimedElement(600, (int64_t)index * 100, 250 + (int64_t)(index % 7) * 30,
+                                   (float)(index % 50), (float)(index % 30), 10.5f, 20.25f);
+  } else {
+    element = [VPKPVeepTrackElement message];
+    element.rect.x = -1.5f * (float)index;
+    element.rect.y = 0.125f;
+    element.rect.width = 64;
+    element.rect.height = 48;
+  }
+  element.header = TestTrackHeader(index % kTrackCount);
+  return element;
+}
+
+VPKPDiscreteTime *VPKPTestTime(int32_t timescale, int64_t value) {
+  VPKPDiscreteTime *time = [VPKPDiscreteTime message];
+  time.timescale = timescale;
+  time.value = value;
+  return time;
+}
+
+VPKPVeepTrackElement *VPKPTestTimedElement(int32_t timescale, int64_t start, int64_t duration,
+                                           float x, float y, float width, float height) {
+  VPKPVeepTrackElement *element = [VPKPVeepTrackElement message];
+  VPKPDiscreteTimeRangeRect *timeRangeRect = element.discreteTimeRangeRect;
+  timeRangeRect.timeRange.start = VPKPTestTime(timescale, start);
+  timeRangeRect.timeRange.duration = VPKPTestTime(timescale, duration);
+  timeRangeRect.rect.x = x;
+  timeRangeRect.rect.y = y;
+  timeRangeRect.rect.width = width;
+  timeRangeRect.rect.height = height;
+  return element;
+}
+
+uint32_t VPKPTestRandom(uint32_t *seed) {
+  // xorshift32, good enough for spreading test data.
+  uint32_t x = *seed ? *seed : 0x9E3779B9u;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
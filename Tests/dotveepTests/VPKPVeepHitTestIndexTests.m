@@ -0,0 +1,334 @@
+//
+//  VPKPVeepHitTestIndexTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKPTestVeeps.h"
+#import "VPKPVeepHitTestIndex.h"
+
+static const int32_t kTimescales[] = {600, 1000, 30000};
+
+// Elements start within the first kSpanSeconds.
+static const int64_t kSpanSeconds = 60;
+
+static float RandomFloat(uint32_t *seed, float bound) {
+  return (float)(VPKPTestRandom(seed) % 1000000) / 1000000.0f * bound;
+}
+
+static VPKPDiscreteTime *RandomTime(uint32_t *seed) {
+  int32_t timescale = kTimescales[VPKPTestRandom(seed) % (sizeof(kTimescales) / sizeof(int32_t))];
+  int64_t seconds = VPKPTestRandom(seed) % (kSpanSeconds + 5);
+  return VPKPTestTime(timescale, seconds * timescale + VPKPTestRandom(seed) % timescale);
+}
+
+// count elements with rects up to size across in a side by side square: most
+// timed, lasting a few seconds, some plain rects hit at any time, some
+// flipped, some with a NaN component, some timed without a rect, and some not
+// timed or indexed.
+static NSArray<VPKPVeepTrackElement *> *RandomElements(NSUInteger count, uint32_t seed,
+                                                       float side, float size) {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    VPKPDiscreteTime *start = RandomTime(&seed);
+    int64_t duration = 1 + VPKPTestRandom(&seed) % (5 * start.timescale);
+    VPKPVeepTrackElement *element = VPKPTestTimedElement(
+        start.timescale, start.value, duration, RandomFloat(&seed, side),
+        RandomFloat(&seed, side), RandomFloat(&seed, size), RandomFloat(&seed, size));
+    VPKPRect *rect = element.discreteTimeRangeRect.rect;
+    switch (VPKPTestRandom(&seed) % 16) {
+      case 0:
+      case 1:
+        element.rect = [[rect copy] autorelease];
+        break;
+      case 2:
+        rect.width = -rect.width;
+        break;
+      case 3:
+        rect.height = -rect.height;
+        break;
+      case 4:
+        rect.width = NAN;
+        break;
+      case 5:
+        element.discreteTimeRangeRect.hasRect = NO;
+        break;
+      case 6:
+        element.discreteTimeRangeRect.timeRange.duration.value = -1;
+        break;
+      case 7:
+        VPKPVeepTrackElement_ClearDataOneOfCase(element);
+        break;
+      default:
+        break;
+    }
+    [elements addObject:element];
+  }
+  return elements;
+}
+
+#pragma mark - Linear Scan
+
+// Whether rect contains the point once standardized, computing its far edges
+// in float as the index does. A rect with a NaN component contains nothing.
+static BOOL RectContainsPoint(VPKPRect *rect, float x, float y) {
+  float farX = rect.x + rect.width;
+  float farY = rect.y + rect.height;
+  return MIN(rect.x, farX) <= x && x < MAX(rect.x, farX) && MIN(rect.y, farY) <= y &&
+         y < MAX(rect.y, farY);
+}
+
+// Whether the element's time range holds time, start <= time < end, exactly.
+static BOOL ElementIsActiveAtTime(VPKPVeepTrackElement *element, VPKPDiscreteTime *time) {
+  VPKPDiscreteTime *start = element.discreteTimeRangeRect.timeRange.start;
+  VPKPDiscreteTime *duration = element.discreteTimeRangeRect.timeRange.duration;
+  if (start.timescale <= 0 || duration.timescale <= 0 || duration.value < 0) {
+    return NO;
+  }
+  __int128 t = (__int128)time.value * start.timescale * duration.timescale;
+  __int128 first = (__int128)start.value * time.timescale * duration.timescale;
+  __int128 end = first + (__int128)duration.value * time.timescale * start.timescale;
+  return first <= t && t < end;
+}
+
+// The positions in elements of those containing the point at time, in order.
+static NSArray<NSNumber *> *ScanContainingPoint(NSArray<VPKPVeepTrackElement *> *elements,
+                                                float x, float y, VPKPDiscreteTime *time) {
+  NSMutableArray<NSNumber *> *positions = [NSMutableArray array];
+  if (time.timescale <= 0) {
+    return positions;
+  }
+  for (NSUInteger i = 0; i < elements.count; ++i) {
+    VPKPVeepTrackElement *element = elements[i];
+    BOOL hit = NO;
+    switch (element.dataOneOfCase) {
+      case VPKPVeepTrackElement_Data_OneOfCase_Rect:
+        hit = RectContainsPoint(element.rect, x, y);
+        break;
+      case VPKPVeepTrackElement_Data_OneOfCase_DiscreteTimeRangeRect:
+        hit = element.discreteTimeRangeRect.hasRect &&
+              RectContainsPoint(element.discreteTimeRangeRect.rect, x, y) &&
+              ElementIsActiveAtTime(element, time);
+        break;
+      default:
+        break;
+    }
+    if (hit) {
+      [positions addObject:@(i)];
+    }
+  }
+  return positions;
+}
+
+// A point and time to look elements up at.
+typedef struct HitTestQuery {
+  float x;
+  float y;
+  VPKPDiscreteTime *time;
+} HitTestQuery;
+
+@interface VPKPVeepHitTestIndexTests : XCTestCase
+@end
+
+@implementation VPKPVeepHitTestIndexTests
+
+// Checks the index against the scan at the corners of every rect, where the
+// near edges are in and the far ones out, at each element's start and just
+// before it, and at random points and times.
+- (void)assertIndexMatchesScan:(VPKPVeepHitTestIndex *)index seed:(uint32_t)seed {
+  NSArray<VPKPVeepTrackElement *> *elements = index.trackElements;
+  NSMutableArray<NSValue *> *queries = [NSMutableArray array];
+  void (^addQuery)(float, float, VPKPDiscreteTime *) = ^(float x, float y,
+                                                         VPKPDiscreteTime *time) {
+    HitTestQuery query = {x, y, time};
+    [queries addObject:[NSValue valueWithBytes:&query objCType:@encode(HitTestQuery)]];
+  };
+  for (VPKPVeepTrackElement *element in elements) {
+    VPKPRect *rect = element.dataOneOfCase == VPKPVeepTrackElement_Data_OneOfCase_Rect
+                         ? element.rect
+                         : element.discreteTimeRangeRect.rect;
+    VPKPDiscreteTime *start = element.discreteTimeRangeRect.timeRange.start;
+    VPKPDiscreteTime *time = start.timescale > 0 ? start : RandomTime(&seed);
+    VPKPDiscreteTime *before = VPKPTestTime(time.timescale, time.value - 1);
+    addQuery(rect.x, rect.y, time);
+    addQuery(rect.x + rect.width, rect.y + rect.height, time);
+    addQuery(rect.x, rect.y + rect.height, before);
+    addQuery(rect.x + rect.width / 2, rect.y + rect.height / 2, before);
+  }
+  for (NSUInteger i = 0; i < elements.count + 100; ++i) {
+    addQuery(RandomFloat(&seed, 1000), RandomFloat(&seed, 1000), RandomTime(&seed));
+  }
+  addQuery(NAN, 10, VPKPTestTime(600, 600));
+  addQuery(-INFINITY, INFINITY, VPKPTestTime(600, 600));
+
+  for (NSValue *value in queries) {
+    HitTestQuery query;
+    [value getValue:&query];
+    NSArray<NSNumber *> *expected = ScanContainingPoint(elements, query.x, query.y, query.time);
+    NSArray<VPKPVeepTrackElement *> *found =
+        [index elementsContainingPointX:query.x y:query.y atTime:query.time];
+    NSMutableArray<NSNumber *> *positions = [NSMutableArray array];
+    for (VPKPVeepTrackElement *element in found) {
+      [positions addObject:@([elements indexOfObjectIdenticalTo:element])];
+    }
+    XCTAssertEqualObjects(positions, expected, @"(%g, %g) at %lld/%d", query.x, query.y,
+                          query.time.value, query.time.timescale);
+
+    NSMutableIndexSet *enumerated = [NSMutableIndexSet indexSet];
+    [index enumerateElementsContainingPointX:query.x
+                                           y:query.y
+                                      atTime:query.time
+                                  usingBlock:^(VPKPVeepTrackElement *element, NSUInteger idx,
+                                               __unused BOOL *stop) {
+                                    XCTAssertEqual(elements[idx], element);
+                                    XCTAssertFalse([enumerated containsIndex:idx]);
+                                    [enumerated addIndex:idx];
+                                  }];
+    XCTAssertEqual(enumerated.count, expected.count);
+    for (NSNumber *position in expected) {
+      XCTAssertTrue([enumerated containsIndex:position.unsignedIntegerValue]);
+    }
+  }
+}
+
+#pragma mark - Lookups
+
+- (void)testLookupsMatchLinearScan {
+  // Empty, a single item, and one to three levels of full and partial nodes.
+  for (NSNumber *count in @[ @0, @1, @15, @16, @17, @256, @257, @3000 ]) {
+    NSArray<VPKPVeepTrackElement *> *elements =
+        RandomElements(count.unsignedIntegerValue, 1 + count.unsignedIntValue, 1000, 200);
+    VPKPVeepHitTestIndex *index = [[[VPKPVeepHitTestIndex alloc]
+        initWithTimeIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements]
+                              autorelease]] autorelease];
+    [self assertIndexMatchesScan:index seed:7 + count.unsignedIntValue];
+  }
+}
+
+- (void)testIndexesTestVeep {
+  // Its even elements are timed rects and its odd ones plain rects.
+  VPKPVeepHitTestIndex *index =
+      [[[VPKPVeepHitTestIndex alloc] initWithVeep:VPKPTestVeep(500)] autorelease];
+  XCTAssertEqual(index.count, (NSUInteger)500);
+  XCTAssertEqual(index.timeIndex.count, (NSUInteger)250);
+  XCTAssertEqualObjects(index.trackElements, index.timeIndex.trackElements);
+  [self assertIndexMatchesScan:index seed:11];
+}
+
+- (void)testCountsUsableRects {
+  NSArray<VPKPVeepTrackElement *> *elements = RandomElements(1000, 13, 1000, 200);
+  VPKPVeepHitTestIndex *index = [[[VPKPVeepHitTestIndex alloc]
+      initWithTimeIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements]
+                            autorelease]] autorelease];
+  NSUInteger usable = 0;
+  for (VPKPVeepTrackElement *element in elements) {
+    VPKPRect *rect;
+    if (element.dataOneOfCase == VPKPVeepTrackElement_Data_OneOfCase_Rect) {
+      rect = element.rect;
+    } else if (element.discreteTimeRangeRect.hasRect &&
+               element.discreteTimeRangeRect.timeRange.duration.value >= 0) {
+      rect = element.discreteTimeRangeRect.rect;
+    } else {
+      continue;
+    }
+    usable += isnan(rect.x + rect.width) || isnan(rect.y + rect.height) ? 0 : 1;
+  }
+  XCTAssertEqual(index.count, usable);
+}
+
+- (void)testUnusableTimeFindsNothing {
+  VPKPVeepTrackElement *plain = [VPKPVeepTrackElement message];
+  plain.rect.width = 10;
+  plain.rect.height = 10;
+  VPKPVeepHitTestIndex *index =
+      [[[VPKPVeepHitTestIndex alloc]
+          initWithTimeIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:@[ plain ]]
+                                autorelease]] autorelease];
+  XCTAssertEqualObjects([index elementsContainingPointX:5 y:5 atTime:VPKPTestTime(1, 0)],
+                        @[ plain ]);
+  XCTAssertEqualObjects([index elementsContainingPointX:5 y:5 atTime:VPKPTestTime(0, 0)], @[]);
+  [index enumerateElementsContainingPointX:5
+                                         y:5
+                                    atTime:VPKPTestTime(-1, 0)
+                                usingBlock:^(__unused VPKPVeepTrackElement *element,
+                                             __unused NSUInteger idx, __unused BOOL *stop) {
+                                  XCTFail(@"No element is hit at an unusable time");
+                                }];
+}
+
+- (void)testEnumerationStops {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 100; ++i) {
+    [elements addObject:VPKPTestTimedElement(600, 0, 600, 0, 0, 10, 10)];
+  }
+  VPKPVeepHitTestIndex *index = [[[VPKPVeepHitTestIndex alloc]
+      initWithTimeIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements]
+                            autorelease]] autorelease];
+  XCTAssertEqual([index elementsContainingPointX:1 y:1 atTime:VPKPTestTime(600, 0)].count,
+                 (NSUInteger)100);
+  __block NSUInteger calls = 0;
+  [index enumerateElementsContainingPointX:1
+                                         y:1
+                                    atTime:VPKPTestTime(600, 0)
+                                usingBlock:^(__unused VPKPVeepTrackElement *element,
+                                             __unused NSUInteger idx, BOOL *stop) {
+                                  *stop = ++calls == 10;
+                                }];
+  XCTAssertEqual(calls, (NSUInteger)10);
+}
+
+#pragma mark - Performance
+
+// 100000 small rects over a large square, so a point is under about one of
+// them, and count points and times to look up.
+- (VPKPVeepHitTestIndex *)performanceIndexWithQueries:(HitTestQuery *)queries
+                                                count:(NSUInteger)count {
+  NSArray<VPKPVeepTrackElement *> *elements = RandomElements(100000, 17, 20000, 100);
+  uint32_t seed = 19;
+  for (NSUInteger i = 0; i < count; ++i) {
+    queries[i] = (HitTestQuery){RandomFloat(&seed, 20000), RandomFloat(&seed, 20000),
+                                RandomTime(&seed)};
+  }
+  return [[[VPKPVeepHitTestIndex alloc]
+      initWithTimeIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements]
+                            autorelease]] autorelease];
+}
+
+- (void)testPerformanceEnumerateElementsContainingPoint {
+  // 100000 lookups in well under 0.1 s is under a microsecond each.
+  static const NSUInteger kQueryCount = 100000;
+  HitTestQuery *queries = malloc(kQueryCount * sizeof(HitTestQuery));
+  VPKPVeepHitTestIndex *index = [self performanceIndexWithQueries:queries count:kQueryCount];
+  [self measureBlock:^{
+    __block NSUInteger hits = 0;
+    for (NSUInteger i = 0; i < kQueryCount; ++i) {
+      [index enumerateElementsContainingPointX:queries[i].x
+                                             y:queries[i].y
+                                        atTime:queries[i].time
+                                    usingBlock:^(__unused VPKPVeepTrackElement *element,
+                                                 __unused NSUInteger idx,
+                                                 __unused BOOL *stop) {
+                                      ++hits;
+                                    }];
+    }
+    XCTAssertNotEqual(hits, (NSUInteger)0);
+  }];
+  free(queries);
+}
+
+- (void)testPerformanceElementsContainingPoint {
+  static const NSUInteger kQueryCount = 100000;
+  HitTestQuery *queries = malloc(kQueryCount * sizeof(HitTestQuery));
+  VPKPVeepHitTestIndex *index = [self performanceIndexWithQueries:queries count:kQueryCount];
+  [self measureBlock:^{
+    @autoreleasepool {
+      for (NSUInteger i = 0; i < kQueryCount; ++i) {
+        [index elementsContainingPointX:queries[i].x y:queries[i].y atTime:queries[i].time];
+      }
+    }
+  }];
+  free(queries);
+}
+
+@end
@@ -0,0 +1,263 @@
+//
+//  VPKPVeepReaderTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKPTestVeeps.h"
+#import "VPKPVeepReader.h"
+
+// The test track element at index, carrying a track header with the given
+// identifier and title.
+static VPKPVeepTrackElement *HeaderElement(NSUInteger index, NSString *identifier,
+                                           NSString *title) {
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(index);
+  element.header.identifier = identifier;
+  element.header.title = title;
+  return element;
+}
+
+// The test track element at index, carrying a track tag for identifier.
+static VPKPVeepTrackElement *TaggedElement(NSUInteger index, NSString *identifier) {
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(index);
+  element.tag.identifier = identifier;
+  return element;
+}
+
+// A veep whose tags name a header before them, a header not seen yet, a
+// header replaced since, and no header at all, followed by an element with
+// neither a header nor a tag.
+static VPKPVeep *TaggedVeep(void) {
+  VPKPVeep *veep = [VPKPVeep message];
+  [veep.trackElementsArray addObjectsFromArray:@[
+    HeaderElement(0, @"a", @"A"),
+    TaggedElement(1, @"a"),
+    TaggedElement(2, @"b"),
+    HeaderElement(3, @"b", @"B"),
+    TaggedElement(4, @"b"),
+    HeaderElement(5, @"a", @"A again"),
+    TaggedElement(6, @"a"),
+    TaggedElement(7, @""),
+    HeaderElement(8, @"", @"No identifier"),
+    TaggedElement(9, @""),
+  ]];
+  VPKPVeepTrackElement *bare = VPKPTestTrackElement(10);
+  VPKPVeepTrackElement_ClearMetaOneOfCase(bare);
+  [veep.trackElementsArray addObject:bare];
+  return veep;
+}
+
+@interface VPKPVeepReaderTests : XCTestCase
+@end
+
+@implementation VPKPVeepReaderTests
+
+// Reads every element left in reader, failing the test on an error.
+- (NSArray<VPKPVeepTrackElement *> *)readAllElements:(VPKPVeepReader *)reader {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  while (YES) {
+    NSError *error = nil;
+    VPKPVeepTrackElement *element = [reader readTrackElement:&error];
+    if (!element) {
+      XCTAssertNil(error);
+      return elements;
+    }
+    [elements addObject:element];
+  }
+}
+
+- (void)testReadsHeaderThenElements {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[veep data]];
+  NSError *error = nil;
+  XCTAssertEqualObjects([reader readHeader:&error], veep.header);
+  XCTAssertNil(error);
+  XCTAssertFalse(reader.atEnd);
+  // Reading the header again does not consume anything.
+  XCTAssertEqualObjects([reader readHeader:&error], veep.header);
+  XCTAssertEqualObjects([self readAllElements:reader], veep.trackElementsArray);
+  XCTAssertTrue(reader.atEnd);
+  XCTAssertEqualObjects(reader.header, veep.header);
+  [reader release];
+}
+
+- (void)testReadsElementsWithoutReadingHeaderFirst {
+  VPKPVeep *veep = VPKPTestVeep(10);
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[veep data]];
+  XCTAssertEqualObjects([self readAllElements:reader], veep.trackElementsArray);
+  XCTAssertEqualObjects(reader.header, veep.header);
+  [reader release];
+}
+
+- (void)testInputStreamReaderMatchesDataReader {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSInputStream *stream = [NSInputStream inputStreamWithData:[veep data]];
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithInputStream:stream];
+  XCTAssertEqualObjects([reader readHeader:NULL], veep.header);
+  XCTAssertEqualObjects([self readAllElements:reader], veep.trackElementsArray);
+  [reader release];
+}
+
+- (void)testReadsInBatches {
+  VPKPVeep *veep = VPKPTestVeep(23);
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[veep data]];
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  while (YES) {
+    NSError *error = nil;
+    NSArray<VPKPVeepTrackElement *> *batch = [reader readTrackElements:5 error:&error];
+    XCTAssertNotNil(batch);
+    XCTAssertNil(error);
+    XCTAssertLessThanOrEqual(batch.count, (NSUInteger)5);
+    if (batch.count == 0) {
+      break;
+    }
+    [elements addObjectsFromArray:batch];
+  }
+  XCTAssertEqualObjects(elements, veep.trackElementsArray);
+  [reader release];
+}
+
+- (void)testVeepWithoutHeader {
+  VPKPVeep *veep = VPKPTestVeep(3);
+  veep.hasHeader = NO;
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[veep data]];
+  NSError *error = nil;
+  XCTAssertNil([reader readHeader:&error]);
+  XCTAssertNil(error);
+  XCTAssertEqualObjects([self readAllElements:reader], veep.trackElementsArray);
+  [reader release];
+}
+
+- (void)testSkipsUnknownFields {
+  VPKPVeep *veep = VPKPTestVeep(4);
+  NSMutableData *data = [NSMutableData dataWithData:[veep data]];
+  // Field 15 as a varint, then field 16 as fixed32.
+  const uint8_t unknown[] = {0x78, 0x96, 0x01, 0x85, 0x01, 1, 2, 3, 4};
+  [data appendBytes:unknown length:sizeof(unknown)];
+  [data appendData:[VPKPTestVeep(0) data]];
+  VPKPVeepTrackElementContainer *container = [VPKPVeepTrackElementContainer message];
+  container.trackElement = VPKPTestTrackElement(99);
+  [data appendData:[container data]];
+
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:data];
+  NSMutableArray *expected = [[veep.trackElementsArray mutableCopy] autorelease];
+  [expected addObject:VPKPTestTrackElement(99)];
+  XCTAssertEqualObjects([self readAllElements:reader], expected);
+  // The second header merges into the first, as with parseFromData:.
+  XCTAssertEqualObjects(reader.header, [VPKPVeep parseFromData:data error:NULL].header);
+  [reader release];
+}
+
+#pragma mark - Track Tags
+
+// Checks the headers elements, those of TaggedVeep(), resolved to.
+- (void)assertResolvedTaggedVeepElements:(NSArray<VPKPVeepTrackElement *> *)elements {
+  XCTAssertEqual(elements.count, (NSUInteger)11);
+  // The elements' own headers, then each tag the last header named by it
+  // before the tag, which is the very header object that element holds.
+  for (NSUInteger i = 0; i < elements.count; ++i) {
+    if (elements[i].metaOneOfCase == VPKPVeepTrackElement_Meta_OneOfCase_Header) {
+      XCTAssertEqual(elements[i].resolvedTrackHeader, elements[i].header, @"%lu",
+                     (unsigned long)i);
+    }
+  }
+  XCTAssertEqual(elements[1].resolvedTrackHeader, elements[0].header);
+  XCTAssertNil(elements[2].resolvedTrackHeader);
+  XCTAssertEqual(elements[4].resolvedTrackHeader, elements[3].header);
+  XCTAssertEqual(elements[6].resolvedTrackHeader, elements[5].header);
+  XCTAssertEqualObjects(elements[6].resolvedTrackHeader.title, @"A again");
+  XCTAssertNil(elements[7].resolvedTrackHeader);
+  XCTAssertNil(elements[9].resolvedTrackHeader);
+  XCTAssertNil(elements[10].resolvedTrackHeader);
+}
+
+- (void)testResolvesTrackTags {
+  VPKPVeep *veep = TaggedVeep();
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[veep data]];
+  XCTAssertEqualObjects(reader.trackHeaders, @{});
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  [elements addObjectsFromArray:[reader readTrackElements:3 error:NULL]];
+  // Only the headers read so far are known.
+  XCTAssertEqualObjects(reader.trackHeaders.allKeys, @[ @"a" ]);
+  [elements addObjectsFromArray:[self readAllElements:reader]];
+  XCTAssertEqualObjects(elements, veep.trackElementsArray);
+  [self assertResolvedTaggedVeepElements:elements];
+  XCTAssertEqualObjects(reader.trackHeaders,
+                        (@{@"a" : elements[5].header, @"b" : elements[3].header}));
+  [reader release];
+}
+
+- (void)testResolveTrackHeadersOfElementsMatchesReader {
+  VPKPVeep *veep = [VPKPVeep parseFromData:[TaggedVeep() data] error:NULL];
+  NSDictionary<NSString *, VPKPVeepTrackHeader *> *headers =
+      [VPKPVeepReader resolveTrackHeadersOfElements:veep.trackElementsArray];
+  [self assertResolvedTaggedVeepElements:veep.trackElementsArray];
+  XCTAssertEqualObjects(headers, (@{
+                          @"a" : veep.trackElementsArray[5].header,
+                          @"b" : veep.trackElementsArray[3].header
+                        }));
+
+  // Elements built in memory resolve the same way, and resolving again
+  // gives the same headers.
+  VPKPVeep *built = TaggedVeep();
+  [VPKPVeepReader resolveTrackHeadersOfElements:built.trackElementsArray];
+  [VPKPVeepReader resolveTrackHeadersOfElements:built.trackElementsArray];
+  [self assertResolvedTaggedVeepElements:built.trackElementsArray];
+}
+
+- (void)testPerformanceResolveTrackTags {
+  // Every element after the first of its track carries a tag.
+  VPKPVeep *veep = VPKPTestVeep(100000);
+  NSMutableSet<NSString *> *seen = [NSMutableSet set];
+  for (VPKPVeepTrackElement *element in veep.trackElementsArray) {
+    NSString *identifier = element.header.identifier;
+    if ([seen containsObject:identifier]) {
+      element.tag.identifier = identifier;
+    } else {
+      [seen addObject:identifier];
+    }
+  }
+  NSData *data = [veep data];
+  [self measureBlock:^{
+    VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:data];
+    NSUInteger resolved = 0;
+    while (YES) {
+      @autoreleasepool {
+        NSArray<VPKPVeepTrackElement *> *elements = [reader readTrackElements:1000 error:NULL];
+        if (!elements.count) {
+          break;
+        }
+        for (VPKPVeepTrackElement *element in elements) {
+          resolved += element.resolvedTrackHeader ? 1 : 0;
+        }
+      }
+    }
+    XCTAssertEqual(resolved, (NSUInteger)100000);
+    [reader release];
+  }];
+}
+
+- (void)testFailureIsSticky {
+  NSData *data = [VPKPTestVeep(10) data];
+  NSData *truncated = [data subdataWithRange:NSMakeRange(0, data.length - 3)];
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:truncated];
+  NSError *error = nil;
+  NSUInteger count = 0;
+  while ([reader readTrackElement:&error]) {
+    ++count;
+  }
+  XCTAssertLessThan(count, (NSUInteger)10);
+  XCTAssertNotNil(error);
+  XCTAssertEqualObjects(error.domain, VPKGPBCodedInputStreamErrorDomain);
+  XCTAssertTrue(reader.atEnd);
+
+  NSError *again = nil;
+  XCTAssertNil([reader readTrackElement:&again]);
+  XCTAssertEqualObjects(again, error);
+  XCTAssertNil([reader readTrackElements:3 error:&again]);
+  XCTAssertEqualObjects(again, error);
+  [reader release];
+}
+
+@end
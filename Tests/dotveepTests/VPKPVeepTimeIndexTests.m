@@ -0,0 +1,517 @@
+//
+//  VPKPVeepTimeIndexTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#import "VPKPTestVeeps.h"
+#import "VPKPVeepTimeIndex.h"
+
+// Their least common multiple, 441000, holds every time exactly.
+static const int32_t kMixedTimescales[] = {600, 1000, 44100, 7};
+static const int64_t kMixedCommonMultiple = 441000;
+// Pairwise coprime, so their least common multiple does not fit in int64.
+static const int32_t kCoprimeTimescales[] = {INT32_MAX, INT32_MAX - 1, INT32_MAX - 2};
+// Timescales queries use besides those of the elements, which the common
+// multiples above are not multiples of.
+static const int32_t kQueryTimescales[] = {1, 30000, 1001, 90000};
+
+#define COUNT_OF(ARRAY) (sizeof(ARRAY) / sizeof(ARRAY[0]))
+
+// Elements start within kSpanSeconds from kFirstSecond.
+static const int64_t kFirstSecond = -5;
+static const int64_t kSpanSeconds = 60;
+
+static uint64_t RandomBelow(uint32_t *seed, uint64_t bound) {
+  uint64_t random = ((uint64_t)VPKPTestRandom(seed) << 32) | VPKPTestRandom(seed);
+  return random % bound;
+}
+
+static int32_t RandomTimescale(uint32_t *seed, const int32_t *timescales, NSUInteger count) {
+  return timescales[VPKPTestRandom(seed) % count];
+}
+
+static VPKPDiscreteTime *RandomTime(uint32_t *seed, int32_t timescale) {
+  return VPKPTestTime(timescale, kFirstSecond * timescale +
+                                     (int64_t)RandomBelow(seed, (kSpanSeconds + 10) * timescale));
+}
+
+// count elements, their starts and durations each in one of timescales. Most
+// last a few seconds, some cover most of the span, some are empty, and some
+// are not indexed at all.
+static NSArray<VPKPVeepTrackElement *> *RandomElements(NSUInteger count, uint32_t seed,
+                                                       const int32_t *timescales,
+                                                       NSUInteger timescaleCount) {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    int32_t startTimescale = RandomTimescale(&seed, timescales, timescaleCount);
+    int32_t durationTimescale = RandomTimescale(&seed, timescales, timescaleCount);
+    int64_t start = RandomTime(&seed, startTimescale).value;
+    int64_t duration;
+    switch (VPKPTestRandom(&seed) % 16) {
+      case 0:
+        duration = 0;
+        break;
+      case 1:
+        duration = (int64_t)RandomBelow(&seed, kSpanSeconds * durationTimescale);
+        break;
+      default:
+        duration = 1 + (int64_t)RandomBelow(&seed, 5 * durationTimescale);
+        break;
+    }
+    VPKPVeepTrackElement *element = VPKPTestTimedElement(startTimescale, start, duration, 0, 0,
+                                                         1, 1);
+    element.discreteTimeRangeRect.timeRange.duration.timescale = durationTimescale;
+    switch (VPKPTestRandom(&seed) % 32) {
+      case 0:
+        element = VPKPTestTrackElement(1);
+        break;
+      case 1:
+        element.discreteTimeRangeRect.timeRange.start.timescale = 0;
+        break;
+      case 2:
+        element.discreteTimeRangeRect.timeRange.duration.value = -1;
+        break;
+      default:
+        break;
+    }
+    [elements addObject:element];
+  }
+  return elements;
+}
+
+#pragma mark - Linear Scan
+
+// A time as the exact fraction numerator / denominator, denominator positive.
+typedef struct Fraction {
+  __int128 numerator;
+  __int128 denominator;
+} Fraction;
+
+static Fraction TimeFraction(VPKPDiscreteTime *time) {
+  return (Fraction){time.value, time.timescale};
+}
+
+static int CompareFractions(Fraction a, Fraction b) {
+  __int128 lhs = a.numerator * b.denominator;
+  __int128 rhs = b.numerator * a.denominator;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static __int128 FloorDivide(__int128 numerator, __int128 denominator) {
+  __int128 quotient = numerator / denominator;
+  return (numerator % denominator != 0 && numerator < 0) ? quotient - 1 : quotient;
+}
+
+static __int128 CeilDivide(__int128 numerator, __int128 denominator) {
+  return -FloorDivide(-numerator, denominator);
+}
+
+// Gets the exact start and end of element. Returns NO for the elements the
+// index leaves out.
+static BOOL ElementBounds(VPKPVeepTrackElement *element, Fraction *start, Fraction *end) {
+  if (element.dataOneOfCase != VPKPVeepTrackElement_Data_OneOfCase_DiscreteTimeRangeRect) {
+    return NO;
+  }
+  VPKPDiscreteTime *startTime = element.discreteTimeRangeRect.timeRange.start;
+  VPKPDiscreteTime *duration = element.discreteTimeRangeRect.timeRange.duration;
+  if (startTime.timescale <= 0 || duration.timescale <= 0 || duration.value < 0) {
+    return NO;
+  }
+  *start = TimeFraction(startTime);
+  *end = (Fraction){(__int128)startTime.value * duration.timescale +
+                        (__int128)duration.value * startTime.timescale,
+                    (__int128)startTime.timescale * duration.timescale};
+  return YES;
+}
+
+// Orders the positions in elements by start, ties keeping their order.
+static NSArray<NSNumber *> *SortedByStart(NSArray<NSNumber *> *positions,
+                                          NSArray<VPKPVeepTrackElement *> *elements) {
+  return [positions
+      sortedArrayWithOptions:NSSortStable
+             usingComparator:^NSComparisonResult(NSNumber *lhs, NSNumber *rhs) {
+               Fraction lhsStart, rhsStart, end;
+               ElementBounds(elements[lhs.unsignedIntegerValue], &lhsStart, &end);
+               ElementBounds(elements[rhs.unsignedIntegerValue], &rhsStart, &end);
+               return (NSComparisonResult)CompareFractions(lhsStart, rhsStart);
+             }];
+}
+
+// The positions in elements of those active at time, start <= time < end,
+// ordered by start.
+static NSArray<NSNumber *> *ScanActiveAtTime(NSArray<VPKPVeepTrackElement *> *elements,
+                                             VPKPDiscreteTime *time) {
+  NSMutableArray<NSNumber *> *positions = [NSMutableArray array];
+  Fraction t = TimeFraction(time);
+  for (NSUInteger i = 0; i < elements.count; ++i) {
+    Fraction start, end;
+    if (time.timescale > 0 && ElementBounds(elements[i], &start, &end) &&
+        CompareFractions(start, t) <= 0 && CompareFractions(t, end) < 0) {
+      [positions addObject:@(i)];
+    }
+  }
+  return SortedByStart(positions, elements);
+}
+
+// The positions in elements of those active at some time in timeRange,
+// ordered by start. An empty range is looked up at its start.
+static NSArray<NSNumber *> *ScanIntersectingTimeRange(NSArray<VPKPVeepTrackElement *> *elements,
+                                                      VPKPDiscreteTimeRange *timeRange) {
+  if (timeRange.start.timescale <= 0 || timeRange.duration.timescale <= 0 ||
+      timeRange.duration.value < 0) {
+    return @[];
+  }
+  if (timeRange.duration.value == 0) {
+    return ScanActiveAtTime(elements, timeRange.start);
+  }
+  VPKPVeepTrackElement *range = [VPKPVeepTrackElement message];
+  range.discreteTimeRangeRect.timeRange = timeRange;
+  Fraction rangeStart, rangeEnd;
+  ElementBounds(range, &rangeStart, &rangeEnd);
+  NSMutableArray<NSNumber *> *positions = [NSMutableArray array];
+  for (NSUInteger i = 0; i < elements.count; ++i) {
+    Fraction start, end;
+    if (ElementBounds(elements[i], &start, &end) && CompareFractions(start, end) < 0 &&
+        CompareFractions(start, rangeEnd) < 0 && CompareFractions(rangeStart, end) < 0) {
+      [positions addObject:@(i)];
+    }
+  }
+  return SortedByStart(positions, elements);
+}
+
+// Like ScanActiveAtTime(), but on the bounds widened out to whole ticks of
+// timescale and the time rounded down to them, leaving out elements whose
+// ticks do not fit in int64, and ordered by their starting tick.
+static NSArray<NSNumber *> *ScanActiveAtTicks(NSArray<VPKPVeepTrackElement *> *elements,
+                                              int64_t timescale, VPKPDiscreteTime *time) {
+  __int128 ticks = FloorDivide((__int128)time.value * timescale, time.timescale);
+  NSMutableArray<NSNumber *> *positions = [NSMutableArray array];
+  NSMutableDictionary<NSNumber *, NSNumber *> *startTicks = [NSMutableDictionary dictionary];
+  for (NSUInteger i = 0; i < elements.count; ++i) {
+    Fraction start, end;
+    if (!ElementBounds(elements[i], &start, &end)) {
+      continue;
+    }
+    __int128 first = FloorDivide(start.numerator * timescale, start.denominator);
+    __int128 last = CeilDivide(end.numerator * timescale, end.denominator);
+    if (first < INT64_MIN || first > INT64_MAX || last < INT64_MIN || last > INT64_MAX) {
+      continue;
+    }
+    if (first <= ticks && ticks < last) {
+      [positions addObject:@(i)];
+      startTicks[@(i)] = @((int64_t)first);
+    }
+  }
+  return [positions
+      sortedArrayWithOptions:NSSortStable
+             usingComparator:^NSComparisonResult(NSNumber *lhs, NSNumber *rhs) {
+               return [startTicks[lhs] compare:startTicks[rhs]];
+             }];
+}
+
+// The positions in elements of the objects in found.
+static NSArray<NSNumber *> *Positions(NSArray<VPKPVeepTrackElement *> *found,
+                                      NSArray<VPKPVeepTrackElement *> *elements) {
+  NSMutableArray<NSNumber *> *positions = [NSMutableArray arrayWithCapacity:found.count];
+  for (VPKPVeepTrackElement *element in found) {
+    [positions addObject:@([elements indexOfObjectIdenticalTo:element])];
+  }
+  return positions;
+}
+
+// Times to look elements up at: every start and end, the instants just
+// before them, and random times in each of timescales.
+static NSArray<VPKPDiscreteTime *> *QueryTimes(NSArray<VPKPVeepTrackElement *> *elements,
+                                               uint32_t seed, const int32_t *timescales,
+                                               NSUInteger timescaleCount) {
+  NSMutableArray<VPKPDiscreteTime *> *times = [NSMutableArray array];
+  for (VPKPVeepTrackElement *element in elements) {
+    Fraction start, end;
+    if (!ElementBounds(element, &start, &end)) {
+      continue;
+    }
+    [times addObject:VPKPTestTime((int32_t)start.denominator, (int64_t)start.numerator)];
+    [times addObject:VPKPTestTime((int32_t)start.denominator, (int64_t)start.numerator - 1)];
+    if (end.denominator <= INT32_MAX) {
+      [times addObject:VPKPTestTime((int32_t)end.denominator, (int64_t)end.numerator)];
+      [times addObject:VPKPTestTime((int32_t)end.denominator, (int64_t)end.numerator - 1)];
+    }
+  }
+  for (NSUInteger i = 0; i < elements.count + 100; ++i) {
+    int32_t timescale = VPKPTestRandom(&seed) % 2
+                            ? RandomTimescale(&seed, timescales, timescaleCount)
+                            : RandomTimescale(&seed, kQueryTimescales, COUNT_OF(kQueryTimescales));
+    [times addObject:RandomTime(&seed, timescale)];
+  }
+  return times;
+}
+
+@interface VPKPVeepTimeIndexTests : XCTestCase
+@end
+
+@implementation VPKPVeepTimeIndexTests
+
+- (void)assertIndex:(VPKPVeepTimeIndex *)index
+    matchesScanAtTimes:(NSArray<VPKPDiscreteTime *> *)times {
+  NSArray<VPKPVeepTrackElement *> *elements = index.trackElements;
+  for (VPKPDiscreteTime *time in times) {
+    XCTAssertEqualObjects(Positions([index elementsActiveAtTime:time], elements),
+                          ScanActiveAtTime(elements, time), @"%lld/%d", time.value,
+                          time.timescale);
+  }
+}
+
+#pragma mark - Lookups
+
+- (void)testElementsActiveAtTimeMatchesLinearScan {
+  const int32_t timescales[] = {600};
+  for (NSNumber *count in @[ @0, @1, @2, @10, @100, @1000 ]) {
+    NSArray<VPKPVeepTrackElement *> *elements =
+        RandomElements(count.unsignedIntegerValue, 1 + count.unsignedIntValue, timescales, 1);
+    VPKPVeepTimeIndex *index =
+        [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+    [self assertIndex:index matchesScanAtTimes:QueryTimes(elements, 7, timescales, 1)];
+  }
+
+  // The test veeps alternate timed elements and elements with a rect.
+  VPKPVeep *veep = VPKPTestVeep(500);
+  VPKPVeepTimeIndex *index = [[[VPKPVeepTimeIndex alloc] initWithVeep:veep] autorelease];
+  XCTAssertEqual(index.count, (NSUInteger)250);
+  XCTAssertEqual(index.timescale, 600);
+  [self assertIndex:index
+      matchesScanAtTimes:QueryTimes(veep.trackElementsArray, 11, timescales, 1)];
+}
+
+- (void)testMixedTimescalesMatchLinearScan {
+  for (NSNumber *count in @[ @10, @1000 ]) {
+    NSArray<VPKPVeepTrackElement *> *elements =
+        RandomElements(count.unsignedIntegerValue, 3 + count.unsignedIntValue, kMixedTimescales,
+                       COUNT_OF(kMixedTimescales));
+    VPKPVeepTimeIndex *index =
+        [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+    XCTAssertEqual(kMixedCommonMultiple % index.timescale, 0);
+    if (count.unsignedIntegerValue == 1000) {
+      XCTAssertEqual(index.timescale, kMixedCommonMultiple);
+    }
+    [self assertIndex:index
+        matchesScanAtTimes:QueryTimes(elements, 13, kMixedTimescales,
+                                      COUNT_OF(kMixedTimescales))];
+  }
+
+  // Times far outside any element, whose ticks do not fit in int64.
+  NSArray<VPKPVeepTrackElement *> *elements =
+      RandomElements(100, 17, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  [self assertIndex:[[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease]
+      matchesScanAtTimes:@[
+        VPKPTestTime(1, INT64_MAX), VPKPTestTime(1, INT64_MIN), VPKPTestTime(7, INT64_MAX / 2)
+      ]];
+}
+
+- (void)testOverflowFallbackMatchesWidenedLinearScan {
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray
+      arrayWithArray:RandomElements(1000, 19, kCoprimeTimescales, COUNT_OF(kCoprimeTimescales))];
+  // Out of range in ticks of any of the timescales, so left out.
+  VPKPVeepTrackElement *far = VPKPTestTimedElement(1, INT64_MAX / 4, 1, 0, 0, 1, 1);
+  [elements insertObject:far atIndex:500];
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+  XCTAssertEqual(index.timescale, (int64_t)INT32_MAX);
+  NSUInteger usable = 0;
+  for (VPKPVeepTrackElement *element in elements) {
+    Fraction start, end;
+    usable += ElementBounds(element, &start, &end) ? 1 : 0;
+  }
+  XCTAssertEqual(index.count, usable - 1);
+
+  NSMutableArray<VPKPDiscreteTime *> *times = [NSMutableArray
+      arrayWithArray:QueryTimes(elements, 23, kCoprimeTimescales, COUNT_OF(kCoprimeTimescales))];
+  [times addObject:far.discreteTimeRangeRect.timeRange.start];
+  for (VPKPDiscreteTime *time in times) {
+    NSArray<NSNumber *> *found = Positions([index elementsActiveAtTime:time], elements);
+    // Widened elements are found a little early or late, but never missed.
+    XCTAssertEqualObjects(found, ScanActiveAtTicks(elements, index.timescale, time),
+                          @"%lld/%d", time.value, time.timescale);
+    NSMutableSet<NSNumber *> *active =
+        [NSMutableSet setWithArray:ScanActiveAtTime(elements, time)];
+    [active removeObject:@500];
+    XCTAssertTrue([active isSubsetOfSet:[NSSet setWithArray:found]], @"%lld/%d", time.value,
+                  time.timescale);
+    XCTAssertFalse([found containsObject:@500]);
+  }
+}
+
+- (void)testElementsIntersectingTimeRangeMatchesLinearScan {
+  NSArray<VPKPVeepTrackElement *> *elements =
+      RandomElements(1000, 29, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+  NSArray<VPKPDiscreteTime *> *times =
+      QueryTimes(elements, 31, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  uint32_t seed = 37;
+  for (VPKPDiscreteTime *time in times) {
+    VPKPDiscreteTimeRange *timeRange = [VPKPDiscreteTimeRange message];
+    timeRange.start = time;
+    // From the start to another of the times, empty, or not a range at all.
+    VPKPDiscreteTime *other = times[VPKPTestRandom(&seed) % times.count];
+    switch (VPKPTestRandom(&seed) % 8) {
+      case 0:
+        timeRange.duration = VPKPTestTime(time.timescale, 0);
+        break;
+      case 1:
+        timeRange.duration = VPKPTestTime(time.timescale, -1);
+        break;
+      default:
+        timeRange.duration = VPKPTestTime(
+            other.timescale,
+            llabs(other.value - FloorDivide((__int128)time.value * other.timescale,
+                                            time.timescale)));
+        break;
+    }
+    XCTAssertEqualObjects(Positions([index elementsIntersectingTimeRange:timeRange], elements),
+                          ScanIntersectingTimeRange(elements, timeRange), @"%@", timeRange);
+  }
+}
+
+#pragma mark - Cursors
+
+- (void)testCursorMatchesLinearScan {
+  NSArray<VPKPVeepTrackElement *> *elements =
+      RandomElements(1000, 41, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+  VPKPVeepTimeIndexCursor *cursor = [index cursor];
+  XCTAssertEqual(cursor.index, index);
+  XCTAssertEqual(cursor.activeElementCount, (NSUInteger)0);
+  XCTAssertEqualObjects(cursor.activeElements, @[]);
+
+  // Playback at 30000/1001 frames a second, with the odd seek back, seek
+  // ahead, repeated frame, and time that is not one.
+  uint32_t seed = 43;
+  int64_t frame = kFirstSecond * 30000;
+  for (NSUInteger i = 0; i < 3000; ++i) {
+    VPKPDiscreteTime *time;
+    switch (VPKPTestRandom(&seed) % 64) {
+      case 0:
+        time = RandomTime(&seed, RandomTimescale(&seed, kMixedTimescales,
+                                                 COUNT_OF(kMixedTimescales)));
+        frame = (int64_t)FloorDivide((__int128)time.value * 30000, time.timescale);
+        break;
+      case 1:
+        time = VPKPTestTime(30000, frame);
+        break;
+      case 2:
+        time = VPKPTestTime(0, frame);
+        break;
+      default:
+        frame += 1001;
+        time = VPKPTestTime(30000, frame);
+        break;
+    }
+    [cursor moveToTime:time];
+    NSArray<NSNumber *> *expected =
+        [ScanActiveAtTime(elements, time) sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqual(cursor.activeElementCount, expected.count, @"%lld/%d", time.value,
+                   time.timescale);
+    XCTAssertEqualObjects(
+        [Positions(cursor.activeElements, elements) sortedArrayUsingSelector:@selector(compare:)],
+        expected, @"%lld/%d", time.value, time.timescale);
+    NSMutableArray<NSNumber *> *enumerated = [NSMutableArray array];
+    [cursor enumerateActiveElementsUsingBlock:^(VPKPVeepTrackElement *element, NSUInteger idx,
+                                                __unused BOOL *stop) {
+      XCTAssertEqual(elements[idx], element);
+      [enumerated addObject:@(idx)];
+    }];
+    XCTAssertEqualObjects([enumerated sortedArrayUsingSelector:@selector(compare:)], expected);
+  }
+}
+
+- (void)testCursorEnumerationStops {
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:@[
+        VPKPTestTimedElement(600, 0, 600, 0, 0, 1, 1),
+        VPKPTestTimedElement(600, 0, 600, 0, 0, 1, 1),
+        VPKPTestTimedElement(600, 0, 600, 0, 0, 1, 1),
+      ]] autorelease];
+  VPKPVeepTimeIndexCursor *cursor = [index cursor];
+  [cursor moveToTime:VPKPTestTime(1, 0)];
+  XCTAssertEqual(cursor.activeElementCount, (NSUInteger)3);
+  __block NSUInteger calls = 0;
+  [cursor enumerateActiveElementsUsingBlock:^(__unused VPKPVeepTrackElement *element,
+                                              __unused NSUInteger idx, BOOL *stop) {
+    ++calls;
+    *stop = YES;
+  }];
+  XCTAssertEqual(calls, (NSUInteger)1);
+}
+
+#pragma mark - Unindexed Elements
+
+- (void)testUnusableTimesFindNothing {
+  VPKPVeepTimeIndex *empty = [[[VPKPVeepTimeIndex alloc] initWithTrackElements:@[]] autorelease];
+  XCTAssertEqual(empty.count, (NSUInteger)0);
+  XCTAssertEqualObjects([empty elementsActiveAtTime:VPKPTestTime(600, 0)], @[]);
+  [[empty cursor] moveToTime:VPKPTestTime(600, 0)];
+
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithVeep:VPKPTestVeep(100)] autorelease];
+  XCTAssertEqualObjects([index elementsActiveAtTime:VPKPTestTime(0, 300)], @[]);
+  XCTAssertEqualObjects([index elementsActiveAtTime:VPKPTestTime(-600, 300)], @[]);
+  VPKPDiscreteTimeRange *timeRange = [VPKPDiscreteTimeRange message];
+  timeRange.start = VPKPTestTime(600, 300);
+  XCTAssertEqualObjects([index elementsIntersectingTimeRange:timeRange], @[]);
+  VPKPVeepTimeIndexCursor *cursor = [index cursor];
+  [cursor moveToTime:VPKPTestTime(600, 300)];
+  XCTAssertNotEqual(cursor.activeElementCount, (NSUInteger)0);
+  [cursor moveToTime:VPKPTestTime(0, 300)];
+  XCTAssertEqual(cursor.activeElementCount, (NSUInteger)0);
+}
+
+#pragma mark - Performance
+
+- (void)testPerformanceElementsActiveAtTime {
+  NSArray<VPKPVeepTrackElement *> *elements =
+      RandomElements(10000, 47, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+  NSMutableArray<VPKPDiscreteTime *> *times = [NSMutableArray array];
+  uint32_t seed = 53;
+  for (NSUInteger i = 0; i < 10000; ++i) {
+    [times addObject:RandomTime(&seed, 30000)];
+  }
+  [self measureBlock:^{
+    @autoreleasepool {
+      for (VPKPDiscreteTime *time in times) {
+        [index elementsActiveAtTime:time];
+      }
+    }
+  }];
+}
+
+- (void)testPerformanceCursorPlayback {
+  NSArray<VPKPVeepTrackElement *> *elements =
+      RandomElements(10000, 59, kMixedTimescales, COUNT_OF(kMixedTimescales));
+  VPKPVeepTimeIndex *index =
+      [[[VPKPVeepTimeIndex alloc] initWithTrackElements:elements] autorelease];
+  // Every frame of the span at 30000/1001 frames a second.
+  NSMutableArray<VPKPDiscreteTime *> *frames = [NSMutableArray array];
+  for (int64_t value = kFirstSecond * 30000; value < (kFirstSecond + kSpanSeconds) * 30000;
+       value += 1001) {
+    [frames addObject:VPKPTestTime(30000, value)];
+  }
+  [self measureBlock:^{
+    VPKPVeepTimeIndexCursor *cursor = [index cursor];
+    __block NSUInteger visited = 0;
+    for (VPKPDiscreteTime *time in frames) {
+      [cursor moveToTime:time];
+      [cursor enumerateActiveElementsUsingBlock:^(__unused VPKPVeepTrackElement *element,
+                                                  __unused NSUInteger idx, __unused BOOL *stop) {
+        ++visited;
+      }];
+    }
+    XCTAssertNotEqual(visited, (NSUInteger)0);
+  }];
+}
+
+@end
@@ -0,0 +1,329 @@
+//
+//  VPKPVeepWriterTests.m
+//  dotveepTests
+//
+
+#import <XCTest/XCTest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#import "VPKPTestVeeps.h"
+#import "VPKPVeepReader.h"
+#import "VPKPVeepWriter.h"
+
+// The test track element at index, carrying a track header with the given
+// identifier.
+static VPKPVeepTrackElement *HeaderElement(NSUInteger index, NSString *identifier) {
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(index);
+  element.header.identifier = identifier;
+  return element;
+}
+
+// Which of the elements were written with a tag, as a string of H for a
+// header and T for a tag.
+static NSString *MetaCases(NSArray<VPKPVeepTrackElement *> *elements) {
+  NSMutableString *cases = [NSMutableString string];
+  for (VPKPVeepTrackElement *element in elements) {
+    BOOL tagged = element.metaOneOfCase == VPKPVeepTrackElement_Meta_OneOfCase_Tag;
+    [cases appendString:tagged ? @"T" : @"H"];
+  }
+  return cases;
+}
+
+@interface VPKPVeepWriterTests : XCTestCase
+@end
+
+@implementation VPKPVeepWriterTests {
+  NSOutputStream *memory_;
+}
+
+- (void)setUp {
+  [super setUp];
+  memory_ = [[NSOutputStream outputStreamToMemory] retain];
+  [memory_ open];
+}
+
+- (void)tearDown {
+  [memory_ close];
+  [memory_ release];
+  memory_ = nil;
+  [super tearDown];
+}
+
+- (NSData *)writtenData {
+  return [memory_ propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+}
+
+- (void)testWriteVeepMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  NSError *error = nil;
+  XCTAssertTrue([writer writeVeep:veep error:&error]);
+  XCTAssertTrue([writer flush:&error]);
+  XCTAssertNil(error);
+  XCTAssertEqual(writer.trackElementCount, (NSUInteger)100);
+  XCTAssertEqualObjects([self writtenData], [veep data]);
+  [writer release];
+}
+
+- (void)testIncrementalWritesMatchData {
+  VPKPVeep *veep = VPKPTestVeep(50);
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  writer.elementsPerFlush = 3;
+  XCTAssertTrue([writer writeHeader:veep.header error:NULL]);
+  NSArray<VPKPVeepTrackElement *> *elements = veep.trackElementsArray;
+  for (NSUInteger i = 0; i < 20; ++i) {
+    XCTAssertTrue([writer appendTrackElement:elements[i] error:NULL]);
+  }
+  XCTAssertTrue([writer appendTrackElements:[elements subarrayWithRange:NSMakeRange(20, 30)]
+                                      error:NULL]);
+  XCTAssertTrue([writer flush:NULL]);
+  XCTAssertEqualObjects([self writtenData], [veep data]);
+  [writer release];
+}
+
+- (void)testElementsPerFlushHandsElementsToStream {
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  writer.elementsPerFlush = 2;
+  VPKPVeepTrackElement *element = VPKPTestTrackElement(0);
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  XCTAssertEqual([self writtenData].length, (NSUInteger)0);
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  VPKPVeep *expected = [VPKPVeep message];
+  [expected.trackElementsArray addObject:element];
+  [expected.trackElementsArray addObject:element];
+  XCTAssertEqualObjects([self writtenData], [expected data]);
+  [writer release];
+}
+
+- (void)testWriterOutputReadsBack {
+  VPKPVeep *veep = VPKPTestVeep(40);
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  XCTAssertTrue([writer writeVeep:veep error:NULL]);
+  XCTAssertTrue([writer flush:NULL]);
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[self writtenData]];
+  XCTAssertEqualObjects([reader readHeader:NULL], veep.header);
+  XCTAssertEqualObjects([reader readTrackElements:NSUIntegerMax error:NULL],
+                        veep.trackElementsArray);
+  [reader release];
+  [writer release];
+}
+
+- (void)testHeaderAfterElementRaises {
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  XCTAssertTrue([writer appendTrackElement:VPKPTestTrackElement(0) error:NULL]);
+  XCTAssertThrowsSpecificNamed([writer writeHeader:[VPKPVeepHeader message] error:NULL],
+                               NSException, NSInternalInconsistencyException);
+  [writer release];
+}
+
+- (void)testFailureIsSticky {
+  uint8_t buffer[16];
+  NSOutputStream *small = [[NSOutputStream alloc] initToBuffer:buffer capacity:sizeof(buffer)];
+  [small open];
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:small];
+  VPKPVeep *veep = VPKPTestVeep(10);
+  NSError *error = nil;
+  BOOL written = [writer writeVeep:veep error:&error] && [writer flush:&error];
+  XCTAssertFalse(written);
+  XCTAssertNotNil(error);
+
+  NSError *again = nil;
+  XCTAssertFalse([writer appendTrackElement:VPKPTestTrackElement(0) error:&again]);
+  XCTAssertEqualObjects(again, error);
+  again = nil;
+  XCTAssertFalse([writer flush:&again]);
+  XCTAssertEqualObjects(again, error);
+  // Its stream still holds bytes it could not write, which must not raise
+  // again when the writer goes away.
+  XCTAssertNoThrow([writer release]);
+  [small close];
+  [small release];
+}
+
+#pragma mark - Track Header Deduplication
+
+// Writes elements with deduplicatesTrackHeaders set and maxRemembered as
+// maxRememberedTrackHeaders, and reads them back.
+- (NSArray<VPKPVeepTrackElement *> *)deduplicatedElements:
+                                         (NSArray<VPKPVeepTrackElement *> *)elements
+                                              maxRemembered:(NSUInteger)maxRemembered {
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  writer.deduplicatesTrackHeaders = YES;
+  writer.maxRememberedTrackHeaders = maxRemembered;
+  NSError *error = nil;
+  XCTAssertTrue([writer appendTrackElements:elements error:&error]);
+  XCTAssertTrue([writer flush:&error]);
+  XCTAssertNil(error);
+  [writer release];
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[self writtenData]];
+  NSArray<VPKPVeepTrackElement *> *read = [reader readTrackElements:NSUIntegerMax error:&error];
+  XCTAssertNil(error);
+  [reader release];
+  return read;
+}
+
+- (void)testDeduplicatedTrackHeadersResolveBack {
+  VPKPVeep *veep = VPKPTestVeep(200);
+  // Some tracks change their header part way, some headers have no
+  // identifier, and some elements have no header.
+  for (NSUInteger i = 100; i < 200; i += 4) {
+    veep.trackElementsArray[i].header.title = @"Changed";
+  }
+  for (NSUInteger i = 50; i < 200; i += 25) {
+    veep.trackElementsArray[i].header.identifier = @"";
+  }
+  for (NSUInteger i = 60; i < 200; i += 30) {
+    VPKPVeepTrackElement_ClearMetaOneOfCase(veep.trackElementsArray[i]);
+  }
+  VPKPVeep *original = [[veep copy] autorelease];
+  NSArray<VPKPVeepTrackElement *> *read = [self deduplicatedElements:veep.trackElementsArray
+                                                       maxRemembered:256];
+  // The elements passed in are left as they were.
+  XCTAssertEqualObjects(veep, original);
+  VPKPVeep *elementsOnly = [VPKPVeep message];
+  [elementsOnly.trackElementsArray addObjectsFromArray:veep.trackElementsArray];
+  XCTAssertLessThan([self writtenData].length, [elementsOnly data].length);
+
+  XCTAssertEqual(read.count, (NSUInteger)200);
+  NSUInteger tagged = 0;
+  for (NSUInteger i = 0; i < read.count; ++i) {
+    VPKPVeepTrackElement *element = read[i];
+    VPKPVeepTrackElement *expected = veep.trackElementsArray[i];
+    if (element.metaOneOfCase == VPKPVeepTrackElement_Meta_OneOfCase_Tag) {
+      ++tagged;
+      XCTAssertEqualObjects(element.tag.identifier, expected.header.identifier, @"%lu",
+                            (unsigned long)i);
+      // Everything but the header survives.
+      VPKPVeepTrackElement *untagged = [[element copy] autorelease];
+      untagged.header = element.resolvedTrackHeader;
+      XCTAssertEqualObjects(untagged, expected, @"%lu", (unsigned long)i);
+    } else {
+      XCTAssertEqualObjects(element, expected, @"%lu", (unsigned long)i);
+    }
+    XCTAssertEqualObjects(element.resolvedTrackHeader,
+                          expected.metaOneOfCase == VPKPVeepTrackElement_Meta_OneOfCase_Header
+                              ? expected.header
+                              : nil,
+                          @"%lu", (unsigned long)i);
+  }
+  XCTAssertGreaterThan(tagged, (NSUInteger)100);
+}
+
+- (void)testDeduplicationWritesChangedHeadersInFull {
+  VPKPVeepTrackElement *a = HeaderElement(0, @"a");
+  VPKPVeepTrackElement *changed = HeaderElement(0, @"a");
+  changed.header.title = @"Changed";
+  VPKPVeepTrackElement *unnamed = HeaderElement(0, @"");
+  NSArray<VPKPVeepTrackElement *> *read =
+      [self deduplicatedElements:@[ a, a, changed, changed, a, unnamed, unnamed ]
+                   maxRemembered:256];
+  XCTAssertEqualObjects(MetaCases(read), @"HTHTHHH");
+  XCTAssertEqualObjects(read[3].resolvedTrackHeader, changed.header);
+  XCTAssertEqualObjects(read[4].resolvedTrackHeader, a.header);
+}
+
+- (void)testDeduplicationNoticesChangesToWrittenHeaders {
+  VPKPVeepTrackElement *element = HeaderElement(0, @"a");
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  writer.deduplicatesTrackHeaders = YES;
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  // The same header object, changed after it was written.
+  element.header.title = @"Changed";
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  XCTAssertTrue([writer appendTrackElement:element error:NULL]);
+  XCTAssertTrue([writer flush:NULL]);
+  [writer release];
+  VPKPVeepReader *reader = [[VPKPVeepReader alloc] initWithData:[self writtenData]];
+  NSArray<VPKPVeepTrackElement *> *read = [reader readTrackElements:NSUIntegerMax error:NULL];
+  XCTAssertEqualObjects(MetaCases(read), @"HTHT");
+  XCTAssertEqualObjects(read[3].resolvedTrackHeader.title, @"Changed");
+  [reader release];
+}
+
+- (void)testMaxRememberedTrackHeadersForgetsOldest {
+  VPKPVeepTrackElement *a = HeaderElement(0, @"a");
+  VPKPVeepTrackElement *b = HeaderElement(1, @"b");
+  VPKPVeepTrackElement *c = HeaderElement(2, @"c");
+  // Remembering two, c makes the writer forget a, and a then forget b.
+  NSArray<VPKPVeepTrackElement *> *read =
+      [self deduplicatedElements:@[ a, b, a, c, a, c, b ] maxRemembered:2];
+  XCTAssertEqualObjects(MetaCases(read), @"HHTHHTH");
+  for (NSUInteger i = 0; i < read.count; ++i) {
+    XCTAssertEqualObjects(read[i].resolvedTrackHeader, @[ a, b, a, c, a, c, b ][i].header);
+  }
+}
+
+- (void)testZeroMaxRememberedTrackHeadersWritesHeadersInFull {
+  VPKPVeepTrackElement *a = HeaderElement(0, @"a");
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory_];
+  XCTAssertEqual(writer.maxRememberedTrackHeaders, (NSUInteger)256);
+  writer.deduplicatesTrackHeaders = YES;
+  writer.maxRememberedTrackHeaders = 0;
+  XCTAssertTrue([writer appendTrackElements:@[ a, a, a ] error:NULL]);
+  XCTAssertTrue([writer flush:NULL]);
+  [writer release];
+  VPKPVeep *expected = [VPKPVeep message];
+  [expected.trackElementsArray addObjectsFromArray:@[ a, a, a ]];
+  XCTAssertEqualObjects([self writtenData], [expected data]);
+}
+
+- (void)testPerformanceDeduplicatedRoundTrip {
+  VPKPVeep *veep = VPKPTestVeep(100000);
+  [self measureBlock:^{
+    NSOutputStream *memory = [NSOutputStream outputStreamToMemory];
+    [memory open];
+    VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithOutputStream:memory];
+    writer.deduplicatesTrackHeaders = YES;
+    XCTAssertTrue([writer writeVeep:veep error:NULL]);
+    XCTAssertTrue([writer flush:NULL]);
+    [writer release];
+    VPKPVeepReader *reader = [[VPKPVeepReader alloc]
+        initWithData:[memory propertyForKey:NSStreamDataWrittenToMemoryStreamKey]];
+    NSUInteger resolved = 0;
+    while (YES) {
+      @autoreleasepool {
+        NSArray<VPKPVeepTrackElement *> *elements = [reader readTrackElements:1000 error:NULL];
+        if (!elements.count) {
+          break;
+        }
+        for (VPKPVeepTrackElement *element in elements) {
+          resolved += element.resolvedTrackHeader ? 1 : 0;
+        }
+      }
+    }
+    XCTAssertEqual(resolved, (NSUInteger)100000);
+    [reader release];
+    [memory close];
+  }];
+}
+
+- (void)testFileDescriptorWriterMatchesData {
+  VPKPVeep *veep = VPKPTestVeep(100);
+  NSString *path =
+      [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+  int fd = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  XCTAssertGreaterThanOrEqual(fd, 0);
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithFileDescriptor:fd bufferSize:1000];
+  NSError *error = nil;
+  XCTAssertTrue([writer writeVeep:veep error:&error]);
+  XCTAssertTrue([writer flush:&error]);
+  XCTAssertNil(error);
+  [writer release];
+  close(fd);
+  XCTAssertEqualObjects([NSData dataWithContentsOfFile:path], [veep data]);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+- (void)testFileDescriptorWriterFailure {
+  VPKPVeepWriter *writer = [[VPKPVeepWriter alloc] initWithFileDescriptor:-1 bufferSize:16];
+  NSError *error = nil;
+  BOOL written = [writer writeVeep:VPKPTestVeep(10) error:&error] && [writer flush:&error];
+  XCTAssertFalse(written);
+  XCTAssertEqualObjects(error.userInfo[VPKGPBErrorReasonKey], @(strerror(EBADF)));
+  XCTAssertNoThrow([writer release]);
+}
+
+@end
@@ -30,6 +30,10 @@
 
 #import "VPKGPBArray_PackagePrivate.h"
 
+#import <os/lock.h>
+
+#import "VPKGPBCodedOutputStream_PackagePrivate.h"
+#import "VPKGPBDescriptor_PackagePrivate.h"
 #import "VPKGPBMessage_PackagePrivate.h"
 
 // Direct access is use for speed, to avoid even internally declaring things
@@ -217,6 +221,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
 //%    }
 //%  }
 //%}
+//%
+//%- (const TYPE *)internalValues {
+//%  return _values;
+//%}
 
 //%PDDM-DEFINE MUTATION_HOOK_None()
 //%PDDM-DEFINE MUTATION_METHODS(NAME, TYPE, ACCESSOR_NAME, HOOK_1, HOOK_2)
@@ -428,6 +436,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const int32_t *)internalValues {
+  return _values;
+}
+
 - (int32_t)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -676,6 +688,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const uint32_t *)internalValues {
+  return _values;
+}
+
 - (uint32_t)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -924,6 +940,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const int64_t *)internalValues {
+  return _values;
+}
+
 - (int64_t)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -1172,6 +1192,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const uint64_t *)internalValues {
+  return _values;
+}
+
 - (uint64_t)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -1420,6 +1444,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const float *)internalValues {
+  return _values;
+}
+
 - (float)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -1668,6 +1696,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const double *)internalValues {
+  return _values;
+}
+
 - (double)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -1916,6 +1948,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
   }
 }
 
+- (const BOOL *)internalValues {
+  return _values;
+}
+
 - (BOOL)valueAtIndex:(NSUInteger)index {
   if (index >= _count) {
     [NSException raise:NSRangeException
@@ -2186,6 +2222,10 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
     }
   }
 }
+
+- (const int32_t *)internalValues {
+  return _values;
+}
 //%PDDM-EXPAND-END ARRAY_IMMUTABLE_CORE(Enum, int32_t, Raw, %d)
 
 // clang-format on
@@ -2490,6 +2530,7 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
 // we only autocreate empty arrays.
 
 - (void)insertObject:(id)anObject atIndex:(NSUInteger)idx {
+  CheckObject(self, anObject);
   if (_array == nil) {
     _array = [[NSMutableArray alloc] init];
   }
@@ -2509,6 +2550,7 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
 }
 
 - (void)addObject:(id)anObject {
+  CheckObject(self, anObject);
   if (_array == nil) {
     _array = [[NSMutableArray alloc] init];
   }
@@ -2524,6 +2566,7 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
 }
 
 - (void)replaceObjectAtIndex:(NSUInteger)idx withObject:(id)anObject {
+  CheckObject(self, anObject);
   [_array replaceObjectAtIndex:idx withObject:anObject];
 }
 
@@ -2560,4 +2603,212 @@ static BOOL ArrayDefault_IsValidValue(int32_t value) {
 
 @end
 
+@implementation VPKGPBLazyMessageArray {
+  // Holds NSData for the elements not decoded yet, VPKGPBMessages otherwise.
+  NSMutableArray *_array;
+  Class _messageClass;
+  id<VPKGPBExtensionRegistry> _extensionRegistry;
+  // Guards _array. Decoding on access turns reads into writes, so even
+  // concurrent readers need it.
+  os_unfair_lock _lock;
+}
+
+- (instancetype)initWithMessageClass:(Class)messageClass
+                   extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry {
+  if ((self = [super init])) {
+    _array = [[NSMutableArray alloc] init];
+    _messageClass = messageClass;
+    _extensionRegistry = [extensionRegistry retain];
+    _lock = OS_UNFAIR_LOCK_INIT;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [_array release];
+  [_extensionRegistry release];
+  [super dealloc];
+}
+
+- (void)addMessageData:(NSData *)data {
+  os_unfair_lock_lock(&_lock);
+  [_array addObject:data];
+  os_unfair_lock_unlock(&_lock);
+}
+
+// Returns a snapshot of the elements, leaving the undecoded ones as NSData.
+- (NSArray *)copyElements {
+  os_unfair_lock_lock(&_lock);
+  NSArray *result = [_array copy];
+  os_unfair_lock_unlock(&_lock);
+  return result;
+}
+
+// Every primitive takes the lock, so reads (which may decode and store an
+// element) and mutations can run concurrently. The lock is never held while
+// something can raise, so nil objects and bad indexes are checked first.
+static void CheckObject(VPKGPBLazyMessageArray *self, id anObject) {
+  if (anObject == nil) {
+    [NSException raise:NSInvalidArgumentException
+                format:@"%@: object cannot be nil", [self class]];
+  }
+}
+
+static void CheckIndex(VPKGPBLazyMessageArray *self, NSUInteger idx, NSUInteger count) {
+  if (idx >= count) {
+    os_unfair_lock_unlock(&self->_lock);
+    [NSException raise:NSRangeException
+                format:@"%@: index (%lu) beyond bounds (%lu)", [self class], (unsigned long)idx,
+                       (unsigned long)count];
+  }
+}
+
+#pragma mark Required NSArray overrides
+
+- (NSUInteger)count {
+  os_unfair_lock_lock(&_lock);
+  NSUInteger count = [_array count];
+  os_unfair_lock_unlock(&_lock);
+  return count;
+}
+
+- (id)objectAtIndex:(NSUInteger)idx {
+  os_unfair_lock_lock(&_lock);
+  CheckIndex(self, idx, [_array count]);
+  id value = [[[_array objectAtIndex:idx] retain] autorelease];
+  os_unfair_lock_unlock(&_lock);
+  if (![value isKindOfClass:[NSData class]]) {
+    return value;
+  }
+
+  // Decode outside the lock since a malformed element raises.
+  VPKGPBMessage *message = [[_messageClass alloc] init];
+  @try {
+    [message mergeFromData:value extensionRegistry:_extensionRegistry];
+  } @catch (NSException *exception) {
+    [message release];
+    @throw;
+  }
+
+  os_unfair_lock_lock(&_lock);
+  id current = idx < [_array count] ? [_array objectAtIndex:idx] : nil;
+  if (current == value) {
+    [_array replaceObjectAtIndex:idx withObject:message];
+  } else if ([current isKindOfClass:_messageClass]) {
+    // Another reader got here first, use its message.
+    [message release];
+    message = [current retain];
+  }
+  os_unfair_lock_unlock(&_lock);
+  return [message autorelease];
+}
+
+#pragma mark Required NSMutableArray overrides
+
+- (void)insertObject:(id)anObject atIndex:(NSUInteger)idx {
+  CheckObject(self, anObject);
+  os_unfair_lock_lock(&_lock);
+  CheckIndex(self, idx, [_array count] + 1);
+  [_array insertObject:anObject atIndex:idx];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeObjectAtIndex:(NSUInteger)idx {
+  os_unfair_lock_lock(&_lock);
+  CheckIndex(self, idx, [_array count]);
+  [_array removeObjectAtIndex:idx];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)addObject:(id)anObject {
+  CheckObject(self, anObject);
+  os_unfair_lock_lock(&_lock);
+  [_array addObject:anObject];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)removeLastObject {
+  os_unfair_lock_lock(&_lock);
+  CheckIndex(self, 0, [_array count]);
+  [_array removeLastObject];
+  os_unfair_lock_unlock(&_lock);
+}
+
+- (void)replaceObjectAtIndex:(NSUInteger)idx withObject:(id)anObject {
+  CheckObject(self, anObject);
+  os_unfair_lock_lock(&_lock);
+  CheckIndex(self, idx, [_array count]);
+  [_array replaceObjectAtIndex:idx withObject:anObject];
+  os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark Extra things hooked
+
+- (instancetype)deepCopyWithZone:(NSZone *)zone {
+  VPKGPBLazyMessageArray *result =
+      [[VPKGPBLazyMessageArray allocWithZone:zone] initWithMessageClass:_messageClass
+                                                      extensionRegistry:_extensionRegistry];
+  NSArray *elements = [self copyElements];
+  for (id value in elements) {
+    if ([value isKindOfClass:[NSData class]]) {
+      // Immutable, so the copy can share it.
+      [result->_array addObject:value];
+    } else {
+      VPKGPBMessage *copiedMsg = [value copyWithZone:zone];
+      [result->_array addObject:copiedMsg];
+      [copiedMsg release];
+    }
+  }
+  [elements release];
+  return result;
+}
+
+// Returns the snapshot the write in progress on this thread sized the array
+// from, taking (and recording) one if it has not been sized yet. The write
+// must see the same elements it was sized with: an element another thread
+// decodes in the meantime may re-encode to a different length.
+- (NSArray *)copyElementsForWrite {
+  NSArray *result = [VPKGPBRecordedLazyElements(self) retain];
+  if (!result) {
+    result = [self copyElements];
+    VPKGPBRecordLazyElements(self, result);
+  }
+  return result;
+}
+
+- (size_t)computeSerializedSizeAsField:(VPKGPBFieldDescriptor *)field {
+  NSArray *elements = [self copyElementsForWrite];
+  size_t result = VPKGPBComputeTagSize((int32_t)VPKGPBFieldNumber(field)) * elements.count;
+  for (id value in elements) {
+    if ([value isKindOfClass:[NSData class]]) {
+      result += VPKGPBComputeBytesSizeNoTag(value);
+    } else {
+      result += VPKGPBComputeMessageSizeNoTag(value);
+    }
+  }
+  [elements release];
+  return result;
+}
+
+- (void)writeToCodedOutputStream:(VPKGPBCodedOutputStream *)outputStream
+                         asField:(VPKGPBFieldDescriptor *)field {
+  uint32_t fieldNumber = VPKGPBFieldNumber(field);
+  NSArray *elements = [self copyElementsForWrite];
+  @try {
+    for (id value in elements) {
+      if ([value isKindOfClass:[NSData class]]) {
+        // Untouched, so the original encoding is still exact.
+        [outputStream writeTag:fieldNumber format:VPKGPBWireFormatLengthDelimited];
+        [outputStream writeBytesNoTag:value];
+      } else {
+        [outputStream writeMessage:(int32_t)fieldNumber value:value];
+      }
+    }
+  } @finally {
+    [elements release];
+  }
+}
+
+@end
+
 #pragma clang diagnostic pop
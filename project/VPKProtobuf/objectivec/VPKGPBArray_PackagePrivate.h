@@ -30,7 +30,10 @@
 
 #import "VPKGPBArray.h"
 
+@class VPKGPBCodedOutputStream;
+@class VPKGPBFieldDescriptor;
 @class VPKGPBMessage;
+@protocol VPKGPBExtensionRegistry;
 
 //%PDDM-DEFINE DECLARE_ARRAY_EXTRAS()
 //%ARRAY_INTERFACE_EXTRAS(Int32, int32_t)
@@ -49,6 +52,9 @@
 //% @package
 //%  VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 //%}
+//%// The array's storage, for reading it in bulk. Only valid until the array is
+//%// next mutated.
+//%- (const TYPE *)internalValues;
 //%@end
 //%
 
@@ -61,6 +67,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const int32_t *)internalValues;
 @end
 
 #pragma mark - UInt32
@@ -69,6 +78,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const uint32_t *)internalValues;
 @end
 
 #pragma mark - Int64
@@ -77,6 +89,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const int64_t *)internalValues;
 @end
 
 #pragma mark - UInt64
@@ -85,6 +100,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const uint64_t *)internalValues;
 @end
 
 #pragma mark - Float
@@ -93,6 +111,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const float *)internalValues;
 @end
 
 #pragma mark - Double
@@ -101,6 +122,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const double *)internalValues;
 @end
 
 #pragma mark - Bool
@@ -109,6 +133,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const BOOL *)internalValues;
 @end
 
 #pragma mark - Enum
@@ -117,6 +144,9 @@
  @package
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
+// The array's storage, for reading it in bulk. Only valid until the array is
+// next mutated.
+- (const int32_t *)internalValues;
 @end
 
 //%PDDM-EXPAND-END DECLARE_ARRAY_EXTRAS()
@@ -128,3 +158,17 @@
   VPKGPB_UNSAFE_UNRETAINED VPKGPBMessage *_autocreator;
 }
 @end
+
+// Backs a repeated message field filled in by a parse that defers decoding.
+// Each element is held as its encoded bytes until it is first accessed, and
+// elements that were never accessed are written back out as those bytes.
+@interface VPKGPBLazyMessageArray : NSMutableArray
+- (instancetype)initWithMessageClass:(Class)messageClass
+                   extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry;
+// Appends an element that is decoded from |data| on first access.
+- (void)addMessageData:(NSData *)data;
+- (instancetype)deepCopyWithZone:(NSZone *)zone;
+- (size_t)computeSerializedSizeAsField:(VPKGPBFieldDescriptor *)field;
+- (void)writeToCodedOutputStream:(VPKGPBCodedOutputStream *)outputStream
+                         asField:(VPKGPBFieldDescriptor *)field;
+@end
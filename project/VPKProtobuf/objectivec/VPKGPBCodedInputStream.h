@@ -69,6 +69,8 @@ typedef NS_ENUM(NSInteger, VPKGPBCodedInputStreamErrorCode) {
   VPKGPBCodedInputStreamErrorInvalidVarInt = -105,
   /** The maximum recursion depth of messages was exceeded. */
   VPKGPBCodedInputStreamErrorRecursionDepthExceeded = -106,
+  /** Reading from the underlying NSInputStream or file descriptor failed. */
+  VPKGPBCodedInputStreamErrorReadFailed = -107,
 };
 
 CF_EXTERN_C_END
@@ -104,6 +106,55 @@ __attribute__((objc_subclassing_restricted))
  **/
 - (instancetype)initWithData:(NSData *)data;
 
+/**
+ * Creates a new stream that pulls its data from an NSInputStream.
+ *
+ * Only a window of the input is kept in memory; it is refilled as the parse
+ * advances, so decoding can start before the whole input is available.
+ *
+ * @param input The input stream to read from. If it is not open yet it is
+ *              opened, and then closed when the coded stream is deallocated;
+ *              a stream the caller already opened is left open.
+ *
+ * @return A newly instanced VPKGPBCodedInputStream.
+ **/
++ (instancetype)streamWithInputStream:(NSInputStream *)input;
+
+/**
+ * Initializes a stream that pulls its data from an NSInputStream, using the
+ * default window size.
+ *
+ * @param input The input stream to read from.
+ *
+ * @return A newly initialized VPKGPBCodedInputStream.
+ **/
+- (instancetype)initWithInputStream:(NSInputStream *)input;
+
+/**
+ * Initializes a stream that pulls its data from an NSInputStream.
+ *
+ * @note The window only grows past @c bufferSize when a single string, bytes
+ *       or other scalar value is larger than it; skipped fields never grow it.
+ *
+ * @param input      The input stream to read from.
+ * @param bufferSize The size of the window kept in memory.
+ *
+ * @return A newly initialized VPKGPBCodedInputStream.
+ **/
+- (instancetype)initWithInputStream:(NSInputStream *)input bufferSize:(size_t)bufferSize;
+
+/**
+ * Initializes a stream that reads(2) its data from a file descriptor.
+ *
+ * @note The descriptor is not closed by the stream.
+ *
+ * @param fileDescriptor The file descriptor to read from.
+ * @param bufferSize     The size of the window kept in memory.
+ *
+ * @return A newly initialized VPKGPBCodedInputStream.
+ **/
+- (instancetype)initWithFileDescriptor:(int)fileDescriptor bufferSize:(size_t)bufferSize;
+
 /**
  * Attempts to read a field tag, returning zero if we have reached EOF.
  * Protocol message parsers use this to read tags, since a protocol message
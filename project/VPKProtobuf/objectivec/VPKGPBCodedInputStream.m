@@ -30,6 +30,11 @@
 
 #import "VPKGPBCodedInputStream_PackagePrivate.h"
 
+#import <errno.h>
+#import <objc/runtime.h>
+#import <stdatomic.h>
+#import <unistd.h>
+
 #import "VPKGPBDictionary_PackagePrivate.h"
 #import "VPKGPBMessage_PackagePrivate.h"
 #import "VPKGPBUnknownFieldSet_PackagePrivate.h"
@@ -51,66 +56,198 @@ NSString *const VPKGPBCodedInputStreamErrorDomain =
 //  int CodedInputStream::default_recursion_limit_ = 100;
 static const NSUInteger kDefaultRecursionLimit = 100;
 
-static void RaiseException(NSInteger code, NSString *reason) {
+// Window size used by the NSInputStream/file descriptor initializers when the
+// caller doesn't pick one.
+static const size_t kDefaultStreamingBufferSize = 32 * 1024;
+
+static NSError *ErrorWithCode(NSInteger code, NSString *reason) {
   NSDictionary *errorInfo = nil;
   if ([reason length]) {
     errorInfo = @{VPKGPBErrorReasonKey : reason};
   }
-  NSError *error = [NSError errorWithDomain:VPKGPBCodedInputStreamErrorDomain
-                                       code:code
-                                   userInfo:errorInfo];
+  return [NSError errorWithDomain:VPKGPBCodedInputStreamErrorDomain
+                             code:code
+                         userInfo:errorInfo];
+}
 
+// Raises, or when the state records errors, keeps the first failure and
+// returns. Callers must then return a harmless value without consuming more.
+static void RaiseException(VPKGPBCodedInputStreamState *state, NSInteger code,
+                           NSString *reason) {
+  if (state->recordsErrors) {
+    if (state->status == 0) {
+      state->status = code;
+      state->statusReason = [reason copy];
+    }
+    return;
+  }
+
+  NSError *error = ErrorWithCode(code, reason);
   NSDictionary *exceptionInfo = @{VPKGPBCodedInputStreamUnderlyingErrorKey : error};
   [[NSException exceptionWithName:VPKGPBCodedInputStreamException reason:reason
                          userInfo:exceptionInfo] raise];
 }
 
-static void CheckRecursionLimit(VPKGPBCodedInputStreamState *state) {
+static BOOL CheckRecursionLimit(VPKGPBCodedInputStreamState *state) {
   if (state->recursionDepth >= kDefaultRecursionLimit) {
-    RaiseException(VPKGPBCodedInputStreamErrorRecursionDepthExceeded, nil);
+    RaiseException(state, VPKGPBCodedInputStreamErrorRecursionDepthExceeded, nil);
+    return NO;
   }
+  return YES;
 }
 
-static void CheckSize(VPKGPBCodedInputStreamState *state, size_t size) {
+// Reads up to |length| bytes from the streaming source. Returns 0 at the end
+// of the source and raises if the read fails.
+static size_t ReadFromSource(VPKGPBCodedInputStreamState *state, uint8_t *dest, size_t length) {
+  if (state->inputStream) {
+    NSInteger result = [state->inputStream read:dest maxLength:length];
+    if (result < 0) {
+      RaiseException(state, VPKGPBCodedInputStreamErrorReadFailed,
+                     [[state->inputStream streamError] localizedDescription]);
+      return 0;
+    }
+    return (size_t)result;
+  }
+  while (YES) {
+    ssize_t result = read(state->fileDescriptor, dest, length);
+    if (result >= 0) {
+      return (size_t)result;
+    }
+    if (errno != EINTR) {
+      RaiseException(state, VPKGPBCodedInputStreamErrorReadFailed, @(strerror(errno)));
+      return 0;
+    }
+  }
+}
+
+// Slides the unread bytes to the front of the window and reads from the
+// source until at least |size| bytes are available past bufferPos. Returns NO
+// if the source ended first (or the stream isn't streaming at all).
+static BOOL Refill(VPKGPBCodedInputStreamState *state, size_t size) {
+  if (state->window == NULL) {
+    return NO;
+  }
+  size_t unread = state->bufferSize - state->bufferPos;
+  if (state->bufferPos > state->bufferStart) {
+    memmove(state->window, state->window + (state->bufferPos - state->bufferStart), unread);
+    state->bufferStart = state->bufferPos;
+  }
+  while (unread < size && !state->sourceAtEnd) {
+    if (unread == state->windowCapacity) {
+      // A single value is larger than the window. Grow it as the bytes
+      // arrive so a bogus length on the wire can't force a huge allocation.
+      size_t newCapacity = state->windowCapacity * 2;
+      uint8_t *newWindow = realloc(state->window, newCapacity);
+      if (newWindow == NULL) {
+        RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSize, @"Unable to grow buffer.");
+        return NO;
+      }
+      state->window = newWindow;
+      state->bytes = newWindow;
+      state->windowCapacity = newCapacity;
+    }
+    size_t bytesRead =
+        ReadFromSource(state, state->window + unread, state->windowCapacity - unread);
+    if (bytesRead == 0) {
+      state->sourceAtEnd = YES;
+    }
+    unread += bytesRead;
+    state->bufferSize += bytesRead;
+  }
+  state->bytes = state->window;
+  return unread >= size;
+}
+
+// Pointer to the byte at bufferPos.
+static inline const uint8_t *CurrentBytes(VPKGPBCodedInputStreamState *state) {
+  return state->bytes + (state->bufferPos - state->bufferStart);
+}
+
+// Returns NO (when not raising) if |size| bytes can't be read.
+static BOOL CheckSize(VPKGPBCodedInputStreamState *state, size_t size) {
   size_t newSize = state->bufferPos + size;
   if (newSize > state->bufferSize) {
-    RaiseException(VPKGPBCodedInputStreamErrorInvalidSize, nil);
+    if (state->window == NULL) {
+      RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSize, nil);
+      return NO;
+    } else if (newSize <= state->currentLimit && !Refill(state, size)) {
+      // Bytes past the current limit are never pulled in, that case is
+      // reported as reaching the limit below.
+      RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSize, nil);
+      return NO;
+    }
   }
   if (newSize > state->currentLimit) {
     // Fast forward to end of currentLimit;
     state->bufferPos = state->currentLimit;
-    RaiseException(VPKGPBCodedInputStreamErrorSubsectionLimitReached, nil);
+    RaiseException(state, VPKGPBCodedInputStreamErrorSubsectionLimitReached, nil);
+    return NO;
   }
+  return YES;
 }
 
 static int8_t ReadRawByte(VPKGPBCodedInputStreamState *state) {
-  CheckSize(state, sizeof(int8_t));
-  return ((int8_t *)state->bytes)[state->bufferPos++];
+  if (!CheckSize(state, sizeof(int8_t))) {
+    return 0;
+  }
+  int8_t value = *(const int8_t *)CurrentBytes(state);
+  state->bufferPos++;
+  return value;
 }
 
 static int32_t ReadRawLittleEndian32(VPKGPBCodedInputStreamState *state) {
-  CheckSize(state, sizeof(int32_t));
+  if (!CheckSize(state, sizeof(int32_t))) {
+    return 0;
+  }
   // Not using OSReadLittleInt32 because it has undocumented dependency
   // on reads being aligned.
   int32_t value;
-  memcpy(&value, state->bytes + state->bufferPos, sizeof(int32_t));
+  memcpy(&value, CurrentBytes(state), sizeof(int32_t));
   value = OSSwapLittleToHostInt32(value);
   state->bufferPos += sizeof(int32_t);
   return value;
 }
 
 static int64_t ReadRawLittleEndian64(VPKGPBCodedInputStreamState *state) {
-  CheckSize(state, sizeof(int64_t));
+  if (!CheckSize(state, sizeof(int64_t))) {
+    return 0;
+  }
   // Not using OSReadLittleInt64 because it has undocumented dependency
   // on reads being aligned.
   int64_t value;
-  memcpy(&value, state->bytes + state->bufferPos, sizeof(int64_t));
+  memcpy(&value, CurrentBytes(state), sizeof(int64_t));
   value = OSSwapLittleToHostInt64(value);
   state->bufferPos += sizeof(int64_t);
   return value;
 }
 
-static int64_t ReadRawVarint64(VPKGPBCodedInputStreamState *state) {
+void VPKGPBCodedInputStreamReadRawLittleEndianArray(VPKGPBCodedInputStreamState *state,
+                                                    void *values, size_t count, size_t width) {
+  size_t length = count * width;
+  if (!CheckSize(state, length)) {
+    memset(values, 0, length);
+    return;
+  }
+  memcpy(values, CurrentBytes(state), length);
+  state->bufferPos += length;
+#if !(defined(__LITTLE_ENDIAN__) && __LITTLE_ENDIAN__)
+  uint8_t *bytes = values;
+  for (size_t i = 0; i < count; ++i, bytes += width) {
+    for (size_t j = 0; j < width / 2; ++j) {
+      uint8_t swap = bytes[j];
+      bytes[j] = bytes[width - 1 - j];
+      bytes[width - 1 - j] = swap;
+    }
+  }
+#endif
+}
+
+// The most bytes a varint can take on the wire.
+static const size_t kMaxVarintBytes = 10;
+
+// Byte by byte decode, bounds checking (and refilling) for each byte. Only
+// used when the end of the buffer or limit is within kMaxVarintBytes.
+static int64_t ReadRawVarint64Slow(VPKGPBCodedInputStreamState *state) {
   int32_t shift = 0;
   int64_t result = 0;
   while (shift < 64) {
@@ -121,7 +258,38 @@ static int64_t ReadRawVarint64(VPKGPBCodedInputStreamState *state) {
     }
     shift += 7;
   }
-  RaiseException(VPKGPBCodedInputStreamErrorInvalidVarInt, @"Invalid VarInt64");
+  RaiseException(state, VPKGPBCodedInputStreamErrorInvalidVarInt, @"Invalid VarInt64");
+  return 0;
+}
+
+static int64_t ReadRawVarint64(VPKGPBCodedInputStreamState *state) {
+  size_t end = MIN(state->bufferSize, state->currentLimit);
+  size_t available = (state->bufferPos < end) ? (end - state->bufferPos) : 0;
+  if (available == 0) {
+    return ReadRawVarint64Slow(state);
+  }
+  const uint8_t *ptr = CurrentBytes(state);
+  if (ptr[0] < 0x80) {
+    // Tags, lengths and most small values fit in a single byte.
+    state->bufferPos++;
+    return ptr[0];
+  }
+  if (available < kMaxVarintBytes) {
+    return ReadRawVarint64Slow(state);
+  }
+  // A whole varint is known to be readable, so decode straight from the
+  // buffer with a single bounds check.
+  uint64_t result = 0;
+  for (size_t i = 0; i < kMaxVarintBytes; ++i) {
+    uint8_t b = ptr[i];
+    result |= (uint64_t)(b & 0x7F) << (7 * i);
+    if (b < 0x80) {
+      state->bufferPos += i + 1;
+      return (int64_t)result;
+    }
+  }
+  state->bufferPos += kMaxVarintBytes;
+  RaiseException(state, VPKGPBCodedInputStreamErrorInvalidVarInt, @"Invalid VarInt64");
   return 0;
 }
 
@@ -130,8 +298,23 @@ static int32_t ReadRawVarint32(VPKGPBCodedInputStreamState *state) {
 }
 
 static void SkipRawData(VPKGPBCodedInputStreamState *state, size_t size) {
-  CheckSize(state, size);
-  state->bufferPos += size;
+  size_t newSize = state->bufferPos + size;
+  if (state->window != NULL && newSize > state->bufferSize && newSize <= state->currentLimit) {
+    // Streaming, discard whole windows instead of growing one to hold bytes
+    // that are about to be thrown away.
+    while (newSize > state->bufferSize) {
+      state->bufferPos = state->bufferSize;
+      if (!Refill(state, 1)) {
+        RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSize, nil);
+        return;
+      }
+    }
+    state->bufferPos = newSize;
+    return;
+  }
+  if (CheckSize(state, size)) {
+    state->bufferPos += size;
+  }
 }
 
 double VPKGPBCodedInputStreamReadDouble(VPKGPBCodedInputStreamState *state) {
@@ -212,26 +395,111 @@ int32_t VPKGPBCodedInputStreamReadTag(VPKGPBCodedInputStreamState *state) {
   state->lastTag = ReadRawVarint32(state);
   // Tags have to include a valid wireformat.
   if (!VPKGPBWireFormatIsValidTag(state->lastTag)) {
-    RaiseException(VPKGPBCodedInputStreamErrorInvalidTag, @"Invalid wireformat in tag.");
+    RaiseException(state, VPKGPBCodedInputStreamErrorInvalidTag, @"Invalid wireformat in tag.");
   }
   // Zero is not a valid field number.
   if (VPKGPBWireFormatGetTagFieldNumber(state->lastTag) == 0) {
-    RaiseException(VPKGPBCodedInputStreamErrorInvalidTag,
+    RaiseException(state, VPKGPBCodedInputStreamErrorInvalidTag,
                    @"A zero field number on the wire is invalid.");
   }
+  if (state->status != 0) {
+    // Recording errors, and the tag (or the data before it) was bad.
+    state->lastTag = 0;
+  }
   return state->lastTag;
 }
 
+// Strings shorter than this are left to NSString, which often stores them in
+// the pointer itself.
+static const size_t kUTF8StringMinimumLength = 16;
+
+// Returns YES if |bytes| are well formed UTF-8, as -[NSString
+// initWithBytes:length:encoding:] requires: no overlong forms, surrogates or
+// values past U+10FFFF.
+static BOOL IsValidUTF8(const uint8_t *bytes, size_t length) {
+  size_t i = 0;
+  while (i < length) {
+    // Skip ASCII a word at a time.
+    while (i + sizeof(uint64_t) <= length) {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      if (word & 0x8080808080808080ULL) {
+        break;
+      }
+      i += sizeof(word);
+    }
+    if (i == length) {
+      break;
+    }
+    uint8_t c = bytes[i];
+    if (c < 0x80) {
+      ++i;
+      continue;
+    }
+    size_t trailing;
+    uint32_t codePoint;
+    uint32_t minimum;
+    if ((c & 0xE0) == 0xC0) {
+      trailing = 1;
+      codePoint = c & 0x1F;
+      minimum = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+      trailing = 2;
+      codePoint = c & 0x0F;
+      minimum = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+      trailing = 3;
+      codePoint = c & 0x07;
+      minimum = 0x10000;
+    } else {
+      return NO;
+    }
+    if (length - i <= trailing) {
+      return NO;
+    }
+    for (size_t j = 1; j <= trailing; ++j) {
+      uint8_t next = bytes[i + j];
+      if ((next & 0xC0) != 0x80) {
+        return NO;
+      }
+      codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF ||
+        (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+      return NO;
+    }
+    i += trailing + 1;
+  }
+  return YES;
+}
+
+static BOOL ShouldKeepUTF8(const uint8_t *bytes, size_t length) {
+  if (length < kUTF8StringMinimumLength) {
+    return NO;
+  }
+  // NSString drops a leading byte order mark, so those strings would not
+  // write back out as the bytes they were read from.
+  return !(bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF);
+}
+
+static NSString *CreateUTF8String(const uint8_t *bytes, size_t length)
+    __attribute__((ns_returns_retained));
+
 NSString *VPKGPBCodedInputStreamReadRetainedString(VPKGPBCodedInputStreamState *state) {
   int32_t size = ReadRawVarint32(state);
   NSString *result;
   if (size == 0) {
     result = @"";
   } else {
-    CheckSize(state, size);
-    result = [[NSString alloc] initWithBytes:&state->bytes[state->bufferPos]
-                                      length:size
-                                    encoding:NSUTF8StringEncoding];
+    if (!CheckSize(state, size)) {
+      return @"";
+    }
+    const uint8_t *bytes = CurrentBytes(state);
+    if (ShouldKeepUTF8(bytes, size)) {
+      result = IsValidUTF8(bytes, size) ? CreateUTF8String(bytes, size) : nil;
+    } else {
+      result = [[NSString alloc] initWithBytes:bytes length:size encoding:NSUTF8StringEncoding];
+    }
     state->bufferPos += size;
     if (!result) {
 #ifdef DEBUG
@@ -239,7 +507,8 @@ NSString *VPKGPBCodedInputStreamReadRetainedString(VPKGPBCodedInputStreamState *
       NSLog(@"UTF-8 failure, is some field type 'string' when it should be "
             @"'bytes'?");
 #endif
-      RaiseException(VPKGPBCodedInputStreamErrorInvalidUTF8, nil);
+      RaiseException(state, VPKGPBCodedInputStreamErrorInvalidUTF8, nil);
+      result = @"";
     }
   }
   return result;
@@ -248,29 +517,59 @@ NSString *VPKGPBCodedInputStreamReadRetainedString(VPKGPBCodedInputStreamState *
 NSData *VPKGPBCodedInputStreamReadRetainedBytes(VPKGPBCodedInputStreamState *state) {
   int32_t size = ReadRawVarint32(state);
   if (size < 0) return nil;
-  CheckSize(state, size);
-  NSData *result = [[NSData alloc] initWithBytes:state->bytes + state->bufferPos length:size];
+  if (!CheckSize(state, size)) {
+    return [[NSData alloc] init];
+  }
+  NSData *result = [[NSData alloc] initWithBytes:CurrentBytes(state) length:size];
   state->bufferPos += size;
   return result;
 }
 
 NSData *VPKGPBCodedInputStreamReadRetainedBytesNoCopy(VPKGPBCodedInputStreamState *state) {
+  if (state->window != NULL) {
+    // The window is reused by the next refill, so nothing can alias it.
+    return VPKGPBCodedInputStreamReadRetainedBytes(state);
+  }
   int32_t size = ReadRawVarint32(state);
   if (size < 0) return nil;
-  CheckSize(state, size);
+  if (!CheckSize(state, size)) {
+    return [[NSData alloc] init];
+  }
   // Cast is safe because freeWhenDone is NO.
-  NSData *result = [[NSData alloc] initWithBytesNoCopy:(void *)(state->bytes + state->bufferPos)
+  NSData *result = [[NSData alloc] initWithBytesNoCopy:(void *)CurrentBytes(state)
                                                 length:size
                                           freeWhenDone:NO];
   state->bufferPos += size;
   return result;
 }
 
+NSData *VPKGPBCodedInputStreamReadRetainedFieldBytes(VPKGPBCodedInputStreamState *state) {
+  if (state->aliasedData == nil) {
+    return VPKGPBCodedInputStreamReadRetainedBytes(state);
+  }
+  return VPKGPBCodedInputStreamReadRetainedSlice(state, state->aliasedData);
+}
+
+NSData *VPKGPBCodedInputStreamReadRetainedSlice(VPKGPBCodedInputStreamState *state,
+                                                NSData *source) {
+  int32_t size = ReadRawVarint32(state);
+  if (size < 0) return nil;
+  if (size == 0 || !CheckSize(state, size)) {
+    return [[NSData alloc] init];
+  }
+  NSData *result = [[VPKGPBAliasedData alloc] initWithSource:source
+                                                       bytes:CurrentBytes(state)
+                                                      length:size];
+  state->bufferPos += size;
+  return result;
+}
+
 size_t VPKGPBCodedInputStreamPushLimit(VPKGPBCodedInputStreamState *state, size_t byteLimit) {
   byteLimit += state->bufferPos;
   size_t oldLimit = state->currentLimit;
   if (byteLimit > oldLimit) {
-    RaiseException(VPKGPBCodedInputStreamErrorInvalidSubsectionLimit, nil);
+    RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSubsectionLimit, nil);
+    return oldLimit;
   }
   state->currentLimit = byteLimit;
   return oldLimit;
@@ -281,19 +580,214 @@ void VPKGPBCodedInputStreamPopLimit(VPKGPBCodedInputStreamState *state, size_t o
 }
 
 size_t VPKGPBCodedInputStreamBytesUntilLimit(VPKGPBCodedInputStreamState *state) {
+  if (state->status != 0) {
+    return 0;
+  }
   return state->currentLimit - state->bufferPos;
 }
 
 BOOL VPKGPBCodedInputStreamIsAtEnd(VPKGPBCodedInputStreamState *state) {
-  return (state->bufferPos == state->bufferSize) || (state->bufferPos == state->currentLimit);
+  if (state->bufferPos == state->currentLimit || state->status != 0) {
+    return YES;
+  }
+  if (state->bufferPos == state->bufferSize) {
+    // Only the end if a streaming source has nothing more to give.
+    if (Refill(state, 1)) {
+      return NO;
+    }
+    if (state->currentLimit != SIZE_MAX) {
+      // The source ended inside a length delimited value, which a data
+      // backed stream would have rejected when the limit was pushed.
+      RaiseException(state, VPKGPBCodedInputStreamErrorInvalidSize, @"Truncated message.");
+    }
+    return YES;
+  }
+  return NO;
 }
 
 void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, int32_t value) {
   if (state->lastTag != value) {
-    RaiseException(VPKGPBCodedInputStreamErrorInvalidTag, @"Unexpected tag read");
+    RaiseException(state, VPKGPBCodedInputStreamErrorInvalidTag, @"Unexpected tag read");
   }
 }
 
+void VPKGPBCodedInputStreamReportError(VPKGPBCodedInputStreamState *state, NSInteger code,
+                                       NSString *reason) {
+  RaiseException(state, code, reason);
+}
+
+NSError *VPKGPBCodedInputStreamStatusError(VPKGPBCodedInputStreamState *state) {
+  if (state->status == 0) {
+    return nil;
+  }
+  return ErrorWithCode(state->status, state->statusReason);
+}
+
+static void ClearStatus(VPKGPBCodedInputStreamState *state) {
+  state->status = 0;
+  [state->statusReason release];
+  state->statusReason = nil;
+}
+
+BOOL VPKGPBCodedInputStreamBeginRecordingErrors(VPKGPBCodedInputStreamState *state) {
+  BOOL wasRecordingErrors = state->recordsErrors;
+  if (!wasRecordingErrors) {
+    ClearStatus(state);
+  }
+  state->recordsErrors = YES;
+  return wasRecordingErrors;
+}
+
+NSError *VPKGPBCodedInputStreamEndRecordingErrors(VPKGPBCodedInputStreamState *state,
+                                                  BOOL wasRecordingErrors) {
+  NSError *error = VPKGPBCodedInputStreamStatusError(state);
+  state->recordsErrors = wasRecordingErrors;
+  if (!wasRecordingErrors) {
+    ClearStatus(state);
+  }
+  return error;
+}
+
+@implementation VPKGPBAliasedData {
+  NSData *source_;
+  const void *bytes_;
+  NSUInteger length_;
+}
+
+- (instancetype)initWithSource:(NSData *)source bytes:(const void *)bytes length:(NSUInteger)length {
+  if ((self = [super init])) {
+    source_ = [source retain];
+    bytes_ = bytes;
+    length_ = length;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [source_ release];
+  [super dealloc];
+}
+
+- (const void *)bytes {
+  return bytes_;
+}
+
+- (NSUInteger)length {
+  return length_;
+}
+
+- (instancetype)copyWithZone:(__unused NSZone *)zone {
+  // Immutable.
+  return [self retain];
+}
+
+@end
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+@implementation VPKGPBUTF8String {
+ @package
+  // Made from the bytes on first use; see BackingString().
+  NSString *string_;
+  size_t utf8Length_;
+  // The object's indexed ivars: utf8Length_ bytes and a NUL.
+  const uint8_t *utf8Bytes_;
+}
+
+static NSString *CreateUTF8String(const uint8_t *bytes, size_t length) {
+  VPKGPBUTF8String *result = NSAllocateObject([VPKGPBUTF8String class], length + 1, NULL);
+  result = [result init];
+  uint8_t *storage = object_getIndexedIvars(result);
+  memcpy(storage, bytes, length);
+  storage[length] = 0;
+  result->utf8Bytes_ = storage;
+  result->utf8Length_ = length;
+  return result;
+}
+
+const uint8_t *VPKGPBStringCachedUTF8Bytes(NSString *string, size_t *length) {
+  if (object_getClass(string) != [VPKGPBUTF8String class]) {
+    return NULL;
+  }
+  VPKGPBUTF8String *utf8String = (VPKGPBUTF8String *)string;
+  *length = utf8String->utf8Length_;
+  return utf8String->utf8Bytes_;
+}
+
+// The bytes were validated when read, so this only fails if memory does.
+static NSString *BackingString(VPKGPBUTF8String *self) {
+  _Atomic(NSString *) *stringPtr = (_Atomic(NSString *) *)&self->string_;
+  NSString *string = atomic_load_explicit(stringPtr, memory_order_acquire);
+  if (string == nil) {
+    NSString *created = [[NSString alloc] initWithBytes:self->utf8Bytes_
+                                                 length:self->utf8Length_
+                                               encoding:NSUTF8StringEncoding];
+    NSString *expected = nil;
+    if (atomic_compare_exchange_strong(stringPtr, &expected, created)) {
+      string = created;
+    } else {
+      // Another thread got there first.
+      [created release];
+      string = expected;
+    }
+  }
+  return string;
+}
+
+- (void)dealloc {
+  [string_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)length {
+  return [BackingString(self) length];
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index {
+  return [BackingString(self) characterAtIndex:index];
+}
+
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range {
+  [BackingString(self) getCharacters:buffer range:range];
+}
+
+- (NSUInteger)lengthOfBytesUsingEncoding:(NSStringEncoding)encoding {
+  if (encoding == NSUTF8StringEncoding) {
+    return utf8Length_;
+  }
+  return [BackingString(self) lengthOfBytesUsingEncoding:encoding];
+}
+
+- (const char *)UTF8String {
+  return (const char *)utf8Bytes_;
+}
+
+- (BOOL)isEqual:(id)other {
+  if (self == other) {
+    return YES;
+  }
+  if (object_getClass(other) == [VPKGPBUTF8String class]) {
+    VPKGPBUTF8String *otherString = other;
+    return utf8Length_ == otherString->utf8Length_ &&
+           memcmp(utf8Bytes_, otherString->utf8Bytes_, utf8Length_) == 0;
+  }
+  return [BackingString(self) isEqual:other];
+}
+
+- (NSUInteger)hash {
+  return [BackingString(self) hash];
+}
+
+- (instancetype)copyWithZone:(__unused NSZone *)zone {
+  // Immutable.
+  return [self retain];
+}
+
+@end
+
+#pragma clang diagnostic pop
+
 @implementation VPKGPBCodedInputStream
 
 + (instancetype)streamWithData:(NSData *)data {
@@ -310,11 +804,65 @@ void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, i
     state_.bytes = (const uint8_t *)[data bytes];
     state_.bufferSize = [data length];
     state_.currentLimit = state_.bufferSize;
+    state_.fileDescriptor = -1;
+  }
+  return self;
+}
+
++ (instancetype)streamWithInputStream:(NSInputStream *)input {
+  return [[[self alloc] initWithInputStream:input] autorelease];
+}
+
+- (instancetype)initWithInputStream:(NSInputStream *)input {
+  return [self initWithInputStream:input bufferSize:kDefaultStreamingBufferSize];
+}
+
+- (instancetype)initWithInputStream:(NSInputStream *)input bufferSize:(size_t)bufferSize {
+  if ((self = [self initWithStreamingBufferSize:bufferSize])) {
+    state_.inputStream = [input retain];
+    if ([input streamStatus] == NSStreamStatusNotOpen) {
+      // Only a stream opened here is closed in dealloc, the caller keeps
+      // ownership of one it opened itself.
+      [input open];
+      state_.closesInputStream = YES;
+    }
+  }
+  return self;
+}
+
+- (instancetype)initWithFileDescriptor:(int)fileDescriptor bufferSize:(size_t)bufferSize {
+  if ((self = [self initWithStreamingBufferSize:bufferSize])) {
+    state_.fileDescriptor = fileDescriptor;
+  }
+  return self;
+}
+
+// Shared setup for the streaming initializers, the window starts out empty
+// and is filled by the first read.
+- (instancetype)initWithStreamingBufferSize:(size_t)bufferSize {
+  if ((self = [self initWithData:[NSData data]])) {
+    if (bufferSize == 0) {
+      bufferSize = kDefaultStreamingBufferSize;
+    }
+    state_.window = malloc(bufferSize);
+    if (state_.window == NULL) {
+      [self release];
+      return nil;
+    }
+    state_.windowCapacity = bufferSize;
+    state_.bytes = state_.window;
+    state_.currentLimit = SIZE_MAX;
   }
   return self;
 }
 
 - (void)dealloc {
+  if (state_.closesInputStream) {
+    [state_.inputStream close];
+  }
+  [state_.inputStream release];
+  free(state_.window);
+  [state_.statusReason release];
   [buffer_ release];
   [super dealloc];
 }
@@ -423,7 +971,9 @@ void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, i
 - (void)readGroup:(int32_t)fieldNumber
               message:(VPKGPBMessage *)message
     extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry {
-  CheckRecursionLimit(&state_);
+  if (!CheckRecursionLimit(&state_)) {
+    return;
+  }
   ++state_.recursionDepth;
   [message mergeFromCodedInputStream:self extensionRegistry:extensionRegistry];
   VPKGPBCodedInputStreamCheckLastTagWas(&state_,
@@ -432,7 +982,9 @@ void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, i
 }
 
 - (void)readUnknownGroup:(int32_t)fieldNumber message:(VPKGPBUnknownFieldSet *)message {
-  CheckRecursionLimit(&state_);
+  if (!CheckRecursionLimit(&state_)) {
+    return;
+  }
   ++state_.recursionDepth;
   [message mergeFromCodedInputStream:self];
   VPKGPBCodedInputStreamCheckLastTagWas(&state_,
@@ -442,7 +994,9 @@ void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, i
 
 - (void)readMessage:(VPKGPBMessage *)message
     extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry {
-  CheckRecursionLimit(&state_);
+  if (!CheckRecursionLimit(&state_)) {
+    return;
+  }
   int32_t length = ReadRawVarint32(&state_);
   size_t oldLimit = VPKGPBCodedInputStreamPushLimit(&state_, length);
   ++state_.recursionDepth;
@@ -456,7 +1010,9 @@ void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, i
     extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
                 field:(VPKGPBFieldDescriptor *)field
         parentMessage:(VPKGPBMessage *)parentMessage {
-  CheckRecursionLimit(&state_);
+  if (!CheckRecursionLimit(&state_)) {
+    return;
+  }
   int32_t length = ReadRawVarint32(&state_);
   size_t oldLimit = VPKGPBCodedInputStreamPushLimit(&state_, length);
   ++state_.recursionDepth;
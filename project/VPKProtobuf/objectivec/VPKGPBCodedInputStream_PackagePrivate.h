@@ -36,6 +36,22 @@
 
 @class VPKGPBUnknownFieldSet;
 @class VPKGPBFieldDescriptor;
+@class VPKGPBFieldSelection;
+
+// The bytes field values handed out by an aliasing parse: a range of the
+// input data, which it retains, instead of a copy of the bytes.
+@interface VPKGPBAliasedData : NSData
+@end
+
+// The strings handed out by a parse for all but the shortest values: the
+// UTF-8 bytes read off the wire, with the UTF-16 NSString made from them only
+// once something asks for characters. Writing one back out copies the bytes
+// as they are instead of measuring and transcoding the string again.
+@interface VPKGPBUTF8String : NSString
+@end
+
+// Defined in VPKGPBMessage.m.
+typedef struct VPKGPBMessageArena VPKGPBMessageArena;
 
 typedef struct VPKGPBCodedInputStreamState {
   const uint8_t *bytes;
@@ -49,6 +65,46 @@ typedef struct VPKGPBCodedInputStreamState {
   size_t currentLimit;
   int32_t lastTag;
   NSUInteger recursionDepth;
+
+  // Streaming support (-initWithInputStream:/-initWithFileDescriptor:). The
+  // |window| is refilled from the source on demand and |bytes| points at it.
+  // |bufferStart| is the stream offset of bytes[0]; bufferPos, bufferSize and
+  // currentLimit are always stream offsets, so limits survive refills. For
+  // streams over NSData, |window| is NULL and |bufferStart| is zero.
+  size_t bufferStart;
+  uint8_t *window;
+  size_t windowCapacity;
+  NSInputStream *inputStream;
+  BOOL closesInputStream;
+  int fileDescriptor;
+  BOOL sourceAtEnd;
+
+  // Exception-free parsing. While |recordsErrors| is set, malformed input does
+  // not raise; the first failure is kept in |status| (a
+  // VPKGPBCodedInputStreamErrorCode, zero while there is none) and
+  // |statusReason|. From then on reads return zero/empty values, tags read as
+  // zero and no bytes remain before any limit, so every parse loop unwinds
+  // normally. The status is sticky for the rest of that parse; see
+  // VPKGPBCodedInputStreamBeginRecordingErrors().
+  BOOL recordsErrors;
+  NSInteger status;
+  NSString *statusReason;
+
+  // When set, VPKGPBCodedInputStreamReadRetainedFieldBytes() returns ranges
+  // of this data (the stream's own, so not retained here) instead of copies.
+  // Only ever set for streams over NSData.
+  NSData *aliasedData;
+
+  // When set, repeated message fields are kept as ranges of this data (the
+  // stream's own, so not retained here) and only decoded when accessed.
+  NSData *deferredMessageSource;
+
+  // When set, the messages created while parsing are allocated from it.
+  VPKGPBMessageArena *arena;
+
+  // When set, only the fields it selects are decoded by the message being
+  // merged, the rest are skipped. Not retained.
+  VPKGPBFieldSelection *fieldSelection;
 } VPKGPBCodedInputStreamState;
 
 @interface VPKGPBCodedInputStream () {
@@ -92,12 +148,28 @@ int64_t VPKGPBCodedInputStreamReadSFixed64(VPKGPBCodedInputStreamState *state);
 int32_t VPKGPBCodedInputStreamReadSInt32(VPKGPBCodedInputStreamState *state);
 int64_t VPKGPBCodedInputStreamReadSInt64(VPKGPBCodedInputStreamState *state);
 BOOL VPKGPBCodedInputStreamReadBool(VPKGPBCodedInputStreamState *state);
+// Returns the UTF-8 bytes of |string| and sets |length| if it is a
+// VPKGPBUTF8String, otherwise returns NULL. The bytes are NUL terminated.
+const uint8_t *VPKGPBStringCachedUTF8Bytes(NSString *string, size_t *length);
+// Reads |count| little endian values of |width| bytes each into |values|, in
+// host byte order. Fails like the single value reads when the bytes run out.
+void VPKGPBCodedInputStreamReadRawLittleEndianArray(VPKGPBCodedInputStreamState *state,
+                                                    void *values, size_t count, size_t width);
 NSString *VPKGPBCodedInputStreamReadRetainedString(VPKGPBCodedInputStreamState *state)
     __attribute((ns_returns_retained));
 NSData *VPKGPBCodedInputStreamReadRetainedBytes(VPKGPBCodedInputStreamState *state)
     __attribute((ns_returns_retained));
 NSData *VPKGPBCodedInputStreamReadRetainedBytesNoCopy(VPKGPBCodedInputStreamState *state)
     __attribute((ns_returns_retained));
+// Reads a length delimited value as a range of |source|, which must be the
+// data the stream is reading, and which the result retains.
+NSData *VPKGPBCodedInputStreamReadRetainedSlice(VPKGPBCodedInputStreamState *state,
+                                                NSData *source)
+    __attribute((ns_returns_retained));
+// Reads the value of a message's bytes field, aliasing the input when the
+// state's aliasedData is set.
+NSData *VPKGPBCodedInputStreamReadRetainedFieldBytes(VPKGPBCodedInputStreamState *state)
+    __attribute((ns_returns_retained));
 
 size_t VPKGPBCodedInputStreamPushLimit(VPKGPBCodedInputStreamState *state, size_t byteLimit);
 void VPKGPBCodedInputStreamPopLimit(VPKGPBCodedInputStreamState *state, size_t oldLimit);
@@ -105,4 +177,27 @@ size_t VPKGPBCodedInputStreamBytesUntilLimit(VPKGPBCodedInputStreamState *state)
 BOOL VPKGPBCodedInputStreamIsAtEnd(VPKGPBCodedInputStreamState *state);
 void VPKGPBCodedInputStreamCheckLastTagWas(VPKGPBCodedInputStreamState *state, int32_t value);
 
+// Raises the VPKGPBCodedInputStreamException for |code|, or records it in the
+// state's status when recordsErrors is set.
+void VPKGPBCodedInputStreamReportError(VPKGPBCodedInputStreamState *state, NSInteger code,
+                                       NSString *reason);
+
+// The NSError for the status recorded while recordsErrors was set, or nil if
+// no error was recorded.
+NSError *VPKGPBCodedInputStreamStatusError(VPKGPBCodedInputStreamState *state);
+
+// Sets recordsErrors for one parse. Unless an enclosing parse is already
+// recording, any status left by an earlier failed parse is cleared first.
+// Returns the previous recordsErrors, to pass to
+// VPKGPBCodedInputStreamEndRecordingErrors().
+BOOL VPKGPBCodedInputStreamBeginRecordingErrors(VPKGPBCodedInputStreamState *state);
+
+// Ends a parse started with VPKGPBCodedInputStreamBeginRecordingErrors() and
+// returns the error it recorded, or nil. Unless an enclosing parse is still
+// recording, the status is then cleared and the stream raises again, so a
+// stream the caller supplied stays usable (from wherever the failed parse
+// stopped) with either API.
+NSError *VPKGPBCodedInputStreamEndRecordingErrors(VPKGPBCodedInputStreamState *state,
+                                                  BOOL wasRecordingErrors);
+
 CF_EXTERN_C_END
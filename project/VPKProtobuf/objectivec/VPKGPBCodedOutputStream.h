@@ -52,6 +52,19 @@ NS_ASSUME_NONNULL_BEGIN
 extern NSString *const VPKGPBCodedOutputStreamException_OutOfSpace;
 extern NSString *const VPKGPBCodedOutputStreamException_WriteFailed;
 
+/**
+ * A function a VPKGPBCodedOutputStream hands its buffered bytes to.
+ *
+ * @param context The context the stream was created with.
+ * @param bytes   The bytes to write.
+ * @param length  The number of bytes to write.
+ *
+ * @return YES once every byte has been written, or NO with errno set if they
+ *         could not be.
+ **/
+typedef BOOL (*VPKGPBCodedOutputStreamWriteFunction)(void *__nullable context, const void *bytes,
+                                                     size_t length);
+
 /**
  * Writes out protocol message fields.
  *
@@ -104,11 +117,144 @@ __attribute__((objc_subclassing_restricted))
  **/
 - (instancetype)initWithOutputStream:(NSOutputStream *)output;
 
+/**
+ * Initializes a stream to write into the given @c NSOutputStream through a
+ * buffer of the given size. A larger buffer means fewer, larger writes.
+ *
+ * @param output     The output stream where the stream will be written to.
+ * @param bufferSize The size of the buffer, or 0 for a default.
+ *
+ * @return A newly initialized VPKGPBCodedOutputStream.
+ **/
+- (instancetype)initWithOutputStream:(NSOutputStream *)output bufferSize:(NSUInteger)bufferSize;
+
+/**
+ * Creates a stream that writes to the given file descriptor.
+ *
+ * @param fd         The file descriptor where the stream will be written to.
+ * @param bufferSize The size of the buffer, or 0 for a default.
+ *
+ * @return A newly instanced VPKGPBCodedOutputStream.
+ **/
++ (instancetype)streamWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize;
+
+/**
+ * Initializes a stream that writes to the given file descriptor with write(2)
+ * each time its buffer of the given size fills, without going through an
+ * @c NSOutputStream. The descriptor is not closed by the stream.
+ *
+ * @param fd         The file descriptor where the stream will be written to.
+ * @param bufferSize The size of the buffer, or 0 for a default.
+ *
+ * @return A newly initialized VPKGPBCodedOutputStream.
+ **/
+- (instancetype)initWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize;
+
+/**
+ * Initializes a stream that hands its output to the given function each time
+ * its buffer of the given size fills, and on -flush. A failed write raises
+ * VPKGPBCodedOutputStreamException_WriteFailed with errno's description as
+ * the reason.
+ *
+ * @param writeFunction The function to write the output with.
+ * @param context       Passed to writeFunction on every call.
+ * @param bufferSize    The size of the buffer, or 0 for a default.
+ *
+ * @return A newly initialized VPKGPBCodedOutputStream.
+ **/
+- (instancetype)initWithWriteFunction:(VPKGPBCodedOutputStreamWriteFunction)writeFunction
+                              context:(nullable void *)context
+                           bufferSize:(NSUInteger)bufferSize;
+
+/**
+ * Creates a stream that writes into memory, growing its buffer as needed
+ * instead of raising when out of space. Collect what was written with
+ * -takeWrittenData.
+ *
+ * @param capacity The initial size of the buffer, or 0 for a default.
+ *
+ * @return A newly instanced VPKGPBCodedOutputStream.
+ **/
++ (instancetype)growableStreamWithCapacity:(NSUInteger)capacity;
+
+/**
+ * Initializes a stream that writes into memory, growing its buffer as needed
+ * instead of raising when out of space. Nothing has to be sized before it is
+ * written, so many messages can be batched into one buffer without a
+ * serializedSize pass for each. Collect what was written with
+ * -takeWrittenData.
+ *
+ * @param capacity The initial size of the buffer, or 0 for a default.
+ *
+ * @return A newly initialized VPKGPBCodedOutputStream.
+ **/
+- (instancetype)initGrowableWithCapacity:(NSUInteger)capacity;
+
+/**
+ * Creates a stream that collects its output as a list of segments.
+ *
+ * @param threshold The smallest bytes or string payload to reference rather
+ *                  than copy, or 0 for a default.
+ *
+ * @return A newly instanced VPKGPBCodedOutputStream.
+ **/
++ (instancetype)segmentedStreamWithReferenceThreshold:(NSUInteger)threshold;
+
+/**
+ * Initializes a stream that collects its output as a list of segments instead
+ * of one contiguous buffer. Small fields are gathered into buffer sized
+ * segments as usual, but bytes fields and strings of at least threshold bytes
+ * become segments of their own that refer to the value's storage, so large
+ * payloads are never copied. Collect the segments with -takeWrittenSegments,
+ * or write them out with -writeSegmentsToFileDescriptor:.
+ *
+ * @param threshold The smallest bytes or string payload to reference rather
+ *                  than copy, or 0 for a default.
+ *
+ * @return A newly initialized VPKGPBCodedOutputStream.
+ **/
+- (instancetype)initSegmentedWithReferenceThreshold:(NSUInteger)threshold;
+
 /**
  * Flush any buffered data out.
  **/
 - (void)flush;
 
+/**
+ * Returns everything written to a growable stream since it was created or
+ * since the last call, without copying it, and starts the stream over with an
+ * empty buffer.
+ *
+ * @note Raises NSInternalInconsistencyException if the stream was not created
+ *       as growable.
+ *
+ * @return The bytes written, exactly as long as what was written.
+ **/
+- (NSData *)takeWrittenData;
+
+/**
+ * Returns everything written to a segmented stream since it was created or
+ * since the last call, and starts the stream over with no segments. The
+ * segments keep the values they refer to alive.
+ *
+ * @note Raises NSInternalInconsistencyException if the stream was not created
+ *       as segmented.
+ *
+ * @return The bytes written, in order.
+ **/
+- (dispatch_data_t)takeWrittenSegments;
+
+/**
+ * Takes the written segments as -takeWrittenSegments does and writes them to
+ * the given file descriptor with writev, without first joining them into one
+ * buffer.
+ *
+ * @note Raises VPKGPBCodedOutputStreamException_WriteFailed if the write fails.
+ *
+ * @param fd The file descriptor to write to.
+ **/
+- (void)writeSegmentsToFileDescriptor:(int)fd;
+
 /**
  * Write the raw byte out.
  *
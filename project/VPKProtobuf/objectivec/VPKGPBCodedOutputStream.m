@@ -30,9 +30,15 @@
 
 #import "VPKGPBCodedOutputStream_PackagePrivate.h"
 
+#import <errno.h>
+#import <limits.h>
 #import <mach/vm_param.h>
+#import <sys/uio.h>
+#import <unistd.h>
 
-#import "VPKGPBArray.h"
+#import "VPKGPBArray_PackagePrivate.h"
+#import "VPKGPBCodedInputStream_PackagePrivate.h"
+#import "VPKGPBMessage_PackagePrivate.h"
 #import "VPKGPBUnknownFieldSet_PackagePrivate.h"
 #import "VPKGPBUtilities_PackagePrivate.h"
 
@@ -49,32 +55,151 @@ typedef struct VPKGPBOutputBufferState {
   size_t size;
   size_t position;
   NSOutputStream *output;
+  // Only set for a growable stream; the buffer that grows instead of running
+  // out of space. Not retained, it is also the stream's buffer_.
+  NSMutableData *growableData;
+  // Only set for a segmented stream; what has been written so far, less what
+  // is still in the buffer.
+  dispatch_data_t segments;
+  // Only set for a stream writing through a C function (which includes one
+  // writing to a file descriptor); used in place of |output|.
+  VPKGPBCodedOutputStreamWriteFunction writeFunction;
+  void *writeContext;
 } VPKGPBOutputBufferState;
 
 @implementation VPKGPBCodedOutputStream {
   VPKGPBOutputBufferState state_;
   NSMutableData *buffer_;
+  // Bytes payloads and strings at least this long are referenced by a
+  // segmented stream rather than copied.
+  NSUInteger segmentReferenceThreshold_;
 }
 
 static const int32_t LITTLE_ENDIAN_32_SIZE = sizeof(uint32_t);
 static const int32_t LITTLE_ENDIAN_64_SIZE = sizeof(uint64_t);
 
+// Makes room for at least |count| more bytes in a growable stream's buffer.
+// The buffer at least doubles each time, so writing n bytes one at a time
+// moves each of them O(1) times on average.
+static void VPKGPBGrowBuffer(VPKGPBOutputBufferState *state, size_t count) {
+  size_t size = state->size ? state->size : PAGE_SIZE;
+  while (size - state->position < count) {
+    size *= 2;
+  }
+  [state->growableData setLength:size];
+  state->bytes = [state->growableData mutableBytes];
+  state->size = size;
+}
+
+static void VPKGPBAppendSegment(VPKGPBOutputBufferState *state, dispatch_data_t segment) {
+  dispatch_data_t segments = dispatch_data_create_concat(state->segments, segment);
+  dispatch_release(state->segments);
+  state->segments = segments;
+}
+
+// Hands |length| bytes to the stream's sink. Raises on failure.
+static void VPKGPBWriteToSink(VPKGPBOutputBufferState *state, const uint8_t *bytes,
+                              size_t length) {
+  if (state->writeFunction != NULL) {
+    if (!state->writeFunction(state->writeContext, bytes, length)) {
+      [NSException raise:VPKGPBCodedOutputStreamException_WriteFailed
+                  format:@"%s", strerror(errno)];
+    }
+    return;
+  }
+  NSInteger written = [state->output write:bytes maxLength:length];
+  if (written != (NSInteger)length) {
+    [NSException raise:VPKGPBCodedOutputStreamException_WriteFailed format:@""];
+  }
+}
+
+// The VPKGPBCodedOutputStreamWriteFunction behind -initWithFileDescriptor:.
+static BOOL VPKGPBWriteToFileDescriptor(void *context, const void *bytes, size_t length) {
+  int fd = (int)(intptr_t)context;
+  while (length > 0) {
+    ssize_t written = write(fd, bytes, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return NO;
+    }
+    bytes = (const uint8_t *)bytes + written;
+    length -= (size_t)written;
+  }
+  return YES;
+}
+
 // Internal helper that writes the current buffer to the output. The
 // buffer position is reset to its initial value when this returns.
 static void VPKGPBRefreshBuffer(VPKGPBOutputBufferState *state) {
-  if (state->output == nil) {
+  if (state->segments != NULL) {
+    // The buffer is small; copying it out lets it be reused, while the large
+    // payloads between buffers are the ones added by reference.
+    if (state->position != 0) {
+      dispatch_data_t segment = dispatch_data_create(state->bytes, state->position, NULL,
+                                                     DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+      VPKGPBAppendSegment(state, segment);
+      dispatch_release(segment);
+      state->position = 0;
+    }
+    return;
+  }
+  if (state->growableData != nil) {
+    // Nothing to hand off; the data written so far stays at the front.
+    if (state->position == state->size) {
+      VPKGPBGrowBuffer(state, 1);
+    }
+    return;
+  }
+  if (state->output == nil && state->writeFunction == NULL) {
     // We're writing to a single buffer.
     [NSException raise:VPKGPBCodedOutputStreamException_OutOfSpace format:@""];
   }
   if (state->position != 0) {
-    NSInteger written = [state->output write:state->bytes maxLength:state->position];
-    if (written != (NSInteger)state->position) {
-      [NSException raise:VPKGPBCodedOutputStreamException_WriteFailed format:@""];
-    }
+    VPKGPBWriteToSink(state, state->bytes, state->position);
     state->position = 0;
   }
 }
 
+// Ends the buffered segment and adds |length| bytes at |bytes| as a segment of
+// their own without copying them. |owner| keeps them alive and is released
+// once the segments no longer refer to them.
+static void VPKGPBAppendReferencedSegment(VPKGPBOutputBufferState *state, const void *bytes,
+                                          size_t length, id owner) {
+  VPKGPBRefreshBuffer(state);
+  dispatch_data_t segment = dispatch_data_create(bytes, length, NULL, ^{
+    [owner release];
+  });
+  VPKGPBAppendSegment(state, segment);
+  dispatch_release(segment);
+}
+
+// Writes every byte described by |iov|, across several writev calls if the
+// descriptor takes less at a time. Raises on failure.
+static void VPKGPBWriteVectorFully(int fd, struct iovec *iov, size_t count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, (int)MIN(count, (size_t)IOV_MAX));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      [NSException raise:VPKGPBCodedOutputStreamException_WriteFailed
+                  format:@"writev failed: %s", strerror(errno)];
+    }
+    // Drop the entries written in full and trim a partly written one.
+    while (count > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + written;
+      iov->iov_len -= (size_t)written;
+    }
+  }
+}
+
 static void VPKGPBWriteRawByte(VPKGPBOutputBufferState *state, uint8_t value) {
   if (state->position == state->size) {
     VPKGPBRefreshBuffer(state);
@@ -145,11 +270,159 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
   VPKGPBWriteRawByte(state, (int32_t)(value >> 56) & 0xFF);
 }
 
+// Copies |length| bytes into the buffer, handing it off (or growing it) as it
+// fills.
+static void VPKGPBWriteRawBytes(VPKGPBOutputBufferState *state, const uint8_t *bytes,
+                                size_t length) {
+  while (length > 0) {
+    if (state->position == state->size) {
+      VPKGPBRefreshBuffer(state);
+    }
+    size_t chunk = MIN(length, state->size - state->position);
+    memcpy(state->bytes + state->position, bytes, chunk);
+    state->position += chunk;
+    bytes += chunk;
+    length -= chunk;
+  }
+}
+
+// The packed array writers below work on an array's storage directly instead
+// of enumerating it through blocks and -write*NoTag: calls.
+
+// Fixed width values are laid out on the wire exactly as they are in memory
+// on a little endian host, so the whole array is copied over at once.
+static void VPKGPBWritePackedFixedWidth(VPKGPBOutputBufferState *state, const void *values,
+                                        size_t count, size_t width) {
+  size_t length = count * width;
+  VPKGPBWriteRawVarint32(state, (int32_t)length);
+#if defined(__LITTLE_ENDIAN__) && __LITTLE_ENDIAN__
+  VPKGPBWriteRawBytes(state, values, length);
+#else
+  const uint8_t *bytes = values;
+  for (size_t i = 0; i < count; ++i, bytes += width) {
+    for (size_t j = width; j > 0; --j) {
+      VPKGPBWriteRawByte(state, bytes[j - 1]);
+    }
+  }
+#endif
+}
+
+// The size of a varint from the position of its highest set bit, without
+// branches so the loops summing it over a whole array vectorize.
+static inline size_t VPKGPBVarintSize(uint64_t value) {
+  return (size_t)((64 - __builtin_clzll(value | 1)) * 9 + 64) / 64;
+}
+
+static inline uint8_t *VPKGPBEncodeVarint(uint8_t *ptr, uint64_t value) {
+  while (value >= 0x80) {
+    *ptr++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *ptr++ = (uint8_t)value;
+  return ptr;
+}
+
+// The most bytes a varint can take on the wire.
+#define kMaxVarintBytes 10
+
+// Defines VPKGPBWritePacked##NAME for a varint type. The total length is summed
+// in one pass, then values are encoded straight into the buffer as long as the
+// space left is sure to hold them, without a bounds check per byte.
+#define VPKGPB_DEFINE_PACKED_VARINT_WRITER(NAME, TYPE, TO_UINT64)                       \
+  static void VPKGPBWritePacked##NAME(VPKGPBOutputBufferState *state, const TYPE *values, \
+                                      size_t count) {                                   \
+    size_t length = 0;                                                                  \
+    for (size_t i = 0; i < count; ++i) {                                                \
+      length += VPKGPBVarintSize(TO_UINT64(values[i]));                                 \
+    }                                                                                   \
+    VPKGPBWriteRawVarint32(state, (int32_t)length);                                     \
+    size_t i = 0;                                                                       \
+    while (i < count) {                                                                 \
+      size_t room = (state->size - state->position) / kMaxVarintBytes;                  \
+      if (room == 0) {                                                                  \
+        VPKGPBWriteRawVarint64(state, (int64_t)TO_UINT64(values[i++]));                 \
+        continue;                                                                       \
+      }                                                                                 \
+      size_t end = MIN(count, i + room);                                                \
+      uint8_t *ptr = state->bytes + state->position;                                    \
+      for (; i < end; ++i) {                                                            \
+        ptr = VPKGPBEncodeVarint(ptr, TO_UINT64(values[i]));                            \
+      }                                                                                 \
+      state->position = (size_t)(ptr - state->bytes);                                   \
+    }                                                                                   \
+  }
+
+// Negative int32 values are sign extended to ten bytes, as
+// VPKGPBWriteInt32NoTag() does.
+#define VPKGPBVarintFromInt32(x) ((uint64_t)(int64_t)(x))
+#define VPKGPBVarintFromUnsigned(x) ((uint64_t)(x))
+#define VPKGPBVarintFromInt64(x) ((uint64_t)(x))
+
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(Int32, int32_t, VPKGPBVarintFromInt32)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(Enum, int32_t, VPKGPBVarintFromInt32)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(UInt32, uint32_t, VPKGPBVarintFromUnsigned)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(Int64, int64_t, VPKGPBVarintFromInt64)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(UInt64, uint64_t, VPKGPBVarintFromUnsigned)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(SInt32, int32_t, VPKGPBEncodeZigZag32)
+VPKGPB_DEFINE_PACKED_VARINT_WRITER(SInt64, int64_t, VPKGPBEncodeZigZag64)
+
+#undef VPKGPBVarintFromInt32
+#undef VPKGPBVarintFromUnsigned
+#undef VPKGPBVarintFromInt64
+#undef VPKGPB_DEFINE_PACKED_VARINT_WRITER
+
+static void VPKGPBWritePackedBool(VPKGPBOutputBufferState *state, const BOOL *values,
+                                  size_t count) {
+  VPKGPBWriteRawVarint32(state, (int32_t)count);
+  for (size_t i = 0; i < count; ++i) {
+    VPKGPBWriteRawByte(state, (values[i] ? 1 : 0));
+  }
+}
+
+static void VPKGPBWritePackedFixed32(VPKGPBOutputBufferState *state, const uint32_t *values,
+                                     size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(uint32_t));
+}
+
+static void VPKGPBWritePackedSFixed32(VPKGPBOutputBufferState *state, const int32_t *values,
+                                      size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(int32_t));
+}
+
+static void VPKGPBWritePackedFloat(VPKGPBOutputBufferState *state, const float *values,
+                                   size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(float));
+}
+
+static void VPKGPBWritePackedFixed64(VPKGPBOutputBufferState *state, const uint64_t *values,
+                                     size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(uint64_t));
+}
+
+static void VPKGPBWritePackedSFixed64(VPKGPBOutputBufferState *state, const int64_t *values,
+                                      size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(int64_t));
+}
+
+static void VPKGPBWritePackedDouble(VPKGPBOutputBufferState *state, const double *values,
+                                    size_t count) {
+  VPKGPBWritePackedFixedWidth(state, values, count, sizeof(double));
+}
+
 - (void)dealloc {
-  [self flush];
+  @try {
+    [self flush];
+  } @catch (NSException *exception) {
+    // A sink that failed keeps the unwritten bytes buffered and fails again
+    // here; that was reported by the write that first failed, and there is
+    // no caller left to raise to.
+  }
   [state_.output close];
   [state_.output release];
   [buffer_ release];
+  if (state_.segments) {
+    dispatch_release(state_.segments);
+  }
 
   [super dealloc];
 }
@@ -163,6 +436,32 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
   return [self initWithOutputStream:nil data:data];
 }
 
+- (instancetype)initWithOutputStream:(NSOutputStream *)output bufferSize:(NSUInteger)bufferSize {
+  NSMutableData *data = [NSMutableData dataWithLength:(bufferSize ? bufferSize : PAGE_SIZE)];
+  return [self initWithOutputStream:output data:data];
+}
+
+- (instancetype)initWithWriteFunction:(VPKGPBCodedOutputStreamWriteFunction)writeFunction
+                              context:(void *)context
+                           bufferSize:(NSUInteger)bufferSize {
+  NSMutableData *data = [NSMutableData dataWithLength:(bufferSize ? bufferSize : PAGE_SIZE)];
+  if ((self = [self initWithOutputStream:nil data:data])) {
+    state_.writeFunction = writeFunction;
+    state_.writeContext = context;
+  }
+  return self;
+}
+
+- (instancetype)initWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize {
+  return [self initWithWriteFunction:VPKGPBWriteToFileDescriptor
+                             context:(void *)(intptr_t)fd
+                          bufferSize:bufferSize];
+}
+
++ (instancetype)streamWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize {
+  return [[[self alloc] initWithFileDescriptor:fd bufferSize:bufferSize] autorelease];
+}
+
 // This initializer isn't exposed, but it is the designated initializer.
 // Setting OutputStream and NSData is to control the buffering behavior/size
 // of the work, but that is more obvious via the bufferSize: version.
@@ -186,6 +485,32 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
   return [[[self alloc] initWithData:data] autorelease];
 }
 
+- (instancetype)initGrowableWithCapacity:(NSUInteger)capacity {
+  NSMutableData *data = [NSMutableData dataWithLength:(capacity ? capacity : PAGE_SIZE)];
+  if ((self = [self initWithOutputStream:nil data:data])) {
+    state_.growableData = buffer_;
+  }
+  return self;
+}
+
++ (instancetype)growableStreamWithCapacity:(NSUInteger)capacity {
+  return [[[self alloc] initGrowableWithCapacity:capacity] autorelease];
+}
+
+- (instancetype)initSegmentedWithReferenceThreshold:(NSUInteger)threshold {
+  NSMutableData *data = [NSMutableData dataWithLength:PAGE_SIZE];
+  if ((self = [self initWithOutputStream:nil data:data])) {
+    state_.segments = dispatch_data_empty;
+    dispatch_retain(state_.segments);
+    segmentReferenceThreshold_ = threshold ? threshold : PAGE_SIZE;
+  }
+  return self;
+}
+
++ (instancetype)segmentedStreamWithReferenceThreshold:(NSUInteger)threshold {
+  return [[[self alloc] initSegmentedWithReferenceThreshold:threshold] autorelease];
+}
+
 // Direct access is use for speed, to avoid even internally declaring things
 // read/write, etc. The warning is enabled in the project to ensure code calling
 // protos can turn on -Wdirect-ivar-access without issues.
@@ -265,7 +590,20 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
 }
 
 - (void)writeStringNoTag:(const NSString *)value {
-  size_t length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+  size_t length = 0;
+  const uint8_t *utf8Bytes = VPKGPBStringCachedUTF8Bytes((NSString *)value, &length);
+  if (utf8Bytes != NULL) {
+    // A string from a parse: its bytes go out as they came in.
+    VPKGPBWriteRawVarint32(&state_, (int32_t)length);
+    if (state_.segments != NULL && length >= segmentReferenceThreshold_) {
+      VPKGPBAppendReferencedSegment(&state_, utf8Bytes, length, [value retain]);
+    } else {
+      [self writeRawPtr:utf8Bytes offset:0 length:length];
+    }
+    return;
+  }
+
+  length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
   VPKGPBWriteRawVarint32(&state_, (int32_t)length);
   if (length == 0) {
     return;
@@ -273,6 +611,23 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
 
   const char *quickString = CFStringGetCStringPtr((CFStringRef)value, kCFStringEncodingUTF8);
 
+  if (state_.segments != NULL && length >= segmentReferenceThreshold_ && quickString != NULL) {
+    // The copy of an immutable string is the string itself; a mutable one is
+    // snapshotted so later edits can't reach the output.
+    NSString *owner = [value copy];
+    const char *ownerString = CFStringGetCStringPtr((CFStringRef)owner, kCFStringEncodingUTF8);
+    if (ownerString != NULL) {
+      VPKGPBAppendReferencedSegment(&state_, ownerString, length, owner);
+      return;
+    }
+    [owner release];
+  }
+
+  if (state_.growableData != nil && state_.size - state_.position < length) {
+    // Make the room so the string is transcoded straight into the buffer.
+    VPKGPBGrowBuffer(&state_, length);
+  }
+
   // Fast path: Most strings are short, if the buffer already has space,
   // add to it directly.
   NSUInteger bufferBytesLeft = state_.size - state_.position;
@@ -335,8 +690,17 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
 }
 
 - (void)writeMessageNoTag:(VPKGPBMessage *)value {
-  VPKGPBWriteRawVarint32(&state_, (int32_t)[value serializedSize]);
-  [value writeToCodedOutputStream:self];
+  // Sizing |value| records the size of everything below it, so the nested
+  // writes reuse those instead of each resizing its own subtree.
+  BOOL startedRecording = VPKGPBBeginRecordingMessageSizes();
+  @try {
+    VPKGPBWriteRawVarint32(&state_, (int32_t)VPKGPBRecordedMessageSize(value));
+    [value writeToCodedOutputStream:self];
+  } @finally {
+    if (startedRecording) {
+      VPKGPBEndRecordingMessageSizes();
+    }
+  }
 }
 
 - (void)writeMessage:(int32_t)fieldNumber value:(VPKGPBMessage *)value {
@@ -414,16 +778,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
 //%       NAME$S     values:(VPKGPB##ARRAY_TYPE##Array *)values
 //%       NAME$S        tag:(uint32_t)tag {
 //%  if (tag != 0) {
-//%    if (values.count == 0) return;
-//%    __block size_t dataSize = 0;
-//%    [values enumerate##ACCESSOR_NAME##ValuesWithBlock:^(TYPE value, __unused NSUInteger idx,__unused  BOOL *stop) {
-//%      dataSize += VPKGPBCompute##NAME##SizeNoTag(value);
-//%    }];
+//%    NSUInteger count = values.count;
+//%    if (count == 0) return;
 //%    VPKGPBWriteRawVarint32(&state_, tag);
-//%    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-//%    [values enumerate##ACCESSOR_NAME##ValuesWithBlock:^(TYPE value, __unused NSUInteger idx, __unused BOOL *stop) {
-//%      [self write##NAME##NoTag:value];
-//%    }];
+//%    VPKGPBWritePacked##NAME(&state_, [values internalValues], count);
 //%  } else {
 //%    [values enumerate##ACCESSOR_NAME##ValuesWithBlock:^(TYPE value, __unused NSUInteger idx, __unused BOOL *stop) {
 //%      [self write##NAME:fieldNumber value:value];
@@ -445,16 +803,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                   values:(VPKGPBDoubleArray *)values
                      tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(double value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeDoubleSizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(double value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeDoubleNoTag:value];
-    }];
+    VPKGPBWritePackedDouble(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(double value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeDouble:fieldNumber value:value];
@@ -469,16 +821,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                  values:(VPKGPBFloatArray *)values
                     tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(float value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeFloatSizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(float value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeFloatNoTag:value];
-    }];
+    VPKGPBWritePackedFloat(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(float value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeFloat:fieldNumber value:value];
@@ -493,16 +839,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                   values:(VPKGPBUInt64Array *)values
                      tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeUInt64SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeUInt64NoTag:value];
-    }];
+    VPKGPBWritePackedUInt64(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeUInt64:fieldNumber value:value];
@@ -517,16 +857,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                  values:(VPKGPBInt64Array *)values
                     tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeInt64SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeInt64NoTag:value];
-    }];
+    VPKGPBWritePackedInt64(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeInt64:fieldNumber value:value];
@@ -541,16 +875,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                  values:(VPKGPBInt32Array *)values
                     tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeInt32SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeInt32NoTag:value];
-    }];
+    VPKGPBWritePackedInt32(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeInt32:fieldNumber value:value];
@@ -565,16 +893,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                   values:(VPKGPBUInt32Array *)values
                      tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeUInt32SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeUInt32NoTag:value];
-    }];
+    VPKGPBWritePackedUInt32(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeUInt32:fieldNumber value:value];
@@ -589,16 +911,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                    values:(VPKGPBUInt64Array *)values
                       tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeFixed64SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeFixed64NoTag:value];
-    }];
+    VPKGPBWritePackedFixed64(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(uint64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeFixed64:fieldNumber value:value];
@@ -613,16 +929,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                    values:(VPKGPBUInt32Array *)values
                       tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeFixed32SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeFixed32NoTag:value];
-    }];
+    VPKGPBWritePackedFixed32(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(uint32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeFixed32:fieldNumber value:value];
@@ -637,16 +947,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                   values:(VPKGPBInt32Array *)values
                      tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeSInt32SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeSInt32NoTag:value];
-    }];
+    VPKGPBWritePackedSInt32(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeSInt32:fieldNumber value:value];
@@ -661,16 +965,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                   values:(VPKGPBInt64Array *)values
                      tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeSInt64SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeSInt64NoTag:value];
-    }];
+    VPKGPBWritePackedSInt64(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeSInt64:fieldNumber value:value];
@@ -685,16 +983,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                     values:(VPKGPBInt64Array *)values
                        tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeSFixed64SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeSFixed64NoTag:value];
-    }];
+    VPKGPBWritePackedSFixed64(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int64_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeSFixed64:fieldNumber value:value];
@@ -709,16 +1001,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                     values:(VPKGPBInt32Array *)values
                        tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeSFixed32SizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeSFixed32NoTag:value];
-    }];
+    VPKGPBWritePackedSFixed32(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeSFixed32:fieldNumber value:value];
@@ -733,16 +1019,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                 values:(VPKGPBBoolArray *)values
                    tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateValuesWithBlock:^(BOOL value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeBoolSizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateValuesWithBlock:^(BOOL value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeBoolNoTag:value];
-    }];
+    VPKGPBWritePackedBool(&state_, [values internalValues], count);
   } else {
     [values enumerateValuesWithBlock:^(BOOL value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeBool:fieldNumber value:value];
@@ -757,16 +1037,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
                 values:(VPKGPBEnumArray *)values
                    tag:(uint32_t)tag {
   if (tag != 0) {
-    if (values.count == 0) return;
-    __block size_t dataSize = 0;
-    [values enumerateRawValuesWithBlock:^(int32_t value, __unused NSUInteger idx,__unused  BOOL *stop) {
-      dataSize += VPKGPBComputeEnumSizeNoTag(value);
-    }];
+    NSUInteger count = values.count;
+    if (count == 0) return;
     VPKGPBWriteRawVarint32(&state_, tag);
-    VPKGPBWriteRawVarint32(&state_, (int32_t)dataSize);
-    [values enumerateRawValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
-      [self writeEnumNoTag:value];
-    }];
+    VPKGPBWritePackedEnum(&state_, [values internalValues], count);
   } else {
     [values enumerateRawValuesWithBlock:^(int32_t value, __unused NSUInteger idx, __unused BOOL *stop) {
       [self writeEnum:fieldNumber value:value];
@@ -838,17 +1112,82 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
 }
 
 - (void)flush {
-  if (state_.output != nil) {
+  if (state_.output != nil || state_.segments != NULL || state_.writeFunction != NULL) {
     VPKGPBRefreshBuffer(&state_);
   }
 }
 
+- (NSData *)takeWrittenData {
+  if (state_.growableData == nil) {
+    [NSException raise:NSInternalInconsistencyException
+                format:@"-takeWrittenData is only supported by growable streams."];
+  }
+  // Trimming the buffer to what was written hands it over without copying;
+  // the stream carries on with a fresh buffer of the same capacity.
+  NSMutableData *data = buffer_;
+  size_t capacity = state_.size;
+  [data setLength:state_.position];
+  buffer_ = [[NSMutableData alloc] initWithLength:capacity];
+  state_.growableData = buffer_;
+  state_.bytes = [buffer_ mutableBytes];
+  state_.position = 0;
+  return [data autorelease];
+}
+
+- (dispatch_data_t)takeWrittenSegments {
+  if (state_.segments == NULL) {
+    [NSException raise:NSInternalInconsistencyException
+                format:@"-takeWrittenSegments is only supported by segmented streams."];
+  }
+  VPKGPBRefreshBuffer(&state_);
+  dispatch_data_t segments = state_.segments;
+  state_.segments = dispatch_data_empty;
+  dispatch_retain(state_.segments);
+  return [segments autorelease];
+}
+
+- (void)writeSegmentsToFileDescriptor:(int)fd {
+  dispatch_data_t segments = [self takeWrittenSegments];
+  __block size_t count = 0;
+  dispatch_data_apply(segments, ^bool(__unused dispatch_data_t region, __unused size_t offset,
+                                      __unused const void *buffer, __unused size_t size) {
+    ++count;
+    return true;
+  });
+  if (count == 0) {
+    return;
+  }
+  struct iovec *iov = malloc(count * sizeof(struct iovec));
+  if (!iov) {
+    [NSException raise:NSMallocException format:@"Failed to allocate %zu iovecs", count];
+  }
+  __block size_t idx = 0;
+  dispatch_data_apply(segments, ^bool(__unused dispatch_data_t region, __unused size_t offset,
+                                      const void *buffer, size_t size) {
+    iov[idx].iov_base = (void *)buffer;
+    iov[idx].iov_len = size;
+    ++idx;
+    return true;
+  });
+  @try {
+    VPKGPBWriteVectorFully(fd, iov, count);
+  } @finally {
+    free(iov);
+  }
+}
+
 - (void)writeRawByte:(uint8_t)value {
   VPKGPBWriteRawByte(&state_, value);
 }
 
 - (void)writeRawData:(const NSData *)data {
-  [self writeRawPtr:[data bytes] offset:0 length:[data length]];
+  size_t length = [data length];
+  if (state_.segments != NULL && length >= segmentReferenceThreshold_) {
+    NSData *owner = [data copy];
+    VPKGPBAppendReferencedSegment(&state_, [owner bytes], length, owner);
+    return;
+  }
+  [self writeRawPtr:[data bytes] offset:0 length:length];
 }
 
 - (void)writeRawPtr:(const void *)value offset:(size_t)offset length:(size_t)length {
@@ -856,6 +1195,10 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
     return;
   }
 
+  if (state_.growableData != nil && state_.size - state_.position < length) {
+    VPKGPBGrowBuffer(&state_, length);
+  }
+
   NSUInteger bufferLength = state_.size;
   NSUInteger bufferBytesLeft = bufferLength - state_.position;
   if (bufferBytesLeft >= length) {
@@ -880,12 +1223,16 @@ static void VPKGPBWriteRawLittleEndian64(VPKGPBOutputBufferState *state, int64_t
       // Fits in new buffer.
       memcpy(state_.bytes, ((uint8_t *)value) + offset, length);
       state_.position = length;
+    } else if (state_.segments != NULL) {
+      // Too big for the buffer and not owned by anything that could keep it
+      // alive, so it has to be copied.
+      dispatch_data_t segment = dispatch_data_create(((uint8_t *)value) + offset, length, NULL,
+                                                     DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+      VPKGPBAppendSegment(&state_, segment);
+      dispatch_release(segment);
     } else {
       // Write is very big.  Let's do it all at once.
-      NSInteger written = [state_.output write:((uint8_t *)value) + offset maxLength:length];
-      if (written != (NSInteger)length) {
-        [NSException raise:VPKGPBCodedOutputStreamException_WriteFailed format:@""];
-      }
+      VPKGPBWriteToSink(&state_, ((uint8_t *)value) + offset, length);
     }
   }
 }
@@ -947,7 +1294,10 @@ size_t VPKGPBComputeFixed32SizeNoTag(__unused uint32_t value) { return LITTLE_EN
 size_t VPKGPBComputeBoolSizeNoTag(__unused BOOL value) { return 1; }
 
 size_t VPKGPBComputeStringSizeNoTag(NSString *value) {
-  NSUInteger length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+  size_t length = 0;
+  if (VPKGPBStringCachedUTF8Bytes(value, &length) == NULL) {
+    length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+  }
   return VPKGPBComputeRawVarint32SizeForInteger(length) + length;
 }
 
@@ -318,6 +318,59 @@ static NSArray *NewFieldsArrayForHasIndex(int hasIndex, NSArray *allMessageField
                                  flags:flags];
 }
 
+static int CompareFieldsByNumber(const void *a, const void *b) {
+  uint32_t numberA = VPKGPBFieldNumber(*(VPKGPBFieldDescriptor *const *)a);
+  uint32_t numberB = VPKGPBFieldNumber(*(VPKGPBFieldDescriptor *const *)b);
+  return (numberA < numberB) ? -1 : ((numberA > numberB) ? 1 : 0);
+}
+
+// Builds the lookup used by VPKGPBDescriptorFieldWithNumber(). Field numbers
+// are usually small and close together, so a table indexed by number covers
+// nearly every message; the dense range is capped relative to the field count
+// so a few large numbers can't blow up its size, and anything past it goes in
+// a sorted array for binary search.
+static void SetupFieldNumberLookup(VPKGPBDescriptor *self) {
+  NSArray *fields = self->fields_;
+  uint32_t fieldCount = (uint32_t)fields.count;
+  if (fieldCount == 0) {
+    return;
+  }
+  const uint32_t denseLimit = 4 * fieldCount + 16;
+  uint32_t denseCount = 0;
+  uint32_t sparseCount = 0;
+  for (VPKGPBFieldDescriptor *field in fields) {
+    uint32_t number = VPKGPBFieldNumber(field);
+    if (number < denseLimit) {
+      if (number >= denseCount) {
+        denseCount = number + 1;
+      }
+    } else {
+      ++sparseCount;
+    }
+  }
+  if (denseCount) {
+    self->denseFields_ = calloc(denseCount, sizeof(VPKGPBFieldDescriptor *));
+    self->denseFieldsCount_ = denseCount;
+  }
+  if (sparseCount) {
+    self->sparseFields_ = malloc(sparseCount * sizeof(VPKGPBFieldDescriptor *));
+    self->sparseFieldsCount_ = sparseCount;
+  }
+  uint32_t sparseIndex = 0;
+  for (VPKGPBFieldDescriptor *field in fields) {
+    uint32_t number = VPKGPBFieldNumber(field);
+    if (number < denseLimit) {
+      self->denseFields_[number] = field;
+    } else {
+      self->sparseFields_[sparseIndex++] = field;
+    }
+  }
+  if (sparseCount > 1) {
+    qsort(self->sparseFields_, sparseCount, sizeof(VPKGPBFieldDescriptor *),
+          CompareFieldsByNumber);
+  }
+}
+
 - (instancetype)initWithClass:(Class)messageClass
                   messageName:(NSString *)messageName
               fileDescription:(VPKGPBFileDescription *)fileDescription
@@ -331,6 +384,7 @@ static NSArray *NewFieldsArrayForHasIndex(int hasIndex, NSArray *allMessageField
     fields_ = [fields retain];
     storageSize_ = storageSize;
     wireFormat_ = wireFormat;
+    SetupFieldNumberLookup(self);
   }
   return self;
 }
@@ -339,6 +393,8 @@ static NSArray *NewFieldsArrayForHasIndex(int hasIndex, NSArray *allMessageField
   [messageName_ release];
   [fields_ release];
   [oneofs_ release];
+  free(denseFields_);
+  free(sparseFields_);
   [super dealloc];
 }
 
@@ -513,12 +569,7 @@ static NSArray *NewFieldsArrayForHasIndex(int hasIndex, NSArray *allMessageField
 }
 
 - (VPKGPBFieldDescriptor *)fieldWithNumber:(uint32_t)fieldNumber {
-  for (VPKGPBFieldDescriptor *descriptor in fields_) {
-    if (VPKGPBFieldNumber(descriptor) == fieldNumber) {
-      return descriptor;
-    }
-  }
-  return nil;
+  return VPKGPBDescriptorFieldWithNumber(self, fieldNumber);
 }
 
 - (VPKGPBFieldDescriptor *)fieldWithName:(NSString *)name {
@@ -680,6 +731,28 @@ uint32_t VPKGPBFieldAlternateTag(VPKGPBFieldDescriptor *self) {
   return VPKGPBWireFormatMakeTag(description->number, format);
 }
 
+VPKGPBFieldDescriptor *VPKGPBDescriptorFieldWithNumber(VPKGPBDescriptor *descriptor,
+                                                       uint32_t fieldNumber) {
+  if (fieldNumber < descriptor->denseFieldsCount_) {
+    return descriptor->denseFields_[fieldNumber];
+  }
+  VPKGPBFieldDescriptor **sparseFields = descriptor->sparseFields_;
+  uint32_t low = 0;
+  uint32_t high = descriptor->sparseFieldsCount_;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    uint32_t midNumber = VPKGPBFieldNumber(sparseFields[mid]);
+    if (midNumber == fieldNumber) {
+      return sparseFields[mid];
+    } else if (midNumber < fieldNumber) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return nil;
+}
+
 @implementation VPKGPBFieldDescriptor {
   VPKGPBGenericValue defaultValue_;
 
@@ -207,6 +207,15 @@ typedef NS_OPTIONS(uint32_t, VPKGPBDescriptorInitializationFlags) {
   NSArray *fields_;
   NSArray *oneofs_;
   uint32_t storageSize_;
+
+  // Field number -> field lookup used when parsing. Numbers below
+  // denseFieldsCount_ index straight into denseFields_ (NULL where there is no
+  // such field); any larger numbers are kept in sparseFields_, sorted by
+  // number. Neither retains the fields, fields_ does.
+  VPKGPBFieldDescriptor **denseFields_;
+  VPKGPBFieldDescriptor **sparseFields_;
+  uint32_t denseFieldsCount_;
+  uint32_t sparseFieldsCount_;
 }
 
 // fieldDescriptions and fileDescription have to be long lived, they are held as raw pointers.
@@ -375,6 +384,11 @@ uint32_t VPKGPBFieldTag(VPKGPBFieldDescriptor *self);
 // would be the wire type for packed.
 uint32_t VPKGPBFieldAlternateTag(VPKGPBFieldDescriptor *self);
 
+// Returns the field of |descriptor| with the given number, or nil if there is
+// none. Constant time for all but unusually sparse field numbers.
+VPKGPBFieldDescriptor *VPKGPBDescriptorFieldWithNumber(VPKGPBDescriptor *descriptor,
+                                                       uint32_t fieldNumber);
+
 VPKGPB_INLINE BOOL VPKGPBExtensionIsRepeated(VPKGPBExtensionDescription *description) {
   return (description->options & VPKGPBExtensionRepeated) != 0;
 }
@@ -38,6 +38,7 @@
 @class VPKGPBCodedOutputStream;
 @class VPKGPBExtensionDescriptor;
 @class VPKGPBFieldDescriptor;
+@class VPKGPBFieldMask;
 @class VPKGPBUnknownFieldSet;
 
 NS_ASSUME_NONNULL_BEGIN
@@ -148,6 +149,167 @@ CF_EXTERN_C_END
                      extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
                                  error:(NSError **)errorPtr;
 
+/**
+ * Creates a new instance by parsing the data without copying the contents of
+ * bytes fields. Each bytes field of the message and its submessages is a
+ * range of the data that keeps the data alive, instead of a copy of it, so
+ * large bytes fields (embedded images, etc.) cost nothing to parse. Other
+ * than that, this behaves like parseFromData:extensionRegistry:error:.
+ *
+ * @note The data is copied once up front if it is mutable.
+ *
+ * @note Holding on to any of the bytes fields keeps all of the data in
+ *       memory. Call VPKGPBMessageDetachAliasedBytesRecursively() to replace
+ *       them with copies so the data can be freed.
+ *
+ * @param data              The data to parse.
+ * @param extensionRegistry The extension registry to use to look up extensions.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the data can not be parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseFromAliasedData:(NSData *)data
+                            extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                                        error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing only the fields named by the field mask.
+ * Every other field is skipped over on the wire without being decoded, so
+ * nothing is allocated for it, and it is not kept as an unknown field either.
+ *
+ * Each path in the mask is a dot separated list of field names, such as
+ * "header.title", where each name but the last is a message field. Naming a
+ * repeated message field in the middle of a path selects within each of its
+ * elements. Extensions can not be named and are always skipped.
+ *
+ * @note Required fields are not checked since the result is partial by design.
+ *
+ * @param data      The data to parse.
+ * @param fieldMask The fields to parse.
+ * @param errorPtr  An optional error pointer to fill in with a failure reason
+ *                  if the data can not be parsed or a path in the mask does
+ *                  not name a field.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseFromData:(NSData *)data
+                             fieldMask:(VPKGPBFieldMask *)fieldMask
+                                 error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing the data, decoding the elements of the
+ * message's repeated message fields on several threads. A first pass only
+ * finds where each element is, using the length prefixes, then the elements
+ * are decoded in parallel on the global concurrent queue. The result is the
+ * same as that of parseFromData:extensionRegistry:error:, with every element
+ * in order, so this suits messages made mostly of many repeated elements.
+ *
+ * @note Only the fields of this message are split up; the fields of its
+ *       submessages are decoded by whichever thread decodes the submessage.
+ *
+ * @param data              The data to parse.
+ * @param extensionRegistry The extension registry to use to look up extensions.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the data can not be parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseConcurrentlyFromData:(NSData *)data
+                                 extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                                             error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing the data, allocating the message and all
+ * the submessages created by the parse from a shared arena. This replaces one
+ * allocation per message with one per large block, and the blocks are all
+ * freed together, which makes parsing and releasing large messages cheaper.
+ * Other than that, this behaves like parseFromData:extensionRegistry:error:.
+ *
+ * @note The arena is freed once the last of its messages is deallocated, so
+ *       holding on to any one of them keeps all of their memory allocated.
+ *
+ * @note Strings, bytes, arrays, maps and extension values are allocated as
+ *       usual.
+ *
+ * @param data              The data to parse.
+ * @param extensionRegistry The extension registry to use to look up extensions.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the data can not be parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseFromDataUsingArena:(NSData *)data
+                               extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                                           error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing the file at the given path. The file is
+ * memory mapped; see parseFromFileAtPath:extensionRegistry:error:.
+ *
+ * @param path     The path of the file to parse.
+ * @param errorPtr An optional error pointer to fill in with a failure reason if
+ *                 the file can not be read or parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseFromFileAtPath:(NSString *)path error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing the file at the given path. The file is
+ * memory mapped rather than read, and the message's bytes fields refer into
+ * the mapping as with parseFromAliasedData:extensionRegistry:error:, so only
+ * the pages the parse and the caller touch are read from disk.
+ *
+ * @note The file must not be truncated or modified while the mapping is
+ *       alive, that is while the message holds on to any bytes field.
+ *
+ * @param path              The path of the file to parse.
+ * @param extensionRegistry The extension registry to use to look up extensions.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the file can not be read or parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseFromFileAtPath:(NSString *)path
+                           extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                                       error:(NSError **)errorPtr;
+
+/**
+ * Creates a new instance by parsing the data, deferring the decoding of the
+ * elements of repeated message fields. The parse only records where each
+ * element's bytes are; an element is decoded the first time it is accessed
+ * through the field's array, and elements that are never accessed are written
+ * back out as their original bytes when the message is serialized. This
+ * suits data where only a few of many elements are looked at.
+ *
+ * @note The data is copied once up front if it is mutable, and stays in
+ *       memory while any of the deferred elements does.
+ *
+ * @note Only the framing of deferred elements is checked by the parse, so it
+ *       can report success for data whose elements are malformed. Such an
+ *       element raises VPKGPBCodedInputStreamException from the array
+ *       accessor that first decodes it (-objectAtIndex:, subscripting,
+ *       enumeration and the like) instead of returning an error. Use
+ *       +parseFromData:extensionRegistry:error: when every element must be
+ *       checked up front.
+ *
+ * @note The arrays holding deferred elements can be read and mutated from
+ *       several threads at once; the rest of the message has the usual,
+ *       non thread safe, behavior.
+ *
+ * @param data              The data to parse.
+ * @param extensionRegistry The extension registry to use to look up extensions,
+ *                          also used when decoding the deferred elements.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the data can not be parsed.
+ *
+ * @return A new instance of the generated class.
+ **/
++ (nullable instancetype)parseLazilyFromData:(NSData *)data
+                           extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                                       error:(NSError **)errorPtr;
+
 /**
  * Creates a new instance by parsing the data from the given input stream. This
  * method should be sent to the generated message class that the data should
@@ -278,6 +440,25 @@ CF_EXTERN_C_END
 - (void)mergeFromData:(NSData *)data
     extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry;
 
+/**
+ * Parses the file at the given path as this message's class, and merges those
+ * values into this message. The file is memory mapped as with
+ * parseFromFileAtPath:extensionRegistry:error:.
+ *
+ * @note If the file can not be parsed, the values parsed before the failure
+ *       have already been merged.
+ *
+ * @param path              The path of the file to merge.
+ * @param extensionRegistry The extension registry to use to look up extensions.
+ * @param errorPtr          An optional error pointer to fill in with a failure
+ *                          reason if the file can not be read or parsed.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)mergeFromFileAtPath:(NSString *)path
+          extensionRegistry:(nullable id<VPKGPBExtensionRegistry>)extensionRegistry
+                      error:(NSError **)errorPtr;
+
 /**
  * Merges the fields from another message (of the same type) into this
  * message.
@@ -42,6 +42,7 @@
 #import "VPKGPBDictionary_PackagePrivate.h"
 #import "VPKGPBExtensionInternals.h"
 #import "VPKGPBExtensionRegistry.h"
+#import "VPKGPBFieldMask.pbobjc.h"
 #import "VPKGPBRootObject_PackagePrivate.h"
 #import "VPKGPBUnknownFieldSet_PackagePrivate.h"
 #import "VPKGPBUtilities_PackagePrivate.h"
@@ -95,9 +96,125 @@ static NSString *const kVPKGPBDataCoderKey = @"VPKGPBData";
   //   https://developer.apple.com/library/archive/documentation/Performance/Conceptual/EnergyGuide-iOS/PrioritizeWorkWithQoS.html
   //   https://developer.apple.com/videos/play/wwdc2017/706/
   os_unfair_lock readOnlyLock_;
+
+  // Set when the message was allocated from an arena, which it then holds a
+  // reference on.
+  VPKGPBMessageArena *arena_;
+
+  // Submessages kept by VPKGPBMessageClearForReuse() for the next parse to
+  // fill in, NSMutableArrays keyed by field number.
+  NSMutableDictionary *spareMessages_;
 }
 @end
 
+#pragma mark - Arena
+
+// A parse using an arena carves the messages it creates out of large zeroed
+// blocks instead of giving each one its own allocation. Every message holds a
+// reference on the arena and all the blocks are freed in one go once the last
+// of them is deallocated, so a message outliving its root stays valid (and
+// keeps the whole arena alive).
+typedef struct VPKGPBMessageArenaBlock {
+  struct VPKGPBMessageArenaBlock *next;
+} VPKGPBMessageArenaBlock;
+
+struct VPKGPBMessageArena {
+  atomic_size_t refCount;
+  VPKGPBMessageArenaBlock *blocks;
+  uint8_t *cursor;
+  size_t remaining;
+};
+
+static const size_t kMessageArenaBlockSize = 64 * 1024;
+// Matches malloc's alignment, which the runtime expects of objects.
+static const size_t kMessageArenaAlignment = 16;
+// The block header is padded so the objects after it stay aligned.
+static const size_t kMessageArenaBlockHeaderSize =
+    (sizeof(VPKGPBMessageArenaBlock) + kMessageArenaAlignment - 1) & ~(kMessageArenaAlignment - 1);
+
+static VPKGPBMessageArena *MessageArenaCreate(void) {
+  VPKGPBMessageArena *arena = calloc(1, sizeof(VPKGPBMessageArena));
+  if (!arena) {
+    [NSException raise:NSMallocException format:@"Failed to allocate a message arena."];
+  }
+  atomic_init(&arena->refCount, 1);
+  return arena;
+}
+
+static void MessageArenaRelease(VPKGPBMessageArena *arena) {
+  if (atomic_fetch_sub(&arena->refCount, 1) != 1) {
+    return;
+  }
+  VPKGPBMessageArenaBlock *block = arena->blocks;
+  while (block) {
+    VPKGPBMessageArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  free(arena);
+}
+
+// Returns |size| zeroed bytes. Only called from the thread doing the parse.
+static void *MessageArenaAllocate(VPKGPBMessageArena *arena, size_t size) {
+  size = (size + kMessageArenaAlignment - 1) & ~(kMessageArenaAlignment - 1);
+  if (size > arena->remaining) {
+    // Anything too big for a regular block gets one of its own.
+    size_t blockSize = MAX(kMessageArenaBlockSize, kMessageArenaBlockHeaderSize + size);
+    VPKGPBMessageArenaBlock *block = calloc(1, blockSize);
+    if (!block) {
+      [NSException raise:NSMallocException format:@"Failed to grow a message arena."];
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->cursor = (uint8_t *)block + kMessageArenaBlockHeaderSize;
+    arena->remaining = blockSize - kMessageArenaBlockHeaderSize;
+  }
+  void *result = arena->cursor;
+  arena->cursor += size;
+  arena->remaining -= size;
+  return result;
+}
+
+// Returns a new message of |msgClass| for a field being parsed from |state|,
+// allocated from the state's arena if it has one.
+static VPKGPBMessage *CreateMessageForParse(Class msgClass, VPKGPBCodedInputStreamState *state)
+    __attribute__((ns_returns_retained));
+static VPKGPBMessage *CreateMessageForParse(Class msgClass, VPKGPBCodedInputStreamState *state) {
+  VPKGPBMessageArena *arena = state->arena;
+  if (!arena) {
+    return [[msgClass alloc] init];
+  }
+  // Same layout as +allocWithZone:, the storage follows the object.
+  VPKGPBDescriptor *descriptor = [msgClass descriptor];
+  size_t size = class_getInstanceSize(msgClass) + descriptor->storageSize_;
+  VPKGPBMessage *message =
+      objc_constructInstance(msgClass, MessageArenaAllocate(arena, size));
+  atomic_fetch_add(&arena->refCount, 1);
+  message->arena_ = arena;
+  return [message init];
+}
+
+// Returns a message for |field| of |self| being parsed from |state|, reusing
+// one kept by VPKGPBMessageClearForReuse() when there is one.
+static VPKGPBMessage *TakeOrCreateMessageForParse(VPKGPBMessage *self,
+                                                  VPKGPBFieldDescriptor *field,
+                                                  VPKGPBCodedInputStreamState *state)
+    __attribute__((ns_returns_retained));
+static VPKGPBMessage *TakeOrCreateMessageForParse(VPKGPBMessage *self,
+                                                  VPKGPBFieldDescriptor *field,
+                                                  VPKGPBCodedInputStreamState *state) {
+  if (self->spareMessages_) {
+    NSMutableArray *spares = self->spareMessages_[@(VPKGPBFieldNumber(field))];
+    NSUInteger count = spares.count;
+    if (count) {
+      VPKGPBMessage *message = [spares[count - 1] retain];
+      [spares removeLastObject];
+      return message;
+    }
+  }
+  return CreateMessageForParse(field.msgClass, state);
+}
+
 static id CreateArrayForField(VPKGPBFieldDescriptor *field, VPKGPBMessage *autocreator)
     __attribute__((ns_returns_retained));
 static id GetOrCreateArrayIvarWithField(VPKGPBMessage *self, VPKGPBFieldDescriptor *field);
@@ -110,11 +227,9 @@ static NSMutableDictionary *CloneExtensionMap(NSDictionary *extensionMap, NSZone
     __attribute__((ns_returns_retained));
 static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self);
 
-#ifdef DEBUG
 static NSError *MessageError(NSInteger code, NSDictionary *userInfo) {
   return [NSError errorWithDomain:VPKGPBMessageErrorDomain code:code userInfo:userInfo];
 }
-#endif
 
 static NSError *ErrorFromException(NSException *exception) {
   NSError *error = nil;
@@ -138,6 +253,285 @@ static NSError *ErrorFromException(NSException *exception) {
   return error;
 }
 
+// Merges |input| into |self| with the stream recording malformed input in its
+// state instead of raising, so rejecting bad data costs no exception unwind.
+// Returns the error for the first failure, or nil.
+static NSError *MergeFromCodedInputStreamRecordingErrors(
+    VPKGPBMessage *self, VPKGPBCodedInputStream *input,
+    id<VPKGPBExtensionRegistry> extensionRegistry, BOOL checkAtEnd) {
+  VPKGPBCodedInputStreamState *state = &input->state_;
+  BOOL wasRecordingErrors = VPKGPBCodedInputStreamBeginRecordingErrors(state);
+  NSError *error = nil;
+  @try {
+    [self mergeFromCodedInputStream:input extensionRegistry:extensionRegistry];
+    if (checkAtEnd) {
+      VPKGPBCodedInputStreamCheckLastTagWas(state, 0);
+    }
+  } @finally {
+    error = VPKGPBCodedInputStreamEndRecordingErrors(state, wasRecordingErrors);
+  }
+  return error;
+}
+
+#pragma mark - Concurrent Parse
+
+// The elements of a repeated message field are decoded in runs of this many
+// per worker, which keeps the per task overhead small next to the decoding.
+static const NSUInteger kConcurrentParseChunkSize = 64;
+
+// Splits the top level of |source| into the elements of |descriptor|'s repeated
+// message fields, collected per field in |fields| and |elementsPerField|, and
+// the encoding of every other field, appended to |rest|. The elements are
+// NSData pointing into |source| without retaining it. Returns the error for
+// the first failure, or nil.
+static NSError *SplitRepeatedMessageFields(VPKGPBDescriptor *descriptor, NSData *source,
+                                           NSMutableArray *fields,
+                                           NSMutableArray *elementsPerField,
+                                           NSMutableData *rest) {
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:source];
+  VPKGPBCodedInputStreamState *state = &input->state_;
+  state->recordsErrors = YES;
+  const uint8_t *bytes = source.bytes;
+  while (YES) {
+    size_t start = state->bufferPos;
+    int32_t tag = VPKGPBCodedInputStreamReadTag(state);
+    if (tag == 0) {
+      break;
+    }
+    VPKGPBFieldDescriptor *field =
+        VPKGPBDescriptorFieldWithNumber(descriptor, VPKGPBWireFormatGetTagFieldNumber(tag));
+    if (field && field.fieldType == VPKGPBFieldTypeRepeated &&
+        VPKGPBGetFieldDataType(field) == VPKGPBDataTypeMessage &&
+        VPKGPBFieldTag(field) == (uint32_t)tag) {
+      NSData *element = VPKGPBCodedInputStreamReadRetainedBytesNoCopy(state);
+      if (!element) {
+        break;
+      }
+      NSUInteger idx = [fields indexOfObjectIdenticalTo:field];
+      if (idx == NSNotFound) {
+        idx = fields.count;
+        [fields addObject:field];
+        [elementsPerField addObject:[NSMutableArray array]];
+      }
+      [elementsPerField[idx] addObject:element];
+      [element release];
+    } else if ([input skipField:tag]) {
+      [rest appendBytes:bytes + start length:state->bufferPos - start];
+    } else {
+      // A stray end group tag, which the serial parse rejects the same way.
+      VPKGPBCodedInputStreamCheckLastTagWas(state, 0);
+      break;
+    }
+  }
+  NSError *error = VPKGPBCodedInputStreamStatusError(state);
+  [input release];
+  return error;
+}
+
+// Decodes each of |elements| as a |msgClass| on the global concurrent queue.
+// The elements are decoded as the serial parse would with its stream at
+// |parentRecursionDepth|, so the recursion limit covers the whole tree; the
+// caller checks required fields once the message is complete. Returns the
+// messages in order, or nil, filling in |errorPtr|, if any failed.
+static NSMutableArray *CreateMessagesConcurrently(Class msgClass, NSArray<NSData *> *elements,
+                                                  id<VPKGPBExtensionRegistry> extensionRegistry,
+                                                  NSUInteger parentRecursionDepth,
+                                                  NSError **errorPtr)
+    __attribute__((ns_returns_retained));
+static NSMutableArray *CreateMessagesConcurrently(Class msgClass, NSArray<NSData *> *elements,
+                                                  id<VPKGPBExtensionRegistry> extensionRegistry,
+                                                  NSUInteger parentRecursionDepth,
+                                                  NSError **errorPtr) {
+  NSUInteger count = elements.count;
+  NSData **datas = malloc(count * sizeof(NSData *));
+  id *messages = calloc(count, sizeof(id));
+  if (!datas || !messages) {
+    free(datas);
+    free(messages);
+    [NSException raise:NSMallocException format:@"Failed to allocate %lu messages.",
+                                                (unsigned long)count];
+  }
+  [elements getObjects:datas range:NSMakeRange(0, count)];
+  // Makes sure the class is set up before the workers race to it.
+  [msgClass descriptor];
+
+  __block NSError *firstError = nil;
+  __block os_unfair_lock errorLock = OS_UNFAIR_LOCK_INIT;
+  size_t chunkCount = (count + kConcurrentParseChunkSize - 1) / kConcurrentParseChunkSize;
+  dispatch_apply(chunkCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                 ^(size_t chunk) {
+    NSUInteger end = MIN(count, (chunk + 1) * kConcurrentParseChunkSize);
+    for (NSUInteger i = chunk * kConcurrentParseChunkSize; i < end; ++i) {
+      @autoreleasepool {
+        VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:datas[i]];
+        // -readMessage:extensionRegistry: parses an element one level below
+        // its parent, so everything nested in it counts against the limit.
+        input->state_.recursionDepth = parentRecursionDepth + 1;
+        VPKGPBMessage *message = [[msgClass alloc] init];
+        NSError *error = nil;
+        @try {
+          error = MergeFromCodedInputStreamRecordingErrors(message, input, extensionRegistry, YES);
+        } @catch (NSException *exception) {
+          error = ErrorFromException(exception);
+        }
+        [input release];
+        if (!error) {
+          messages[i] = message;
+        } else {
+          [message release];
+          os_unfair_lock_lock(&errorLock);
+          if (!firstError) {
+            firstError = [error retain];
+          }
+          os_unfair_lock_unlock(&errorLock);
+          return;
+        }
+      }
+    }
+  });
+
+  NSMutableArray *result = nil;
+  if (firstError) {
+    for (NSUInteger i = 0; i < count; ++i) {
+      [messages[i] release];
+    }
+    if (errorPtr) {
+      *errorPtr = [firstError autorelease];
+    } else {
+      [firstError release];
+    }
+  } else {
+    result = [[NSMutableArray alloc] initWithObjects:messages count:count];
+    for (NSUInteger i = 0; i < count; ++i) {
+      [messages[i] release];
+    }
+  }
+  free(datas);
+  free(messages);
+  return result;
+}
+
+#pragma mark - Field Selection
+
+// The fields of one message type that a field mask parse decodes.
+@interface VPKGPBFieldSelection : NSObject {
+ @package
+  uint32_t count_;
+  uint32_t *fieldNumbers_;
+  // The selection within each selected message field, or nil if the whole
+  // field is selected.
+  VPKGPBFieldSelection **children_;
+}
+@end
+
+@implementation VPKGPBFieldSelection
+
+- (void)dealloc {
+  for (uint32_t i = 0; i < count_; ++i) {
+    [children_[i] release];
+  }
+  free(fieldNumbers_);
+  free(children_);
+  [super dealloc];
+}
+
+@end
+
+// Looks |fieldNumber| up in |selection|, setting |outChild| to the selection
+// within it (nil for the whole field) when it is selected.
+static BOOL FieldSelectionLookup(VPKGPBFieldSelection *selection, uint32_t fieldNumber,
+                                 VPKGPBFieldSelection **outChild) {
+  // Masks are small, a scan beats anything fancier.
+  for (uint32_t i = 0; i < selection->count_; ++i) {
+    if (selection->fieldNumbers_[i] == fieldNumber) {
+      *outChild = selection->children_[i];
+      return YES;
+    }
+  }
+  return NO;
+}
+
+// Adds |fieldNumber| to |selection|, wholly or in part. Returns the selection
+// to add the rest of a path to, or nil once the whole field is selected.
+static VPKGPBFieldSelection *FieldSelectionAdd(VPKGPBFieldSelection *selection,
+                                               uint32_t fieldNumber, BOOL whole) {
+  VPKGPBFieldSelection *child = nil;
+  if (FieldSelectionLookup(selection, fieldNumber, &child)) {
+    if (child && whole) {
+      for (uint32_t i = 0; i < selection->count_; ++i) {
+        if (selection->fieldNumbers_[i] == fieldNumber) {
+          [selection->children_[i] release];
+          selection->children_[i] = nil;
+        }
+      }
+      return nil;
+    }
+    return child;
+  }
+  uint32_t count = selection->count_ + 1;
+  uint32_t *fieldNumbers = realloc(selection->fieldNumbers_, count * sizeof(uint32_t));
+  if (fieldNumbers) {
+    selection->fieldNumbers_ = fieldNumbers;
+  }
+  VPKGPBFieldSelection **children =
+      realloc(selection->children_, count * sizeof(VPKGPBFieldSelection *));
+  if (children) {
+    selection->children_ = children;
+  }
+  if (!fieldNumbers || !children) {
+    [NSException raise:NSMallocException format:@"Failed to grow a field selection."];
+  }
+  child = whole ? nil : [[VPKGPBFieldSelection alloc] init];
+  fieldNumbers[selection->count_] = fieldNumber;
+  children[selection->count_] = child;
+  selection->count_ = count;
+  return child;
+}
+
+static VPKGPBFieldDescriptor *FieldForMaskName(VPKGPBDescriptor *descriptor, NSString *name) {
+  for (VPKGPBFieldDescriptor *field in descriptor->fields_) {
+    if ([name isEqual:field.textFormatName] || [name isEqual:field.name]) {
+      return field;
+    }
+  }
+  return nil;
+}
+
+// Builds the selection for |fieldMask| on |descriptor|'s message. Returns nil,
+// filling in |errorPtr|, if a path does not name a field.
+static VPKGPBFieldSelection *CreateFieldSelection(VPKGPBDescriptor *descriptor,
+                                                  VPKGPBFieldMask *fieldMask,
+                                                  NSError **errorPtr)
+    __attribute__((ns_returns_retained));
+static VPKGPBFieldSelection *CreateFieldSelection(VPKGPBDescriptor *descriptor,
+                                                  VPKGPBFieldMask *fieldMask,
+                                                  NSError **errorPtr) {
+  VPKGPBFieldSelection *root = [[VPKGPBFieldSelection alloc] init];
+  for (NSString *path in fieldMask.pathsArray) {
+    NSArray<NSString *> *names = [path componentsSeparatedByString:@"."];
+    NSUInteger count = names.count;
+    VPKGPBDescriptor *currentDescriptor = descriptor;
+    VPKGPBFieldSelection *current = root;
+    for (NSUInteger i = 0; i < count && current; ++i) {
+      VPKGPBFieldDescriptor *field = FieldForMaskName(currentDescriptor, names[i]);
+      BOOL last = (i + 1 == count);
+      if (!field || (!last && (field.fieldType == VPKGPBFieldTypeMap ||
+                               !VPKGPBFieldDataTypeIsMessage(field)))) {
+        NSString *reason = [NSString
+            stringWithFormat:@"'%@' is not a valid path in %@", path, descriptor.name];
+        if (errorPtr) {
+          *errorPtr = MessageError(VPKGPBMessageErrorCodeOther, @{VPKGPBErrorReasonKey : reason});
+        }
+        [root release];
+        return nil;
+      }
+      current = FieldSelectionAdd(current, VPKGPBFieldNumber(field), last);
+      currentDescriptor = [field.msgClass descriptor];
+    }
+  }
+  return root;
+}
+
 static void CheckExtension(VPKGPBMessage *self, VPKGPBExtensionDescriptor *extension) {
   if (![self isKindOfClass:extension.containingMessageClass]) {
     [NSException raise:NSInvalidArgumentException
@@ -964,17 +1358,20 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
            extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
                        error:(NSError **)errorPtr {
   if ((self = [self init])) {
+    VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+    NSError *error = nil;
     @try {
-      [self mergeFromData:data extensionRegistry:extensionRegistry];
-      if (errorPtr) {
-        *errorPtr = nil;
-      }
+      error = MergeFromCodedInputStreamRecordingErrors(self, input, extensionRegistry, YES);
     } @catch (NSException *exception) {
+      error = ErrorFromException(exception);
+    }
+    [input release];
+    if (error) {
       [self release];
       self = nil;
-      if (errorPtr) {
-        *errorPtr = ErrorFromException(exception);
-      }
+    }
+    if (errorPtr) {
+      *errorPtr = error;
     }
 #ifdef DEBUG
     if (self && !self.initialized) {
@@ -993,17 +1390,18 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
                        extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
                                    error:(NSError **)errorPtr {
   if ((self = [self init])) {
+    NSError *error = nil;
     @try {
-      [self mergeFromCodedInputStream:input extensionRegistry:extensionRegistry];
-      if (errorPtr) {
-        *errorPtr = nil;
-      }
+      error = MergeFromCodedInputStreamRecordingErrors(self, input, extensionRegistry, NO);
     } @catch (NSException *exception) {
+      error = ErrorFromException(exception);
+    }
+    if (error) {
       [self release];
       self = nil;
-      if (errorPtr) {
-        *errorPtr = ErrorFromException(exception);
-      }
+    }
+    if (errorPtr) {
+      *errorPtr = error;
     }
 #ifdef DEBUG
     if (self && !self.initialized) {
@@ -1021,6 +1419,13 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
 - (void)dealloc {
   [self internalClear:NO];
   NSCAssert(!autocreator_, @"Autocreator was not cleared before dealloc.");
+  VPKGPBMessageArena *arena = arena_;
+  if (arena) {
+    // What -[NSObject dealloc] does, except the memory goes back to the arena.
+    objc_destructInstance(self);
+    MessageArenaRelease(arena);
+    return;
+  }
   [super dealloc];
 }
 
@@ -1039,7 +1444,10 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
         // we also need to ensure all the messages as those need copying also.
         id newValue;
         if (VPKGPBFieldDataTypeIsMessage(field)) {
-          if (field.fieldType == VPKGPBFieldTypeRepeated) {
+          if ([value isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+            // Keeps the elements not decoded yet that way in the copy.
+            newValue = [(VPKGPBLazyMessageArray *)value deepCopyWithZone:zone];
+          } else if (field.fieldType == VPKGPBFieldTypeRepeated) {
             NSArray *existingArray = (NSArray *)value;
             NSMutableArray *newArray =
                 [[NSMutableArray alloc] initWithCapacity:existingArray.count];
@@ -1208,6 +1616,8 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
   extensionMap_ = nil;
   [unknownFields_ release];
   unknownFields_ = nil;
+  [spareMessages_ release];
+  spareMessages_ = nil;
 
   // Note that clearing does not affect autocreator_. If we are being cleared
   // because of a dealloc, then autocreator_ should be nil anyway. If we are
@@ -1297,13 +1707,75 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
   return [[self class] descriptor];
 }
 
+// The sizes -serializedSize has recorded for the write in progress on this
+// thread, or NULL when there is none. Keyed by message identity; the keys are
+// retained so an address cannot be reused by another message mid write.
+static _Thread_local CFMutableDictionaryRef gRecordedMessageSizes;
+// The element snapshots lazy message arrays were sized from during that same
+// write, created on first use since most messages have no lazy arrays.
+static _Thread_local CFMutableDictionaryRef gRecordedLazyElements;
+
+static CFMutableDictionaryRef CreateIdentityDictionary(const CFDictionaryValueCallBacks *values) {
+  CFDictionaryKeyCallBacks keyCallBacks = kCFTypeDictionaryKeyCallBacks;
+  keyCallBacks.equal = NULL;
+  keyCallBacks.hash = NULL;
+  return CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &keyCallBacks, values);
+}
+
+BOOL VPKGPBBeginRecordingMessageSizes(void) {
+  if (gRecordedMessageSizes) {
+    return NO;
+  }
+  gRecordedMessageSizes = CreateIdentityDictionary(NULL);
+  return YES;
+}
+
+void VPKGPBEndRecordingMessageSizes(void) {
+  CFRelease(gRecordedMessageSizes);
+  gRecordedMessageSizes = NULL;
+  if (gRecordedLazyElements) {
+    CFRelease(gRecordedLazyElements);
+    gRecordedLazyElements = NULL;
+  }
+}
+
+size_t VPKGPBRecordedMessageSize(VPKGPBMessage *message) {
+  const void *size;
+  if (gRecordedMessageSizes &&
+      CFDictionaryGetValueIfPresent(gRecordedMessageSizes, message, &size)) {
+    return (size_t)size;
+  }
+  // A message that was not sized beforehand, e.g. one handed straight to
+  // -writeMessageNoTag:; sizing it now records it for the write.
+  return [message serializedSize];
+}
+
+void VPKGPBRecordLazyElements(id array, NSArray *elements) {
+  if (!gRecordedMessageSizes) {
+    return;
+  }
+  if (!gRecordedLazyElements) {
+    gRecordedLazyElements = CreateIdentityDictionary(&kCFTypeDictionaryValueCallBacks);
+  }
+  CFDictionarySetValue(gRecordedLazyElements, array, elements);
+}
+
+NSArray *VPKGPBRecordedLazyElements(id array) {
+  if (!gRecordedLazyElements) {
+    return nil;
+  }
+  return (NSArray *)CFDictionaryGetValue(gRecordedLazyElements, array);
+}
+
 - (NSData *)data {
 #ifdef DEBUG
   if (!self.initialized) {
     return nil;
   }
 #endif
-  NSMutableData *data = [NSMutableData dataWithLength:[self serializedSize]];
+  // Sizing |self| records the size of every submessage for the write.
+  BOOL startedRecording = VPKGPBBeginRecordingMessageSizes();
+  NSMutableData *data = [NSMutableData dataWithLength:VPKGPBRecordedMessageSize(self)];
   VPKGPBCodedOutputStream *stream = [[VPKGPBCodedOutputStream alloc] initWithData:data];
   @try {
     [self writeToCodedOutputStream:stream];
@@ -1316,17 +1788,22 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
 #endif
     data = nil;
   }
+  if (startedRecording) {
+    VPKGPBEndRecordingMessageSizes();
+  }
   [stream release];
   return data;
 }
 
 - (NSData *)delimitedData {
-  size_t serializedSize = [self serializedSize];
+  BOOL startedRecording = VPKGPBBeginRecordingMessageSizes();
+  size_t serializedSize = VPKGPBRecordedMessageSize(self);
   size_t varintSize = VPKGPBComputeRawVarint32SizeForInteger(serializedSize);
   NSMutableData *data = [NSMutableData dataWithLength:(serializedSize + varintSize)];
   VPKGPBCodedOutputStream *stream = [[VPKGPBCodedOutputStream alloc] initWithData:data];
   @try {
-    [self writeDelimitedToCodedOutputStream:stream];
+    [stream writeRawVarintSizeTAs32:serializedSize];
+    [self writeToCodedOutputStream:stream];
   } @catch (NSException *exception) {
     // This really shouldn't happen.  The only way writeToCodedOutputStream:
     // could throw is if something in the library has a bug and the
@@ -1338,6 +1815,9 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
     // If it happens, truncate.
     data.length = 0;
   }
+  if (startedRecording) {
+    VPKGPBEndRecordingMessageSizes();
+  }
   [stream release];
   return data;
 }
@@ -1384,8 +1864,15 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
 }
 
 - (void)writeDelimitedToCodedOutputStream:(VPKGPBCodedOutputStream *)output {
-  [output writeRawVarintSizeTAs32:[self serializedSize]];
-  [self writeToCodedOutputStream:output];
+  BOOL startedRecording = VPKGPBBeginRecordingMessageSizes();
+  @try {
+    [output writeRawVarintSizeTAs32:VPKGPBRecordedMessageSize(self)];
+    [self writeToCodedOutputStream:output];
+  } @finally {
+    if (startedRecording) {
+      VPKGPBEndRecordingMessageSizes();
+    }
+  }
 }
 
 - (void)writeField:(VPKGPBFieldDescriptor *)field toCodedOutputStream:(VPKGPBCodedOutputStream *)output {
@@ -1398,6 +1885,16 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
   }
   uint32_t fieldNumber = VPKGPBFieldNumber(field);
 
+  if (fieldType == VPKGPBFieldTypeRepeated &&
+      VPKGPBGetFieldDataType(field) == VPKGPBDataTypeMessage) {
+    id array = VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field);
+    if ([array isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+      // Writes the elements never accessed without decoding them.
+      [(VPKGPBLazyMessageArray *)array writeToCodedOutputStream:output asField:field];
+      return;
+    }
+  }
+
   switch (VPKGPBGetFieldDataType(field)) {
       // clang-format off
 
@@ -1991,6 +2488,25 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
 
 #pragma mark - mergeFrom
 
+// Merges |data| into |self| with the bytes fields aliasing it. Returns the
+// error for the first failure, or nil.
+static NSError *MergeFromAliasedData(VPKGPBMessage *self, NSData *data,
+                                     id<VPKGPBExtensionRegistry> extensionRegistry) {
+  // The bytes fields will point into this, so it must not change under them.
+  NSData *source = [data copy];
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:source];
+  input->state_.aliasedData = source;
+  NSError *error = nil;
+  @try {
+    error = MergeFromCodedInputStreamRecordingErrors(self, input, extensionRegistry, YES);
+  } @catch (NSException *exception) {
+    error = ErrorFromException(exception);
+  }
+  [input release];
+  [source release];
+  return error;
+}
+
 - (void)mergeFromData:(NSData *)data
     extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry {
   VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
@@ -1999,6 +2515,23 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
   [input release];
 }
 
+- (BOOL)mergeFromFileAtPath:(NSString *)path
+          extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                      error:(NSError **)errorPtr {
+  NSData *data = [[NSData alloc] initWithContentsOfFile:path
+                                                options:NSDataReadingMappedAlways
+                                                  error:errorPtr];
+  if (!data) {
+    return NO;
+  }
+  NSError *error = MergeFromAliasedData(self, data, extensionRegistry);
+  [data release];
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  return error == nil;
+}
+
 #pragma mark - mergeDelimitedFrom
 
 - (void)mergeDelimitedFromCodedInputStream:(VPKGPBCodedInputStream *)input
@@ -2011,7 +2544,17 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
   if (data == nil) {
     return;
   }
-  [self mergeFromData:data extensionRegistry:extensionRegistry];
+  if (state->recordsErrors) {
+    // Keep the nested parse exception-free too, and carry its failure out.
+    VPKGPBCodedInputStream *nested = [[VPKGPBCodedInputStream alloc] initWithData:data];
+    NSError *error = MergeFromCodedInputStreamRecordingErrors(self, nested, extensionRegistry, YES);
+    if (error) {
+      VPKGPBCodedInputStreamReportError(state, error.code, error.userInfo[VPKGPBErrorReasonKey]);
+    }
+    [nested release];
+  } else {
+    [self mergeFromData:data extensionRegistry:extensionRegistry];
+  }
   [data release];
 }
 
@@ -2029,6 +2572,172 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
                                error:errorPtr] autorelease];
 }
 
++ (instancetype)parseFromAliasedData:(NSData *)data
+                  extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                              error:(NSError **)errorPtr {
+  VPKGPBMessage *message = [[[self alloc] init] autorelease];
+  NSError *error = MergeFromAliasedData(message, data, extensionRegistry);
+#ifdef DEBUG
+  if (!error && !message.initialized) {
+    error = MessageError(VPKGPBMessageErrorCodeMissingRequiredField, nil);
+  }
+#endif
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  return error ? nil : message;
+}
+
++ (instancetype)parseFromData:(NSData *)data
+                    fieldMask:(VPKGPBFieldMask *)fieldMask
+                        error:(NSError **)errorPtr {
+  VPKGPBFieldSelection *selection = CreateFieldSelection([self descriptor], fieldMask, errorPtr);
+  if (!selection) {
+    return nil;
+  }
+  VPKGPBMessage *message = [[[self alloc] init] autorelease];
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+  input->state_.fieldSelection = selection;
+  NSError *error = nil;
+  @try {
+    error = MergeFromCodedInputStreamRecordingErrors(message, input, nil, YES);
+  } @catch (NSException *exception) {
+    error = ErrorFromException(exception);
+  }
+  [input release];
+  [selection release];
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  return error ? nil : message;
+}
+
++ (instancetype)parseConcurrentlyFromData:(NSData *)data
+                       extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                                   error:(NSError **)errorPtr {
+  VPKGPBMessage *message = [[[self alloc] init] autorelease];
+  // The elements point into this, so it must not change under them.
+  NSData *source = [data copy];
+  NSMutableArray *fields = [NSMutableArray array];
+  NSMutableArray *elementsPerField = [NSMutableArray array];
+  NSMutableData *rest = [NSMutableData data];
+  NSError *error = nil;
+  @try {
+    error = SplitRepeatedMessageFields([self descriptor], source, fields, elementsPerField, rest);
+    if (!error) {
+      // Merging the rest first is equivalent to the serial parse since none of
+      // it is for the fields being decoded concurrently.
+      VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:rest];
+      @try {
+        error = MergeFromCodedInputStreamRecordingErrors(message, input, extensionRegistry, YES);
+      } @finally {
+        [input release];
+      }
+    }
+    NSUInteger fieldCount = fields.count;
+    for (NSUInteger i = 0; i < fieldCount && !error; ++i) {
+      VPKGPBFieldDescriptor *field = fields[i];
+      NSMutableArray *array =
+          CreateMessagesConcurrently(field.msgClass, elementsPerField[i], extensionRegistry,
+                                     /* parentRecursionDepth */ 0, &error);
+      if (array) {
+        VPKGPBSetRetainedObjectIvarWithFieldPrivate(message, field, array);
+      }
+    }
+  } @catch (NSException *exception) {
+    error = ErrorFromException(exception);
+  }
+  // The elements are gone with the arrays; nothing refers to the source now.
+  [source release];
+#ifdef DEBUG
+  if (!error && !message.initialized) {
+    error = MessageError(VPKGPBMessageErrorCodeMissingRequiredField, nil);
+  }
+#endif
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  return error ? nil : message;
+}
+
++ (instancetype)parseFromDataUsingArena:(NSData *)data
+                     extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                                 error:(NSError **)errorPtr {
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:data];
+  VPKGPBCodedInputStreamState *state = &input->state_;
+  state->arena = MessageArenaCreate();
+  VPKGPBMessage *message = nil;
+  NSError *error = nil;
+  @try {
+    message = CreateMessageForParse(self, state);
+    error = MergeFromCodedInputStreamRecordingErrors(message, input, extensionRegistry, YES);
+  } @catch (NSException *exception) {
+    error = ErrorFromException(exception);
+  } @finally {
+    // The messages now hold the arena alive by themselves.
+    MessageArenaRelease(state->arena);
+    state->arena = NULL;
+  }
+  [input release];
+#ifdef DEBUG
+  if (!error && !message.initialized) {
+    error = MessageError(VPKGPBMessageErrorCodeMissingRequiredField, nil);
+  }
+#endif
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  if (error) {
+    [message release];
+    return nil;
+  }
+  return [message autorelease];
+}
+
++ (instancetype)parseFromFileAtPath:(NSString *)path error:(NSError **)errorPtr {
+  return [self parseFromFileAtPath:path extensionRegistry:nil error:errorPtr];
+}
+
++ (instancetype)parseFromFileAtPath:(NSString *)path
+                  extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                              error:(NSError **)errorPtr {
+  NSData *data = [[NSData alloc] initWithContentsOfFile:path
+                                                options:NSDataReadingMappedAlways
+                                                  error:errorPtr];
+  if (!data) {
+    return nil;
+  }
+  VPKGPBMessage *message = [self parseFromAliasedData:data
+                                   extensionRegistry:extensionRegistry
+                                               error:errorPtr];
+  [data release];
+  return message;
+}
+
++ (instancetype)parseLazilyFromData:(NSData *)data
+                 extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
+                             error:(NSError **)errorPtr {
+  VPKGPBMessage *message = [[[self alloc] init] autorelease];
+  // The deferred elements will point into this, so it must not change under them.
+  NSData *source = [data copy];
+  VPKGPBCodedInputStream *input = [[VPKGPBCodedInputStream alloc] initWithData:source];
+  input->state_.deferredMessageSource = source;
+  NSError *error = nil;
+  @try {
+    error = MergeFromCodedInputStreamRecordingErrors(message, input, extensionRegistry, YES);
+  } @catch (NSException *exception) {
+    error = ErrorFromException(exception);
+  }
+  [input release];
+  [source release];
+  // Unlike the other parse methods, required fields are not checked in DEBUG
+  // builds since that would decode every deferred element.
+  if (errorPtr) {
+    *errorPtr = error;
+  }
+  return error ? nil : message;
+}
+
 + (instancetype)parseFromCodedInputStream:(VPKGPBCodedInputStream *)input
                         extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry
                                     error:(NSError **)errorPtr {
@@ -2045,19 +2754,29 @@ static VPKGPBUnknownFieldSet *GetOrMakeUnknownFields(VPKGPBMessage *self) {
                                      (id<VPKGPBExtensionRegistry>)extensionRegistry
                                              error:(NSError **)errorPtr {
   VPKGPBMessage *message = [[[self alloc] init] autorelease];
+  VPKGPBCodedInputStreamState *state = &input->state_;
+  NSError *error = nil;
+  // Malformed input is recorded on the stream rather than raised.
+  BOOL wasRecordingErrors = VPKGPBCodedInputStreamBeginRecordingErrors(state);
   @try {
     [message mergeDelimitedFromCodedInputStream:input
                               extensionRegistry:extensionRegistry];
-    if (errorPtr) {
-      *errorPtr = nil;
-    }
   }
   @catch (NSException *exception) {
-    message = nil;
-    if (errorPtr) {
-      *errorPtr = ErrorFromException(exception);
+    error = ErrorFromException(exception);
+  }
+  @finally {
+    NSError *recordedError = VPKGPBCodedInputStreamEndRecordingErrors(state, wasRecordingErrors);
+    if (!error) {
+      error = recordedError;
     }
   }
+  if (error) {
+    message = nil;
+  }
+  if (errorPtr) {
+    *errorPtr = error;
+  }
 #ifdef DEBUG
   if (message && !message.initialized) {
     message = nil;
@@ -2217,11 +2936,16 @@ static void MergeSingleFieldFromCodedInputStream(
       CASE_SINGLE_POD(SInt64, int64_t, Int64)
       CASE_SINGLE_POD(UInt32, uint32_t, UInt32)
       CASE_SINGLE_POD(UInt64, uint64_t, UInt64)
-      CASE_SINGLE_OBJECT(Bytes)
       CASE_SINGLE_OBJECT(String)
 #undef CASE_SINGLE_POD
 #undef CASE_SINGLE_OBJECT
 
+    case VPKGPBDataTypeBytes: {
+      id val = VPKGPBCodedInputStreamReadRetainedFieldBytes(&input->state_);
+      VPKGPBSetRetainedObjectIvarWithFieldPrivate(self, field, val);
+      break;
+    }
+
     case VPKGPBDataTypeMessage: {
       if (VPKGPBGetHasIvarField(self, field)) {
         // VPKGPBGetObjectIvarWithFieldNoAutocreate() avoids doing the has
@@ -2230,7 +2954,7 @@ static void MergeSingleFieldFromCodedInputStream(
             VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field);
         [input readMessage:message extensionRegistry:extensionRegistry];
       } else {
-        VPKGPBMessage *message = [[field.msgClass alloc] init];
+        VPKGPBMessage *message = TakeOrCreateMessageForParse(self, field, &input->state_);
         [input readMessage:message extensionRegistry:extensionRegistry];
         VPKGPBSetRetainedObjectIvarWithFieldPrivate(self, field, message);
       }
@@ -2247,7 +2971,7 @@ static void MergeSingleFieldFromCodedInputStream(
                       message:message
             extensionRegistry:extensionRegistry];
       } else {
-        VPKGPBMessage *message = [[field.msgClass alloc] init];
+        VPKGPBMessage *message = TakeOrCreateMessageForParse(self, field, &input->state_);
         [input readGroup:VPKGPBFieldNumber(field)
                       message:message
             extensionRegistry:extensionRegistry];
@@ -2268,6 +2992,10 @@ static void MergeSingleFieldFromCodedInputStream(
   }  // switch
 }
 
+// How many values a packed field is decoded into a local buffer before they
+// are appended to the field's array as a batch.
+#define kPackedChunkCount 64
+
 static void MergeRepeatedPackedFieldFromCodedInputStream(
     VPKGPBMessage *self, VPKGPBFieldDescriptor *field,
     VPKGPBCodedInputStream *input) {
@@ -2276,37 +3004,63 @@ static void MergeRepeatedPackedFieldFromCodedInputStream(
   id genericArray = GetOrCreateArrayIvarWithField(self, field);
   int32_t length = VPKGPBCodedInputStreamReadInt32(state);
   size_t limit = VPKGPBCodedInputStreamPushLimit(state, length);
-  while (VPKGPBCodedInputStreamBytesUntilLimit(state) > 0) {
-    switch (fieldDataType) {
-#define CASE_REPEATED_PACKED_POD(NAME, TYPE, ARRAY_TYPE)      \
-     case VPKGPBDataType##NAME: {                                \
-       TYPE val = VPKGPBCodedInputStreamRead##NAME(state);       \
-       [(VPKGPB##ARRAY_TYPE##Array *)genericArray addValue:val]; \
-       break;                                                 \
-     }
-        CASE_REPEATED_PACKED_POD(Bool, BOOL, Bool)
-        CASE_REPEATED_PACKED_POD(Fixed32, uint32_t, UInt32)
-        CASE_REPEATED_PACKED_POD(SFixed32, int32_t, Int32)
-        CASE_REPEATED_PACKED_POD(Float, float, Float)
-        CASE_REPEATED_PACKED_POD(Fixed64, uint64_t, UInt64)
-        CASE_REPEATED_PACKED_POD(SFixed64, int64_t, Int64)
-        CASE_REPEATED_PACKED_POD(Double, double, Double)
-        CASE_REPEATED_PACKED_POD(Int32, int32_t, Int32)
-        CASE_REPEATED_PACKED_POD(Int64, int64_t, Int64)
-        CASE_REPEATED_PACKED_POD(SInt32, int32_t, Int32)
-        CASE_REPEATED_PACKED_POD(SInt64, int64_t, Int64)
-        CASE_REPEATED_PACKED_POD(UInt32, uint32_t, UInt32)
-        CASE_REPEATED_PACKED_POD(UInt64, uint64_t, UInt64)
-#undef CASE_REPEATED_PACKED_POD
-
-      case VPKGPBDataTypeBytes:
-      case VPKGPBDataTypeString:
-      case VPKGPBDataTypeMessage:
-      case VPKGPBDataTypeGroup:
-        NSCAssert(NO, @"Non primitive types can't be packed");
-        break;
+  switch (fieldDataType) {
+// Fixed width values are copied out of the input a chunk at a time. A trailing
+// partial value is read on its own so it fails as it did value by value.
+#define CASE_REPEATED_PACKED_FIXED(NAME, TYPE, ARRAY_TYPE)                       \
+    case VPKGPBDataType##NAME: {                                                 \
+      TYPE values[kPackedChunkCount];                                            \
+      size_t available;                                                          \
+      while ((available = VPKGPBCodedInputStreamBytesUntilLimit(state)) > 0) {    \
+        size_t count = MAX((size_t)1, MIN(available / sizeof(TYPE),              \
+                                          (size_t)kPackedChunkCount));           \
+        VPKGPBCodedInputStreamReadRawLittleEndianArray(state, values, count,     \
+                                                       sizeof(TYPE));            \
+        [(VPKGPB##ARRAY_TYPE##Array *)genericArray addValues:values count:count]; \
+      }                                                                          \
+      break;                                                                     \
+    }
+// Varints are decoded into a chunk and appended with one call per chunk
+// rather than one -addValue: per value.
+#define CASE_REPEATED_PACKED_VARINT(NAME, TYPE, ARRAY_TYPE)                      \
+    case VPKGPBDataType##NAME: {                                                 \
+      TYPE values[kPackedChunkCount];                                            \
+      while (VPKGPBCodedInputStreamBytesUntilLimit(state) > 0) {                 \
+        NSUInteger count = 0;                                                    \
+        do {                                                                     \
+          values[count++] = VPKGPBCodedInputStreamRead##NAME(state);             \
+        } while (count < kPackedChunkCount &&                                    \
+                 VPKGPBCodedInputStreamBytesUntilLimit(state) > 0);              \
+        [(VPKGPB##ARRAY_TYPE##Array *)genericArray addValues:values count:count]; \
+      }                                                                          \
+      break;                                                                     \
+    }
+    CASE_REPEATED_PACKED_FIXED(Fixed32, uint32_t, UInt32)
+    CASE_REPEATED_PACKED_FIXED(SFixed32, int32_t, Int32)
+    CASE_REPEATED_PACKED_FIXED(Float, float, Float)
+    CASE_REPEATED_PACKED_FIXED(Fixed64, uint64_t, UInt64)
+    CASE_REPEATED_PACKED_FIXED(SFixed64, int64_t, Int64)
+    CASE_REPEATED_PACKED_FIXED(Double, double, Double)
+    CASE_REPEATED_PACKED_VARINT(Bool, BOOL, Bool)
+    CASE_REPEATED_PACKED_VARINT(Int32, int32_t, Int32)
+    CASE_REPEATED_PACKED_VARINT(Int64, int64_t, Int64)
+    CASE_REPEATED_PACKED_VARINT(SInt32, int32_t, Int32)
+    CASE_REPEATED_PACKED_VARINT(SInt64, int64_t, Int64)
+    CASE_REPEATED_PACKED_VARINT(UInt32, uint32_t, UInt32)
+    CASE_REPEATED_PACKED_VARINT(UInt64, uint64_t, UInt64)
+#undef CASE_REPEATED_PACKED_FIXED
+#undef CASE_REPEATED_PACKED_VARINT
+
+    case VPKGPBDataTypeBytes:
+    case VPKGPBDataTypeString:
+    case VPKGPBDataTypeMessage:
+    case VPKGPBDataTypeGroup:
+      NSCAssert(NO, @"Non primitive types can't be packed");
+      break;
 
-      case VPKGPBDataTypeEnum: {
+    case VPKGPBDataTypeEnum:
+      // Each value is checked on its own, unknown ones go to the unknown fields.
+      while (VPKGPBCodedInputStreamBytesUntilLimit(state) > 0) {
         int32_t val = VPKGPBCodedInputStreamReadEnum(state);
         if (!VPKGPBFieldIsClosedEnum(field) || [field isValidEnumValue:val]) {
           [(VPKGPBEnumArray*)genericArray addRawValue:val];
@@ -2314,17 +3068,43 @@ static void MergeRepeatedPackedFieldFromCodedInputStream(
           VPKGPBUnknownFieldSet *unknownFields = GetOrMakeUnknownFields(self);
           [unknownFields mergeVarintField:VPKGPBFieldNumber(field) value:val];
         }
-        break;
       }
-    }  // switch
-  }  // while(BytesUntilLimit() > 0)
+      break;
+  }  // switch
   VPKGPBCodedInputStreamPopLimit(state, limit);
 }
 
+// Keeps the encoded element in the field's VPKGPBLazyMessageArray, creating it
+// if the field has no array yet. Returns NO, reading nothing, if the field
+// already holds a regular array so the element has to be decoded now.
+static BOOL MergeDeferredMessageFromCodedInputStream(
+    VPKGPBMessage *self, VPKGPBFieldDescriptor *field,
+    VPKGPBCodedInputStream *input, id<VPKGPBExtensionRegistry>extensionRegistry) {
+  VPKGPBCodedInputStreamState *state = &input->state_;
+  id array = VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field);
+  if (array == nil) {
+    array = [[VPKGPBLazyMessageArray alloc] initWithMessageClass:field.msgClass
+                                               extensionRegistry:extensionRegistry];
+    VPKGPBSetRetainedObjectIvarWithFieldPrivate(self, field, array);
+  } else if (![array isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+    return NO;
+  }
+  NSData *data = VPKGPBCodedInputStreamReadRetainedSlice(state, state->deferredMessageSource);
+  if (data) {
+    [(VPKGPBLazyMessageArray *)array addMessageData:data];
+    [data release];
+  }
+  return YES;
+}
+
 static void MergeRepeatedNotPackedFieldFromCodedInputStream(
     VPKGPBMessage *self, VPKGPBFieldDescriptor *field,
     VPKGPBCodedInputStream *input, id<VPKGPBExtensionRegistry>extensionRegistry) {
   VPKGPBCodedInputStreamState *state = &input->state_;
+  if (state->deferredMessageSource && VPKGPBGetFieldDataType(field) == VPKGPBDataTypeMessage &&
+      MergeDeferredMessageFromCodedInputStream(self, field, input, extensionRegistry)) {
+    return;
+  }
   id genericArray = GetOrCreateArrayIvarWithField(self, field);
   switch (VPKGPBGetFieldDataType(field)) {
 #define CASE_REPEATED_NOT_PACKED_POD(NAME, TYPE, ARRAY_TYPE) \
@@ -2353,19 +3133,24 @@ static void MergeRepeatedNotPackedFieldFromCodedInputStream(
       CASE_REPEATED_NOT_PACKED_POD(SInt64, int64_t, Int64)
       CASE_REPEATED_NOT_PACKED_POD(UInt32, uint32_t, UInt32)
       CASE_REPEATED_NOT_PACKED_POD(UInt64, uint64_t, UInt64)
-      CASE_REPEATED_NOT_PACKED_OBJECT(Bytes)
       CASE_REPEATED_NOT_PACKED_OBJECT(String)
 #undef CASE_REPEATED_NOT_PACKED_POD
 #undef CASE_NOT_PACKED_OBJECT
+    case VPKGPBDataTypeBytes: {
+      id val = VPKGPBCodedInputStreamReadRetainedFieldBytes(state);
+      [(NSMutableArray*)genericArray addObject:val];
+      [val release];
+      break;
+    }
     case VPKGPBDataTypeMessage: {
-      VPKGPBMessage *message = [[field.msgClass alloc] init];
+      VPKGPBMessage *message = TakeOrCreateMessageForParse(self, field, state);
       [input readMessage:message extensionRegistry:extensionRegistry];
       [(NSMutableArray*)genericArray addObject:message];
       [message release];
       break;
     }
     case VPKGPBDataTypeGroup: {
-      VPKGPBMessage *message = [[field.msgClass alloc] init];
+      VPKGPBMessage *message = TakeOrCreateMessageForParse(self, field, state);
       [input readGroup:VPKGPBFieldNumber(field)
                     message:message
           extensionRegistry:extensionRegistry];
@@ -2390,34 +3175,39 @@ static void MergeRepeatedNotPackedFieldFromCodedInputStream(
                 extensionRegistry:(id<VPKGPBExtensionRegistry>)extensionRegistry {
   VPKGPBDescriptor *descriptor = [self descriptor];
   VPKGPBCodedInputStreamState *state = &input->state_;
+  VPKGPBFieldSelection *selection = state->fieldSelection;
   uint32_t tag = 0;
-  NSUInteger startingIndex = 0;
-  NSArray *fields = descriptor->fields_;
-  NSUInteger numFields = fields.count;
   while (YES) {
-    BOOL merged = NO;
+    // A selected message field narrows the selection while it is read.
+    state->fieldSelection = selection;
     tag = VPKGPBCodedInputStreamReadTag(state);
     if (tag == 0) {
       break;  // Reached end.
     }
-    for (NSUInteger i = 0; i < numFields; ++i) {
-      if (startingIndex >= numFields) startingIndex = 0;
-      VPKGPBFieldDescriptor *fieldDescriptor = fields[startingIndex];
+    if (selection) {
+      VPKGPBFieldSelection *fieldSelection = nil;
+      if (!FieldSelectionLookup(selection, VPKGPBWireFormatGetTagFieldNumber(tag),
+                                &fieldSelection)) {
+        if (![input skipField:tag]) {
+          // it's an endgroup tag
+          return;
+        }
+        continue;
+      }
+      state->fieldSelection = fieldSelection;
+    }
+    VPKGPBFieldDescriptor *fieldDescriptor =
+        VPKGPBDescriptorFieldWithNumber(descriptor, VPKGPBWireFormatGetTagFieldNumber(tag));
+    if (fieldDescriptor) {
+      VPKGPBFieldType fieldType = fieldDescriptor.fieldType;
       if (VPKGPBFieldTag(fieldDescriptor) == tag) {
-        VPKGPBFieldType fieldType = fieldDescriptor.fieldType;
         if (fieldType == VPKGPBFieldTypeSingle) {
           MergeSingleFieldFromCodedInputStream(self, fieldDescriptor,
                                                input, extensionRegistry);
-          // Well formed protos will only have a single field once, advance
-          // the starting index to the next field.
-          startingIndex += 1;
         } else if (fieldType == VPKGPBFieldTypeRepeated) {
           if (fieldDescriptor.isPackable) {
             MergeRepeatedPackedFieldFromCodedInputStream(
                 self, fieldDescriptor, input);
-            // Well formed protos will only have a repeated field that is
-            // packed once, advance the starting index to the next field.
-            startingIndex += 1;
           } else {
             MergeRepeatedNotPackedFieldFromCodedInputStream(
                 self, fieldDescriptor, input, extensionRegistry);
@@ -2431,57 +3221,35 @@ static void MergeRepeatedNotPackedFieldFromCodedInputStream(
                         field:fieldDescriptor
                 parentMessage:self];
         }
-        merged = YES;
-        break;
-      } else {
-        startingIndex += 1;
+        continue;
       }
-    }  // for(i < numFields)
 
-    if (!merged && (tag != 0)) {
       // Primitive, repeated types can be packed on unpacked on the wire, and
-      // are parsed either way.  The above loop covered tag in the preferred
-      // for, so this need to check the alternate form.
-      for (NSUInteger i = 0; i < numFields; ++i) {
-        if (startingIndex >= numFields) startingIndex = 0;
-        VPKGPBFieldDescriptor *fieldDescriptor = fields[startingIndex];
-        if ((fieldDescriptor.fieldType == VPKGPBFieldTypeRepeated) &&
-            !VPKGPBFieldDataTypeIsObject(fieldDescriptor) &&
-            (VPKGPBFieldAlternateTag(fieldDescriptor) == tag)) {
-          BOOL alternateIsPacked = !fieldDescriptor.isPackable;
-          if (alternateIsPacked) {
-            MergeRepeatedPackedFieldFromCodedInputStream(
-                self, fieldDescriptor, input);
-            // Well formed protos will only have a repeated field that is
-            // packed once, advance the starting index to the next field.
-            startingIndex += 1;
-          } else {
-            MergeRepeatedNotPackedFieldFromCodedInputStream(
-                self, fieldDescriptor, input, extensionRegistry);
-          }
-          merged = YES;
-          break;
+      // are parsed either way, so also check the alternate form.
+      if ((fieldType == VPKGPBFieldTypeRepeated) &&
+          !VPKGPBFieldDataTypeIsObject(fieldDescriptor) &&
+          (VPKGPBFieldAlternateTag(fieldDescriptor) == tag)) {
+        BOOL alternateIsPacked = !fieldDescriptor.isPackable;
+        if (alternateIsPacked) {
+          MergeRepeatedPackedFieldFromCodedInputStream(
+              self, fieldDescriptor, input);
         } else {
-          startingIndex += 1;
+          MergeRepeatedNotPackedFieldFromCodedInputStream(
+              self, fieldDescriptor, input, extensionRegistry);
         }
+        continue;
       }
     }
 
-    if (!merged) {
-      if (tag == 0) {
-        // zero signals EOF / limit reached
-        return;
-      } else {
-        if (![self parseUnknownField:input
-                   extensionRegistry:extensionRegistry
-                                 tag:tag]) {
-          // it's an endgroup tag
-          return;
-        }
-      }
-    }  // if(!merged)
-
+    if (![self parseUnknownField:input
+               extensionRegistry:extensionRegistry
+                             tag:tag]) {
+      // it's an endgroup tag
+      state->fieldSelection = selection;
+      return;
+    }
   }  // while(YES)
+  state->fieldSelection = selection;
 }
 
 #pragma mark - MergeFrom Support
@@ -2998,6 +3766,12 @@ static void MergeRepeatedNotPackedFieldFromCodedInputStream(
       if (count == 0) {
         continue;  // Nothing to add.
       }
+      if (fieldDataType == VPKGPBDataTypeMessage &&
+          [genericArray isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+        result += [(VPKGPBLazyMessageArray *)genericArray
+            computeSerializedSizeAsField:fieldDescriptor];
+        continue;
+      }
       __block size_t dataSize = 0;
 
       switch (fieldDataType) {
@@ -3085,6 +3859,9 @@ static void MergeRepeatedNotPackedFieldFromCodedInputStream(
     result += VPKGPBComputeExtensionSerializedSizeIncludingTag(extension, value);
   }
 
+  if (gRecordedMessageSizes) {
+    CFDictionarySetValue(gRecordedMessageSizes, self, (const void *)result);
+  }
   return result;
 }
 
@@ -3406,4 +4183,523 @@ id VPKGPBGetObjectIvarWithField(VPKGPBMessage *self, VPKGPBFieldDescriptor *fiel
   return expected;
 }
 
+// Clears |message| for reuse and keeps it with the spares for |field|.
+static void AddSpareMessage(NSMutableDictionary **spares, VPKGPBFieldDescriptor *field,
+                            VPKGPBMessage *message, NSSet *reusableFields) {
+  VPKGPBMessageClearForReuse(message, reusableFields);
+  if (!*spares) {
+    *spares = [[NSMutableDictionary alloc] init];
+  }
+  NSNumber *key = @(VPKGPBFieldNumber(field));
+  NSMutableArray *fieldSpares = (*spares)[key];
+  if (!fieldSpares) {
+    fieldSpares = [[NSMutableArray alloc] init];
+    (*spares)[key] = fieldSpares;
+    [fieldSpares release];
+  }
+  [fieldSpares addObject:message];
+}
+
+// Empties the array or map of |field| when it can be kept across a clear,
+// returning it (now owned by the caller), or returns nil to let -internalClear:
+// release it.
+static id TakeReusableArrayOrMap(VPKGPBMessage *self, VPKGPBFieldDescriptor *field,
+                                 NSMutableDictionary **spares, NSSet *reusableFields) {
+  id arrayOrMap = VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field);
+  if (!arrayOrMap) {
+    return nil;
+  }
+  if (field.fieldType == VPKGPBFieldTypeRepeated) {
+    if (VPKGPBFieldDataTypeIsObject(field)) {
+      if ([arrayOrMap isKindOfClass:[VPKGPBAutocreatedArray class]] ||
+          [arrayOrMap isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+        return nil;
+      }
+      NSMutableArray *array = arrayOrMap;
+      if (VPKGPBFieldDataTypeIsMessage(field)) {
+        for (VPKGPBMessage *element in array) {
+          AddSpareMessage(spares, field, element, reusableFields);
+        }
+      }
+      [array removeAllObjects];
+    } else {
+      // Type doesn't matter, it is a VPKGPB*Array.
+      VPKGPBInt32Array *VPKGPBArray = arrayOrMap;
+      if (VPKGPBArray->_autocreator == self) {
+        return nil;
+      }
+      [VPKGPBArray removeAll];
+    }
+  } else {
+    if ((field.mapKeyDataType == VPKGPBDataTypeString) && VPKGPBFieldDataTypeIsObject(field)) {
+      if ([arrayOrMap isKindOfClass:[VPKGPBAutocreatedDictionary class]]) {
+        return nil;
+      }
+      [(NSMutableDictionary *)arrayOrMap removeAllObjects];
+    } else {
+      // Type doesn't matter, it is a VPKGPB*Dictionary.
+      VPKGPBInt32Int32Dictionary *VPKGPBDict = arrayOrMap;
+      if (VPKGPBDict->_autocreator == self) {
+        return nil;
+      }
+      [VPKGPBDict removeAll];
+    }
+  }
+  // Hide it from -internalClear:.
+  uint8_t *storage = (uint8_t *)self->messageStorage_;
+  id *typePtr = (id *)&storage[field->description_->offset];
+  *typePtr = nil;
+  return arrayOrMap;
+}
+
+void VPKGPBMessageClearForReuse(VPKGPBMessage *self, NSSet *reusableFields) {
+  VPKGPBDescriptor *descriptor = [self descriptor];
+  NSMutableDictionary *spares = self->spareMessages_;
+  self->spareMessages_ = nil;
+
+  NSUInteger fieldCount = descriptor->fields_.count;
+  id *kept = calloc(fieldCount, sizeof(id));
+  if (!kept) {
+    [spares release];
+    [self internalClear:YES];
+    return;
+  }
+  NSUInteger idx = 0;
+  for (VPKGPBFieldDescriptor *field in descriptor->fields_) {
+    // Only the fields the caller vouched for are recycled, anything else may
+    // still be referenced elsewhere and is released by -internalClear: as
+    // -clear would.
+    if ([reusableFields containsObject:field]) {
+      if (VPKGPBFieldIsMapOrArray(field)) {
+        kept[idx] = TakeReusableArrayOrMap(self, field, &spares, reusableFields);
+      } else if (VPKGPBFieldDataTypeIsMessage(field) && VPKGPBGetHasIvarField(self, field)) {
+        // -internalClear: then drops our reference; the spares hold another.
+        AddSpareMessage(&spares, field, VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field),
+                        reusableFields);
+      }
+    }
+    ++idx;
+  }
+
+  [self internalClear:YES];
+
+  uint8_t *storage = (uint8_t *)self->messageStorage_;
+  idx = 0;
+  for (VPKGPBFieldDescriptor *field in descriptor->fields_) {
+    if (kept[idx]) {
+      id *typePtr = (id *)&storage[field->description_->offset];
+      *typePtr = kept[idx];
+    }
+    ++idx;
+  }
+  free(kept);
+  self->spareMessages_ = spares;
+}
+
+#pragma mark - One Pass Encoding
+
+// The output of VPKGPBMessageDataInOnePass() is built from the end of the
+// buffer towards the start: a length delimited value is written before its
+// length is needed, so no field has to be sized ahead of being written. The
+// bytes written so far are the last |length| bytes of |bytes|.
+typedef struct VPKGPBReverseBuffer {
+  uint8_t *bytes;
+  size_t capacity;
+  size_t length;
+} VPKGPBReverseBuffer;
+
+static const size_t kReverseBufferInitialCapacity = 256;
+
+// Makes room for |count| more bytes and returns where they start.
+static uint8_t *ReverseReserve(VPKGPBReverseBuffer *buffer, size_t count) {
+  if (buffer->capacity - buffer->length < count) {
+    size_t capacity = buffer->capacity ? buffer->capacity : kReverseBufferInitialCapacity;
+    while (capacity - buffer->length < count) {
+      capacity *= 2;
+    }
+    uint8_t *bytes = malloc(capacity);
+    if (!bytes) {
+      [NSException raise:NSMallocException format:@"Failed to allocate %zu bytes", capacity];
+    }
+    if (buffer->length) {
+      memcpy(bytes + capacity - buffer->length,
+             buffer->bytes + buffer->capacity - buffer->length, buffer->length);
+    }
+    free(buffer->bytes);
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+  }
+  buffer->length += count;
+  return buffer->bytes + buffer->capacity - buffer->length;
+}
+
+static void ReverseWriteRaw(VPKGPBReverseBuffer *buffer, const void *bytes, size_t count) {
+  if (count) {
+    memcpy(ReverseReserve(buffer, count), bytes, count);
+  }
+}
+
+static void ReverseWriteVarint64(VPKGPBReverseBuffer *buffer, uint64_t value) {
+  uint8_t scratch[10];
+  size_t count = 0;
+  while (value > 0x7F) {
+    scratch[count++] = (uint8_t)((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  scratch[count++] = (uint8_t)value;
+  ReverseWriteRaw(buffer, scratch, count);
+}
+
+static void ReverseWriteTag(VPKGPBReverseBuffer *buffer, uint32_t fieldNumber,
+                            VPKGPBWireFormat format) {
+  ReverseWriteVarint64(buffer, VPKGPBWireFormatMakeTag(fieldNumber, format));
+}
+
+static void ReverseWriteLittleEndian32(VPKGPBReverseBuffer *buffer, uint32_t value) {
+  uint8_t *bytes = ReverseReserve(buffer, sizeof(uint32_t));
+  for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+    bytes[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+static void ReverseWriteLittleEndian64(VPKGPBReverseBuffer *buffer, uint64_t value) {
+  uint8_t *bytes = ReverseReserve(buffer, sizeof(uint64_t));
+  for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+    bytes[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+// The per type value writers, named after their VPKGPBDataType so the field
+// writers can be stamped out by macro.
+static void ReverseWriteBool(VPKGPBReverseBuffer *buffer, BOOL value) {
+  *ReverseReserve(buffer, 1) = value ? 1 : 0;
+}
+
+static void ReverseWriteFixed32(VPKGPBReverseBuffer *buffer, uint32_t value) {
+  ReverseWriteLittleEndian32(buffer, value);
+}
+
+static void ReverseWriteSFixed32(VPKGPBReverseBuffer *buffer, int32_t value) {
+  ReverseWriteLittleEndian32(buffer, (uint32_t)value);
+}
+
+static void ReverseWriteFloat(VPKGPBReverseBuffer *buffer, float value) {
+  ReverseWriteLittleEndian32(buffer, (uint32_t)VPKGPBConvertFloatToInt32(value));
+}
+
+static void ReverseWriteFixed64(VPKGPBReverseBuffer *buffer, uint64_t value) {
+  ReverseWriteLittleEndian64(buffer, value);
+}
+
+static void ReverseWriteSFixed64(VPKGPBReverseBuffer *buffer, int64_t value) {
+  ReverseWriteLittleEndian64(buffer, (uint64_t)value);
+}
+
+static void ReverseWriteDouble(VPKGPBReverseBuffer *buffer, double value) {
+  ReverseWriteLittleEndian64(buffer, (uint64_t)VPKGPBConvertDoubleToInt64(value));
+}
+
+static void ReverseWriteInt32(VPKGPBReverseBuffer *buffer, int32_t value) {
+  // Negative values are sign extended to ten bytes, as -writeInt32NoTag: does.
+  ReverseWriteVarint64(buffer, (uint64_t)(int64_t)value);
+}
+
+static void ReverseWriteInt64(VPKGPBReverseBuffer *buffer, int64_t value) {
+  ReverseWriteVarint64(buffer, (uint64_t)value);
+}
+
+static void ReverseWriteSInt32(VPKGPBReverseBuffer *buffer, int32_t value) {
+  ReverseWriteVarint64(buffer, VPKGPBEncodeZigZag32(value));
+}
+
+static void ReverseWriteSInt64(VPKGPBReverseBuffer *buffer, int64_t value) {
+  ReverseWriteVarint64(buffer, VPKGPBEncodeZigZag64(value));
+}
+
+static void ReverseWriteUInt32(VPKGPBReverseBuffer *buffer, uint32_t value) {
+  ReverseWriteVarint64(buffer, value);
+}
+
+static void ReverseWriteUInt64(VPKGPBReverseBuffer *buffer, uint64_t value) {
+  ReverseWriteVarint64(buffer, value);
+}
+
+static void ReverseWriteEnum(VPKGPBReverseBuffer *buffer, int32_t value) {
+  ReverseWriteInt32(buffer, value);
+}
+
+static void ReverseWriteString(VPKGPBReverseBuffer *buffer, NSString *value) {
+  size_t length = 0;
+  const uint8_t *utf8Bytes = VPKGPBStringCachedUTF8Bytes(value, &length);
+  if (utf8Bytes != NULL) {
+    ReverseWriteRaw(buffer, utf8Bytes, length);
+    ReverseWriteVarint64(buffer, length);
+    return;
+  }
+  length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+  if (length) {
+    uint8_t *bytes = ReverseReserve(buffer, length);
+    const char *quickString = CFStringGetCStringPtr((CFStringRef)value, kCFStringEncodingUTF8);
+    if (quickString != NULL) {
+      memcpy(bytes, quickString, length);
+    } else {
+      NSUInteger usedLength = 0;
+      BOOL result = [value getBytes:bytes
+                          maxLength:length
+                         usedLength:&usedLength
+                           encoding:NSUTF8StringEncoding
+                            options:(NSStringEncodingConversionOptions)0
+                              range:NSMakeRange(0, [value length])
+                     remainingRange:NULL];
+      NSCAssert2(result && (usedLength == length), @"Our UTF8 calc was wrong? %tu vs %zd",
+                 usedLength, length);
+      (void)result;
+    }
+  }
+  ReverseWriteVarint64(buffer, length);
+}
+
+static void ReverseWriteBytes(VPKGPBReverseBuffer *buffer, NSData *value) {
+  size_t length = value.length;
+  ReverseWriteRaw(buffer, value.bytes, length);
+  ReverseWriteVarint64(buffer, length);
+}
+
+static void ReverseWriteMessageFields(VPKGPBReverseBuffer *buffer, VPKGPBMessage *self);
+
+static void ReverseWriteMessage(VPKGPBReverseBuffer *buffer, VPKGPBMessage *value) {
+  size_t end = buffer->length;
+  ReverseWriteMessageFields(buffer, value);
+  ReverseWriteVarint64(buffer, buffer->length - end);
+}
+
+static void ReverseWriteGroup(VPKGPBReverseBuffer *buffer, uint32_t fieldNumber,
+                              VPKGPBMessage *value) {
+  ReverseWriteTag(buffer, fieldNumber, VPKGPBWireFormatEndGroup);
+  ReverseWriteMessageFields(buffer, value);
+  ReverseWriteTag(buffer, fieldNumber, VPKGPBWireFormatStartGroup);
+}
+
+// Hands |block| a forward coded output stream and copies what it wrote in.
+// Used for the parts that are not worth a one pass form of their own: maps,
+// extensions, unknown fields and arrays still holding undecoded messages.
+static void ReverseWriteForwardEncoded(VPKGPBReverseBuffer *buffer,
+                                       void (^block)(VPKGPBCodedOutputStream *output)) {
+  NSOutputStream *stream = [[NSOutputStream alloc] initToMemory];
+  [stream open];
+  VPKGPBCodedOutputStream *output = [[VPKGPBCodedOutputStream alloc] initWithOutputStream:stream];
+  @try {
+    block(output);
+    [output flush];
+    NSData *data = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    ReverseWriteRaw(buffer, data.bytes, data.length);
+  } @finally {
+    [output release];
+    [stream close];
+    [stream release];
+  }
+}
+
+static void ReverseWriteSingleField(VPKGPBReverseBuffer *buffer, VPKGPBMessage *self,
+                                    VPKGPBFieldDescriptor *field) {
+  if (!VPKGPBGetHasIvarField(self, field)) {
+    return;
+  }
+  uint32_t fieldNumber = VPKGPBFieldNumber(field);
+  VPKGPBDataType dataType = VPKGPBGetFieldDataType(field);
+  switch (dataType) {
+#define CASE_SINGLE_POD(NAME, FUNC_TYPE)                                   \
+  case VPKGPBDataType##NAME:                                               \
+    ReverseWrite##NAME(buffer, VPKGPBGetMessage##FUNC_TYPE##Field(self, field)); \
+    break;
+    CASE_SINGLE_POD(Bool, Bool)
+    CASE_SINGLE_POD(Fixed32, UInt32)
+    CASE_SINGLE_POD(SFixed32, Int32)
+    CASE_SINGLE_POD(Float, Float)
+    CASE_SINGLE_POD(Fixed64, UInt64)
+    CASE_SINGLE_POD(SFixed64, Int64)
+    CASE_SINGLE_POD(Double, Double)
+    CASE_SINGLE_POD(Int32, Int32)
+    CASE_SINGLE_POD(Int64, Int64)
+    CASE_SINGLE_POD(SInt32, Int32)
+    CASE_SINGLE_POD(SInt64, Int64)
+    CASE_SINGLE_POD(UInt32, UInt32)
+    CASE_SINGLE_POD(UInt64, UInt64)
+    CASE_SINGLE_POD(Enum, Int32)
+#undef CASE_SINGLE_POD
+    case VPKGPBDataTypeString:
+      ReverseWriteString(buffer, VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field));
+      break;
+    case VPKGPBDataTypeBytes:
+      ReverseWriteBytes(buffer, VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field));
+      break;
+    case VPKGPBDataTypeMessage:
+      ReverseWriteMessage(buffer, VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field));
+      break;
+    case VPKGPBDataTypeGroup:
+      // The group writes both of its own tags.
+      ReverseWriteGroup(buffer, fieldNumber, VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field));
+      return;
+  }
+  ReverseWriteTag(buffer, fieldNumber, VPKGPBWireFormatForType(dataType, NO));
+}
+
+static void ReverseWriteRepeatedField(VPKGPBReverseBuffer *buffer, VPKGPBMessage *self,
+                                      VPKGPBFieldDescriptor *field) {
+  id array = VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field);
+  if ([array count] == 0) {
+    return;
+  }
+  if ([array isKindOfClass:[VPKGPBLazyMessageArray class]]) {
+    // Its undecoded elements are already bytes; let it copy them out.
+    ReverseWriteForwardEncoded(buffer, ^(VPKGPBCodedOutputStream *output) {
+      [self writeField:field toCodedOutputStream:output];
+    });
+    return;
+  }
+  uint32_t fieldNumber = VPKGPBFieldNumber(field);
+  VPKGPBDataType dataType = VPKGPBGetFieldDataType(field);
+  BOOL isPacked = field.isPackable;
+  uint64_t tag = VPKGPBWireFormatMakeTag(fieldNumber, VPKGPBWireFormatForType(dataType, NO));
+  size_t end = buffer->length;
+  switch (dataType) {
+#define CASE_REPEATED_POD(NAME, TYPE, ARRAY_TYPE, ENUMERATE)                            \
+  case VPKGPBDataType##NAME:                                                            \
+    [(VPKGPB##ARRAY_TYPE##Array *)array                                                 \
+        ENUMERATE:NSEnumerationReverse                                                  \
+        usingBlock:^(TYPE value, __unused NSUInteger idx, __unused BOOL * stop) {        \
+          ReverseWrite##NAME(buffer, value);                                            \
+          if (!isPacked) {                                                              \
+            ReverseWriteVarint64(buffer, tag);                                          \
+          }                                                                             \
+        }];                                                                             \
+    break;
+    CASE_REPEATED_POD(Bool, BOOL, Bool, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Fixed32, uint32_t, UInt32, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(SFixed32, int32_t, Int32, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Float, float, Float, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Fixed64, uint64_t, UInt64, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(SFixed64, int64_t, Int64, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Double, double, Double, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Int32, int32_t, Int32, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Int64, int64_t, Int64, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(SInt32, int32_t, Int32, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(SInt64, int64_t, Int64, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(UInt32, uint32_t, UInt32, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(UInt64, uint64_t, UInt64, enumerateValuesWithOptions)
+    CASE_REPEATED_POD(Enum, int32_t, Enum, enumerateRawValuesWithOptions)
+#undef CASE_REPEATED_POD
+    case VPKGPBDataTypeString:
+      for (NSString *value in [array reverseObjectEnumerator]) {
+        ReverseWriteString(buffer, value);
+        ReverseWriteVarint64(buffer, tag);
+      }
+      break;
+    case VPKGPBDataTypeBytes:
+      for (NSData *value in [array reverseObjectEnumerator]) {
+        ReverseWriteBytes(buffer, value);
+        ReverseWriteVarint64(buffer, tag);
+      }
+      break;
+    case VPKGPBDataTypeMessage:
+      for (VPKGPBMessage *value in [array reverseObjectEnumerator]) {
+        ReverseWriteMessage(buffer, value);
+        ReverseWriteVarint64(buffer, tag);
+      }
+      break;
+    case VPKGPBDataTypeGroup:
+      for (VPKGPBMessage *value in [array reverseObjectEnumerator]) {
+        ReverseWriteGroup(buffer, fieldNumber, value);
+      }
+      break;
+  }
+  if (isPacked) {
+    ReverseWriteVarint64(buffer, buffer->length - end);
+    ReverseWriteTag(buffer, fieldNumber, VPKGPBWireFormatLengthDelimited);
+  }
+}
+
+// Writes what -writeToCodedOutputStream: writes, last field first.
+static void ReverseWriteMessageFields(VPKGPBReverseBuffer *buffer, VPKGPBMessage *self) {
+  VPKGPBDescriptor *descriptor = [self descriptor];
+  VPKGPBUnknownFieldSet *unknownFields = self->unknownFields_;
+  if (unknownFields) {
+    BOOL isWireFormat = descriptor.isWireFormat;
+    ReverseWriteForwardEncoded(buffer, ^(VPKGPBCodedOutputStream *output) {
+      if (isWireFormat) {
+        [unknownFields writeAsMessageSetTo:output];
+      } else {
+        [unknownFields writeToCodedOutputStream:output];
+      }
+    });
+  }
+
+  NSArray *fieldsArray = descriptor->fields_;
+  const VPKGPBExtensionRange *extensionRanges = descriptor.extensionRanges;
+  NSArray *sortedExtensions = nil;
+  if (self->extensionMap_.count) {
+    sortedExtensions =
+        [[self->extensionMap_ allKeys] sortedArrayUsingSelector:@selector(compareByFieldNumber:)];
+  }
+  // Unwinds the merge of fields and extension ranges done going forward: a
+  // field follows a range exactly when its number is not below the range's start.
+  for (NSUInteger i = fieldsArray.count, j = descriptor.extensionRangesCount; i > 0 || j > 0;) {
+    if (i > 0 && (j == 0 || VPKGPBFieldNumber(fieldsArray[i - 1]) >= extensionRanges[j - 1].start)) {
+      VPKGPBFieldDescriptor *field = fieldsArray[--i];
+      switch (field.fieldType) {
+        case VPKGPBFieldTypeSingle:
+          ReverseWriteSingleField(buffer, self, field);
+          break;
+        case VPKGPBFieldTypeRepeated:
+          ReverseWriteRepeatedField(buffer, self, field);
+          break;
+        case VPKGPBFieldTypeMap:
+          if ([VPKGPBGetObjectIvarWithFieldNoAutocreate(self, field) count]) {
+            ReverseWriteForwardEncoded(buffer, ^(VPKGPBCodedOutputStream *output) {
+              [self writeField:field toCodedOutputStream:output];
+            });
+          }
+          break;
+      }
+    } else {
+      VPKGPBExtensionRange range = extensionRanges[--j];
+      if (sortedExtensions) {
+        ReverseWriteForwardEncoded(buffer, ^(VPKGPBCodedOutputStream *output) {
+          [self writeExtensionsToCodedOutputStream:output
+                                             range:range
+                                  sortedExtensions:sortedExtensions];
+        });
+      }
+    }
+  }
+}
+
+NSData *VPKGPBMessageDataInOnePass(VPKGPBMessage *message) {
+#ifdef DEBUG
+  if (!message.initialized) {
+    return nil;
+  }
+#endif
+  VPKGPBReverseBuffer buffer = {NULL, 0, 0};
+  @try {
+    ReverseWriteMessageFields(&buffer, message);
+  } @catch (NSException *exception) {
+    free(buffer.bytes);
+    // This really shouldn't happen; the one pass writer has no sizes to get wrong.
+#ifdef DEBUG
+    NSLog(@"%@: Internal exception while building message data: %@", [message class], exception);
+#endif
+    return nil;
+  }
+  if (buffer.length == 0) {
+    free(buffer.bytes);
+    return [NSData data];
+  }
+  // Slide the output to the start so NSData can take the buffer over.
+  memmove(buffer.bytes, buffer.bytes + buffer.capacity - buffer.length, buffer.length);
+  return [[[NSData alloc] initWithBytesNoCopy:buffer.bytes
+                                       length:buffer.length
+                                 freeWhenDone:YES] autorelease];
+}
+
 #pragma clang diagnostic pop
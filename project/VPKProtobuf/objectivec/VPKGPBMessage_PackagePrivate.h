@@ -118,4 +118,27 @@ void VPKGPBAutocreatedDictionaryModified(VPKGPBMessage *self, id dictionary);
 // autocreated reference to this message.
 void VPKGPBClearMessageAutocreator(VPKGPBMessage *self);
 
+// While a write is in progress on the current thread, -serializedSize records
+// the size of every message it visits in a table private to that write, so
+// nested messages are not sized again at every level of nesting. Returns YES
+// if this call started recording, in which case it must be balanced by
+// VPKGPBEndRecordingMessageSizes() once the write is done; NO if an enclosing
+// write on this thread already is.
+BOOL VPKGPBBeginRecordingMessageSizes(void);
+void VPKGPBEndRecordingMessageSizes(void);
+
+// Returns the size recorded for |message| by the write in progress on this
+// thread, sizing (and recording) it if it has not been sized yet.
+size_t VPKGPBRecordedMessageSize(VPKGPBMessage *message);
+
+// Keeps the snapshot of its elements a lazy message array was sized from, for
+// the write in progress on this thread, so the array writes exactly the
+// elements it was sized with even if another thread decodes one in between.
+// Does nothing while no write is in progress.
+void VPKGPBRecordLazyElements(id array, NSArray *elements);
+
+// Returns the snapshot recorded for |array| by the write in progress on this
+// thread, or nil if it was not sized as part of it.
+NSArray *VPKGPBRecordedLazyElements(id array);
+
 CF_EXTERN_C_END
@@ -411,6 +411,49 @@ NSData *VPKGPBEmptyNSData(void) __attribute__((pure));
  **/
 void VPKGPBMessageDropUnknownFieldsRecursively(VPKGPBMessage *message);
 
+/**
+ * Replaces the bytes fields of the given message and all sub messages that
+ * still refer into the data passed to +parseFromAliasedData:extensionRegistry:error:
+ * with copies, so that data can be freed.
+ **/
+void VPKGPBMessageDetachAliasedBytesRecursively(VPKGPBMessage *message);
+
+/**
+ * Clears the given message like -clear, but keeps the sub messages, arrays and
+ * maps of the given fields for parsing into it again, so decoding many
+ * messages of the same shape one after the other into one message stops
+ * allocating once it has seen the largest of them. The sub messages kept are
+ * cleared the same way and reused by the next parse into this message; the
+ * arrays and maps kept are emptied in place.
+ *
+ * Reuse is opt in per field because a kept object is mutated in place: only
+ * list fields whose sub messages, arrays and maps are referenced by nothing
+ * but this message (no references obtained from it and still in use, no
+ * values shared with another message). The objects of any other field are
+ * released as -clear does, leaving references to them untouched. Strings and
+ * bytes are immutable and are always released.
+ *
+ * @param message        The message to clear.
+ * @param reusableFields The fields whose objects may be kept, of the message
+ *                       or of any message type below it. Fields of sub
+ *                       messages only apply to sub messages that are kept
+ *                       themselves.
+ **/
+void VPKGPBMessageClearForReuse(VPKGPBMessage *message,
+                                NSSet<VPKGPBFieldDescriptor *> *reusableFields);
+
+/**
+ * Serializes the given message like -data, but in a single pass: the output
+ * is written from the last field to the first, so each sub message's length
+ * is known once its fields have been written and nothing is sized up front.
+ * This avoids the serializedSize walk that -data makes over deep trees or
+ * trees of many small messages before it writes anything. The bytes are the
+ * same as -data produces.
+ *
+ * @return The serialized message, or nil if it could not be encoded.
+ **/
+NSData *__nullable VPKGPBMessageDataInOnePass(VPKGPBMessage *message);
+
 NS_ASSUME_NONNULL_END
 
 CF_EXTERN_C_END
@@ -33,6 +33,7 @@
 #import <objc/runtime.h>
 
 #import "VPKGPBArray_PackagePrivate.h"
+#import "VPKGPBCodedInputStream_PackagePrivate.h"
 #import "VPKGPBDescriptor_PackagePrivate.h"
 #import "VPKGPBDictionary_PackagePrivate.h"
 #import "VPKGPBMessage_PackagePrivate.h"
@@ -73,6 +74,110 @@ NSData *VPKGPBEmptyNSData(void) {
   return defaultNSData;
 }
 
+// Adds the messages held by the fields and extensions of |msg| to |todo|.
+static void AddSubMessages(VPKGPBMessage *msg, NSMutableArray *todo) {
+  // Handle the message fields.
+  VPKGPBDescriptor *descriptor = [[msg class] descriptor];
+  for (VPKGPBFieldDescriptor *field in descriptor->fields_) {
+    if (!VPKGPBFieldDataTypeIsMessage(field)) {
+      continue;
+    }
+    switch (field.fieldType) {
+      case VPKGPBFieldTypeSingle:
+        if (VPKGPBGetHasIvarField(msg, field)) {
+          VPKGPBMessage *fieldMessage = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
+          [todo addObject:fieldMessage];
+        }
+        break;
+
+      case VPKGPBFieldTypeRepeated: {
+        NSArray *fieldMessages = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
+        if (fieldMessages.count) {
+          [todo addObjectsFromArray:fieldMessages];
+        }
+        break;
+      }
+
+      case VPKGPBFieldTypeMap: {
+        id rawFieldMap = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
+        switch (field.mapKeyDataType) {
+          case VPKGPBDataTypeBool:
+            [(VPKGPBBoolObjectDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused BOOL key, id _Nonnull object,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:object];
+                }];
+            break;
+          case VPKGPBDataTypeFixed32:
+          case VPKGPBDataTypeUInt32:
+            [(VPKGPBUInt32ObjectDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused uint32_t key, id _Nonnull object,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:object];
+                }];
+            break;
+          case VPKGPBDataTypeInt32:
+          case VPKGPBDataTypeSFixed32:
+          case VPKGPBDataTypeSInt32:
+            [(VPKGPBInt32ObjectDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused int32_t key, id _Nonnull object,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:object];
+                }];
+            break;
+          case VPKGPBDataTypeFixed64:
+          case VPKGPBDataTypeUInt64:
+            [(VPKGPBUInt64ObjectDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused uint64_t key, id _Nonnull object,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:object];
+                }];
+            break;
+          case VPKGPBDataTypeInt64:
+          case VPKGPBDataTypeSFixed64:
+          case VPKGPBDataTypeSInt64:
+            [(VPKGPBInt64ObjectDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused int64_t key, id _Nonnull object,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:object];
+                }];
+            break;
+          case VPKGPBDataTypeString:
+            [(NSDictionary *)rawFieldMap
+                enumerateKeysAndObjectsUsingBlock:^(__unused NSString *_Nonnull key,
+                                                    VPKGPBMessage *_Nonnull obj,
+                                                    __unused BOOL *_Nonnull stop) {
+                  [todo addObject:obj];
+                }];
+            break;
+          case VPKGPBDataTypeFloat:
+          case VPKGPBDataTypeDouble:
+          case VPKGPBDataTypeEnum:
+          case VPKGPBDataTypeBytes:
+          case VPKGPBDataTypeGroup:
+          case VPKGPBDataTypeMessage:
+            NSCAssert(NO, @"Aren't valid key types.");
+        }
+        break;
+      }  // switch(field.mapKeyDataType)
+    }    // switch(field.fieldType)
+  }      // for(fields)
+
+  // Handle any extensions holding messages.
+  for (VPKGPBExtensionDescriptor *extension in [msg extensionsCurrentlySet]) {
+    if (!VPKGPBDataTypeIsMessage(extension.dataType)) {
+      continue;
+    }
+    if (extension.isRepeated) {
+      NSArray *extMessages = [msg getExtension:extension];
+      [todo addObjectsFromArray:extMessages];
+    } else {
+      VPKGPBMessage *extMessage = [msg getExtension:extension];
+      [todo addObject:extMessage];
+    }
+  }  // for(extensionsCurrentlySet)
+}
+
 void VPKGPBMessageDropUnknownFieldsRecursively(VPKGPBMessage *initialMessage) {
   if (!initialMessage) {
     return;
@@ -88,107 +193,55 @@ void VPKGPBMessageDropUnknownFieldsRecursively(VPKGPBMessage *initialMessage) {
     // Clear unknowns.
     msg.unknownFields = nil;
 
-    // Handle the message fields.
+    AddSubMessages(msg, todo);
+  }  // while(todo.count)
+}
+
+void VPKGPBMessageDetachAliasedBytesRecursively(VPKGPBMessage *initialMessage) {
+  if (!initialMessage) {
+    return;
+  }
+
+  // Use an array as a list to process to avoid recursion.
+  NSMutableArray *todo = [NSMutableArray arrayWithObject:initialMessage];
+  Class aliasedDataClass = [VPKGPBAliasedData class];
+
+  while (todo.count) {
+    VPKGPBMessage *msg = todo.lastObject;
+    [todo removeLastObject];
+
+    // Swap the aliased bytes for copies. Maps, extensions and unknown fields
+    // never alias, only regular bytes fields do.
     VPKGPBDescriptor *descriptor = [[msg class] descriptor];
     for (VPKGPBFieldDescriptor *field in descriptor->fields_) {
-      if (!VPKGPBFieldDataTypeIsMessage(field)) {
+      if (VPKGPBGetFieldDataType(field) != VPKGPBDataTypeBytes) {
         continue;
       }
-      switch (field.fieldType) {
-        case VPKGPBFieldTypeSingle:
-          if (VPKGPBGetHasIvarField(msg, field)) {
-            VPKGPBMessage *fieldMessage = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
-            [todo addObject:fieldMessage];
-          }
-          break;
-
-        case VPKGPBFieldTypeRepeated: {
-          NSArray *fieldMessages = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
-          if (fieldMessages.count) {
-            [todo addObjectsFromArray:fieldMessages];
-          }
-          break;
+      VPKGPBFieldType fieldType = field.fieldType;
+      if (fieldType == VPKGPBFieldTypeSingle) {
+        if (!VPKGPBGetHasIvarField(msg, field)) {
+          continue;
         }
-
-        case VPKGPBFieldTypeMap: {
-          id rawFieldMap = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
-          switch (field.mapKeyDataType) {
-            case VPKGPBDataTypeBool:
-              [(VPKGPBBoolObjectDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused BOOL key, id _Nonnull object,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:object];
-                  }];
-              break;
-            case VPKGPBDataTypeFixed32:
-            case VPKGPBDataTypeUInt32:
-              [(VPKGPBUInt32ObjectDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused uint32_t key, id _Nonnull object,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:object];
-                  }];
-              break;
-            case VPKGPBDataTypeInt32:
-            case VPKGPBDataTypeSFixed32:
-            case VPKGPBDataTypeSInt32:
-              [(VPKGPBInt32ObjectDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused int32_t key, id _Nonnull object,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:object];
-                  }];
-              break;
-            case VPKGPBDataTypeFixed64:
-            case VPKGPBDataTypeUInt64:
-              [(VPKGPBUInt64ObjectDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused uint64_t key, id _Nonnull object,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:object];
-                  }];
-              break;
-            case VPKGPBDataTypeInt64:
-            case VPKGPBDataTypeSFixed64:
-            case VPKGPBDataTypeSInt64:
-              [(VPKGPBInt64ObjectDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused int64_t key, id _Nonnull object,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:object];
-                  }];
-              break;
-            case VPKGPBDataTypeString:
-              [(NSDictionary *)rawFieldMap
-                  enumerateKeysAndObjectsUsingBlock:^(__unused NSString *_Nonnull key,
-                                                      VPKGPBMessage *_Nonnull obj,
-                                                      __unused BOOL *_Nonnull stop) {
-                    [todo addObject:obj];
-                  }];
-              break;
-            case VPKGPBDataTypeFloat:
-            case VPKGPBDataTypeDouble:
-            case VPKGPBDataTypeEnum:
-            case VPKGPBDataTypeBytes:
-            case VPKGPBDataTypeGroup:
-            case VPKGPBDataTypeMessage:
-              NSCAssert(NO, @"Aren't valid key types.");
+        NSData *value = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
+        if ([value isKindOfClass:aliasedDataClass]) {
+          NSData *copied = [[NSData alloc] initWithBytes:value.bytes length:value.length];
+          VPKGPBSetRetainedObjectIvarWithFieldPrivate(msg, field, copied);
+        }
+      } else if (fieldType == VPKGPBFieldTypeRepeated) {
+        NSMutableArray *values = VPKGPBGetObjectIvarWithFieldNoAutocreate(msg, field);
+        NSUInteger count = values.count;
+        for (NSUInteger i = 0; i < count; ++i) {
+          NSData *value = values[i];
+          if ([value isKindOfClass:aliasedDataClass]) {
+            NSData *copied = [[NSData alloc] initWithBytes:value.bytes length:value.length];
+            [values replaceObjectAtIndex:i withObject:copied];
+            [copied release];
           }
-          break;
-        }  // switch(field.mapKeyDataType)
-      }    // switch(field.fieldType)
-    }      // for(fields)
-
-    // Handle any extensions holding messages.
-    for (VPKGPBExtensionDescriptor *extension in [msg extensionsCurrentlySet]) {
-      if (!VPKGPBDataTypeIsMessage(extension.dataType)) {
-        continue;
-      }
-      if (extension.isRepeated) {
-        NSArray *extMessages = [msg getExtension:extension];
-        [todo addObjectsFromArray:extMessages];
-      } else {
-        VPKGPBMessage *extMessage = [msg getExtension:extension];
-        [todo addObject:extMessage];
+        }
       }
-    }  // for(extensionsCurrentlySet)
+    }  // for(fields)
 
+    AddSubMessages(msg, todo);
   }  // while(todo.count)
 }
 
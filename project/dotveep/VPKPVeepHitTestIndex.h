@@ -0,0 +1,90 @@
+//
+//  VPKPVeepHitTestIndex.h
+//  dotveep
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VPKPVeepTimeIndex.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Immutable index of the rects of a veep's track elements, for finding the
+ * elements under a point at a given time, such as the annotations a viewer
+ * tapped on.
+ *
+ * The index covers the elements of a VPKPVeepTimeIndex whose
+ * discreteTimeRangeRect has a rect, which are hit only while active, and the
+ * elements whose data is a plain rect, which are hit at any time. A rect
+ * contains a point when x <= px < x + width and y <= py < y + height, as
+ * with CGRectContainsPoint(); rects with a negative width or height are
+ * standardized first and rects with a NaN component are not indexed.
+ *
+ * The rects are packed bottom up into a static R-tree whose nodes also hold
+ * the time span of everything below them, so a lookup only descends where
+ * both the point and the time can match.
+ **/
+@interface VPKPVeepHitTestIndex : NSObject
+
+/** The time index the timed elements were taken from. */
+@property(nonatomic, readonly) VPKPVeepTimeIndex *timeIndex;
+
+/** The track elements the index was built from, indexed or not. */
+@property(nonatomic, readonly) NSArray<VPKPVeepTrackElement *> *trackElements;
+
+/** The number of elements with a usable rect, which are indexed. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/**
+ * Builds an index over the track elements of the given veep.
+ *
+ * @param veep The veep to index.
+ **/
+- (instancetype)initWithVeep:(VPKPVeep *)veep;
+
+/**
+ * Builds an index over the track elements of the given time index.
+ *
+ * @param timeIndex The time index to take the elements and their times from.
+ **/
+- (instancetype)initWithTimeIndex:(VPKPVeepTimeIndex *)timeIndex NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Returns the elements whose rect contains the given point and which are
+ * active at the given time.
+ *
+ * @param x    The x coordinate of the point, in the rects' coordinate space.
+ * @param y    The y coordinate of the point, in the rects' coordinate space.
+ * @param time The time to look up.
+ *
+ * @return The elements, in their order in trackElements. Empty if time has no
+ *         positive timescale.
+ **/
+- (NSArray<VPKPVeepTrackElement *> *)elementsContainingPointX:(float)x
+                                                            y:(float)y
+                                                       atTime:(VPKPDiscreteTime *)time;
+
+/**
+ * Calls block for each element whose rect contains the given point and which
+ * is active at the given time, in no particular order, without building an
+ * array.
+ *
+ * @param x     The x coordinate of the point, in the rects' coordinate space.
+ * @param y     The y coordinate of the point, in the rects' coordinate space.
+ * @param time  The time to look up.
+ * @param block The block to call with each element and its index in
+ *              trackElements. Set *stop to YES to stop early.
+ **/
+- (void)enumerateElementsContainingPointX:(float)x
+                                        y:(float)y
+                                   atTime:(VPKPDiscreteTime *)time
+                               usingBlock:(void(NS_NOESCAPE ^)(VPKPVeepTrackElement *element,
+                                                               NSUInteger idx,
+                                                               BOOL *stop))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
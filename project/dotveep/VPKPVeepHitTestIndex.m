@@ -0,0 +1,334 @@
+//
+//  VPKPVeepHitTestIndex.m
+//  dotveep
+//
+
+#import "VPKPVeepHitTestIndex.h"
+
+#import "VPKPVeepTimeIndex_PackagePrivate.h"
+
+// The number of children of each node of the tree. Children are tested
+// together by a branch-free loop the compiler can vectorize.
+#define kNodeSize 16
+// More levels than an NSUInteger number of items can need at kNodeSize.
+#define kMaxLevels 32
+
+// A rect and time span while the tree is being built.
+typedef struct VPKPHitTestItem {
+  float minX;
+  float minY;
+  float maxX;
+  float maxY;
+  int64_t start;
+  int64_t end;
+  NSUInteger elementIndex;
+} VPKPHitTestItem;
+
+// Fills in the bounds of |item| from |rect|. Returns NO if a component is NaN.
+static BOOL ItemBoundsFromRect(VPKPRect *rect, VPKPHitTestItem *item) {
+  float x = rect.x;
+  float y = rect.y;
+  float maxX = x + rect.width;
+  float maxY = y + rect.height;
+  if (isnan(maxX) || isnan(maxY)) {
+    return NO;
+  }
+  item->minX = MIN(x, maxX);
+  item->maxX = MAX(x, maxX);
+  item->minY = MIN(y, maxY);
+  item->maxY = MAX(y, maxY);
+  return YES;
+}
+
+@implementation VPKPVeepHitTestIndex {
+  VPKPVeepTimeIndex *timeIndex_;
+  NSUInteger count_;
+  // Every item and node of the tree, level by level from the items up to the
+  // root, which is last. levelEnds_[l] is where level l ends.
+  NSUInteger nodeCount_;
+  NSUInteger levelCount_;
+  NSUInteger levelEnds_[kMaxLevels];
+  float *minXs_;
+  float *minYs_;
+  float *maxXs_;
+  float *maxYs_;
+  int64_t *starts_;
+  int64_t *ends_;
+  // For items, the index of the element in trackElements; for nodes, the
+  // position of their first child.
+  NSUInteger *indices_;
+}
+
+@synthesize timeIndex = timeIndex_;
+@synthesize count = count_;
+
+- (instancetype)initWithVeep:(VPKPVeep *)veep {
+  VPKPVeepTimeIndex *timeIndex = [[VPKPVeepTimeIndex alloc] initWithVeep:veep];
+  self = [self initWithTimeIndex:timeIndex];
+  [timeIndex release];
+  return self;
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+// Collects the items to index: the active-while-timed elements of the time
+// index, then the always-hit plain rects. Returns the number collected.
+static NSUInteger CollectItems(VPKPVeepTimeIndex *timeIndex, VPKPHitTestItem *items) {
+  NSArray<VPKPVeepTrackElement *> *trackElements = timeIndex.trackElements;
+  const int64_t *startTicks = [timeIndex startTicks];
+  const int64_t *endTicks = [timeIndex endTicks];
+  const NSUInteger *elementIndices = [timeIndex elementIndices];
+  NSUInteger count = 0;
+  for (NSUInteger i = 0; i < timeIndex.count; ++i) {
+    VPKPDiscreteTimeRangeRect *timeRangeRect =
+        trackElements[elementIndices[i]].discreteTimeRangeRect;
+    if (timeRangeRect.hasRect && ItemBoundsFromRect(timeRangeRect.rect, &items[count])) {
+      items[count].start = startTicks[i];
+      items[count].end = endTicks[i];
+      items[count].elementIndex = elementIndices[i];
+      ++count;
+    }
+  }
+  NSUInteger elementCount = trackElements.count;
+  for (NSUInteger i = 0; i < elementCount; ++i) {
+    VPKPVeepTrackElement *element = trackElements[i];
+    if (element.dataOneOfCase == VPKPVeepTrackElement_Data_OneOfCase_Rect &&
+        ItemBoundsFromRect(element.rect, &items[count])) {
+      items[count].start = INT64_MIN;
+      items[count].end = INT64_MAX;
+      items[count].elementIndex = i;
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Orders |items| sort-tile-recursive style: into vertical slices by center x,
+// and each slice by center y, so consecutive runs of kNodeSize are compact.
+static void SortItems(VPKPHitTestItem *items, NSUInteger count) {
+  qsort_b(items, count, sizeof(VPKPHitTestItem), ^int(const void *a, const void *b) {
+    const VPKPHitTestItem *lhs = a;
+    const VPKPHitTestItem *rhs = b;
+    float lhsX = lhs->minX + lhs->maxX;
+    float rhsX = rhs->minX + rhs->maxX;
+    return (lhsX > rhsX) - (lhsX < rhsX);
+  });
+  NSUInteger leafCount = (count + kNodeSize - 1) / kNodeSize;
+  NSUInteger sliceCount = (NSUInteger)ceil(sqrt((double)leafCount));
+  if (sliceCount == 0) {
+    return;
+  }
+  NSUInteger sliceLength = kNodeSize * ((leafCount + sliceCount - 1) / sliceCount);
+  for (NSUInteger lo = 0; lo < count; lo += sliceLength) {
+    qsort_b(&items[lo], MIN(sliceLength, count - lo), sizeof(VPKPHitTestItem),
+            ^int(const void *a, const void *b) {
+              const VPKPHitTestItem *lhs = a;
+              const VPKPHitTestItem *rhs = b;
+              float lhsY = lhs->minY + lhs->maxY;
+              float rhsY = rhs->minY + rhs->maxY;
+              return (lhsY > rhsY) - (lhsY < rhsY);
+            });
+  }
+}
+
+- (instancetype)initWithTimeIndex:(VPKPVeepTimeIndex *)timeIndex {
+  if ((self = [super init])) {
+    timeIndex_ = [timeIndex retain];
+    VPKPHitTestItem *items =
+        malloc(MAX(timeIndex.count + timeIndex.trackElements.count, (NSUInteger)1) *
+               sizeof(VPKPHitTestItem));
+    if (!items) {
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the hit test index"];
+    }
+    NSUInteger count = CollectItems(timeIndex, items);
+    SortItems(items, count);
+    count_ = count;
+
+    NSUInteger nodeCount = count;
+    NSUInteger levelLength = count;
+    if (count) {
+      levelEnds_[levelCount_++] = nodeCount;
+    }
+    while (levelLength > 1) {
+      levelLength = (levelLength + kNodeSize - 1) / kNodeSize;
+      nodeCount += levelLength;
+      levelEnds_[levelCount_++] = nodeCount;
+    }
+    nodeCount_ = nodeCount;
+
+    NSUInteger capacity = MAX(nodeCount, (NSUInteger)1);
+    minXs_ = malloc(capacity * sizeof(float));
+    minYs_ = malloc(capacity * sizeof(float));
+    maxXs_ = malloc(capacity * sizeof(float));
+    maxYs_ = malloc(capacity * sizeof(float));
+    starts_ = malloc(capacity * sizeof(int64_t));
+    ends_ = malloc(capacity * sizeof(int64_t));
+    indices_ = malloc(capacity * sizeof(NSUInteger));
+    if (!minXs_ || !minYs_ || !maxXs_ || !maxYs_ || !starts_ || !ends_ || !indices_) {
+      free(items);
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the hit test index"];
+    }
+    for (NSUInteger i = 0; i < count; ++i) {
+      minXs_[i] = items[i].minX;
+      minYs_[i] = items[i].minY;
+      maxXs_[i] = items[i].maxX;
+      maxYs_[i] = items[i].maxY;
+      starts_[i] = items[i].start;
+      ends_[i] = items[i].end;
+      indices_[i] = items[i].elementIndex;
+    }
+    free(items);
+
+    // Each node bounds the rects and time spans of the run of kNodeSize
+    // entries below it.
+    NSUInteger position = count;
+    for (NSUInteger level = 1; level < levelCount_; ++level) {
+      NSUInteger childEnd = levelEnds_[level - 1];
+      for (NSUInteger child = level > 1 ? levelEnds_[level - 2] : 0; child < childEnd;
+           child += kNodeSize) {
+        NSUInteger last = MIN(child + kNodeSize, childEnd);
+        float minX = minXs_[child];
+        float minY = minYs_[child];
+        float maxX = maxXs_[child];
+        float maxY = maxYs_[child];
+        int64_t start = starts_[child];
+        int64_t end = ends_[child];
+        for (NSUInteger i = child + 1; i < last; ++i) {
+          minX = MIN(minX, minXs_[i]);
+          minY = MIN(minY, minYs_[i]);
+          maxX = MAX(maxX, maxXs_[i]);
+          maxY = MAX(maxY, maxYs_[i]);
+          start = MIN(start, starts_[i]);
+          end = MAX(end, ends_[i]);
+        }
+        minXs_[position] = minX;
+        minYs_[position] = minY;
+        maxXs_[position] = maxX;
+        maxYs_[position] = maxY;
+        starts_[position] = start;
+        ends_[position] = end;
+        indices_[position] = child;
+        ++position;
+      }
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [timeIndex_ release];
+  free(minXs_);
+  free(minYs_);
+  free(maxXs_);
+  free(maxYs_);
+  free(starts_);
+  free(ends_);
+  free(indices_);
+  [super dealloc];
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)trackElements {
+  return timeIndex_.trackElements;
+}
+
+// Returns a mask of which entries in [first, last), at most kNodeSize of
+// them, contain the point and time.
+static uint32_t MatchEntries(VPKPVeepHitTestIndex *self, NSUInteger first, NSUInteger last,
+                             float x, float y, int64_t ticks) {
+  const float *minXs = self->minXs_;
+  const float *minYs = self->minYs_;
+  const float *maxXs = self->maxXs_;
+  const float *maxYs = self->maxYs_;
+  const int64_t *starts = self->starts_;
+  const int64_t *ends = self->ends_;
+  uint32_t matches = 0;
+  for (NSUInteger i = first; i < last; ++i) {
+    matches |= (uint32_t)((minXs[i] <= x) & (x < maxXs[i]) & (minYs[i] <= y) & (y < maxYs[i]) &
+                          (starts[i] <= ticks) & (ticks < ends[i]))
+               << (i - first);
+  }
+  return matches;
+}
+
+// Calls |report| with the element index of every item containing the point
+// at |ticks|, walking down only through the nodes that contain them too.
+static void QueryPoint(VPKPVeepHitTestIndex *self, float x, float y, int64_t ticks,
+                       void (^report)(NSUInteger elementIndex, BOOL *stop)) {
+  if (!self->nodeCount_) {
+    return;
+  }
+  NSUInteger root = self->nodeCount_ - 1;
+  if (!MatchEntries(self, root, root + 1, x, y, ticks)) {
+    return;
+  }
+  BOOL stop = NO;
+  if (self->levelCount_ == 1) {
+    report(self->indices_[root], &stop);
+    return;
+  }
+  // Nodes still to descend into, with their levels. Each pop pushes at most
+  // kNodeSize children one level down, which bounds the depth.
+  NSUInteger stack[kNodeSize * kMaxLevels];
+  NSUInteger stackLevels[kNodeSize * kMaxLevels];
+  NSUInteger depth = 0;
+  stack[depth] = root;
+  stackLevels[depth++] = self->levelCount_ - 1;
+  while (depth) {
+    --depth;
+    NSUInteger node = stack[depth];
+    NSUInteger level = stackLevels[depth];
+    NSUInteger first = self->indices_[node];
+    NSUInteger last = MIN(first + kNodeSize, self->levelEnds_[level - 1]);
+    uint32_t matches = MatchEntries(self, first, last, x, y, ticks);
+    while (matches) {
+      NSUInteger child = first + (NSUInteger)__builtin_ctz(matches);
+      matches &= matches - 1;
+      if (level == 1) {
+        report(self->indices_[child], &stop);
+        if (stop) {
+          return;
+        }
+      } else {
+        stack[depth] = child;
+        stackLevels[depth++] = level - 1;
+      }
+    }
+  }
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)elementsContainingPointX:(float)x
+                                                            y:(float)y
+                                                       atTime:(VPKPDiscreteTime *)time {
+  int64_t ticks;
+  if (![timeIndex_ getTicks:&ticks forTime:time]) {
+    return @[];
+  }
+  NSMutableIndexSet *elementIndices = [NSMutableIndexSet indexSet];
+  QueryPoint(self, x, y, ticks, ^(NSUInteger elementIndex, __unused BOOL *stop) {
+    [elementIndices addIndex:elementIndex];
+  });
+  return [timeIndex_.trackElements objectsAtIndexes:elementIndices];
+}
+
+- (void)enumerateElementsContainingPointX:(float)x
+                                        y:(float)y
+                                   atTime:(VPKPDiscreteTime *)time
+                               usingBlock:(void(NS_NOESCAPE ^)(VPKPVeepTrackElement *element,
+                                                               NSUInteger idx,
+                                                               BOOL *stop))block {
+  int64_t ticks;
+  if (![timeIndex_ getTicks:&ticks forTime:time]) {
+    return;
+  }
+  NSArray<VPKPVeepTrackElement *> *trackElements = timeIndex_.trackElements;
+  QueryPoint(self, x, y, ticks, ^(NSUInteger elementIndex, BOOL *stop) {
+    block(trackElements[elementIndex], elementIndex, stop);
+  });
+}
+
+#pragma clang diagnostic pop
+
+@end
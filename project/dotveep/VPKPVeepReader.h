@@ -0,0 +1,136 @@
+//
+//  VPKPVeepReader.h
+//  dotveep
+//
+
+#import <Foundation/Foundation.h>
+
+#import "Veep.pbobjc.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Incremental reader for the streamable veep layout.
+ *
+ * A veep on the wire is a VeepHeader (field 1) followed by any number of
+ * VeepTrackElements (field 2), which is also the byte layout produced by
+ * concatenating a VPKPVeepHeaderContainer and VPKPVeepTrackElementContainers.
+ * Rather than materialising the whole VPKPVeep, the reader hands back the
+ * header as soon as it has been decoded and then decodes track elements one
+ * at a time (or in batches), so only the elements the caller is holding on to
+ * stay in memory.
+ *
+ * Per protobuf semantics, a header appearing again later in the stream is
+ * merged into the header already read. Unknown fields are skipped.
+ *
+ * As elements are decoded the reader also records each VPKPVeepTrackHeader it
+ * sees by identifier, and resolves the VPKPVeepTrackTag of every later
+ * element against them, so that element's resolvedTrackHeader is available
+ * without any further lookup.
+ *
+ * Once a read fails, every subsequent read returns the same error.
+ **/
+@interface VPKPVeepReader : NSObject
+
+/**
+ * The header read so far, or nil if none has been read yet (or the veep has
+ * no header).
+ **/
+@property(nonatomic, readonly, nullable) VPKPVeepHeader *header;
+
+/** YES once the end of the input has been reached or a read has failed. */
+@property(nonatomic, readonly, getter=isAtEnd) BOOL atEnd;
+
+/**
+ * The track headers carried by the elements decoded so far, by identifier.
+ * When several carry the same identifier, the latest one wins. The
+ * dictionary grows as further elements are read.
+ **/
+@property(nonatomic, readonly) NSDictionary<NSString *, VPKPVeepTrackHeader *> *trackHeaders;
+
+/**
+ * Creates a reader that pulls from the given coded input stream, starting at
+ * its current position.
+ *
+ * @param input The coded input stream to read the veep from.
+ **/
+- (instancetype)initWithCodedInputStream:(VPKGPBCodedInputStream *)input
+    NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Creates a reader that pulls from the given input stream as bytes are needed.
+ *
+ * @param input The input stream to read the veep from.
+ **/
+- (instancetype)initWithInputStream:(NSInputStream *)input;
+
+/**
+ * Creates a reader over an in-memory veep.
+ *
+ * @param data The serialized veep.
+ **/
+- (instancetype)initWithData:(NSData *)data;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Reads up to and including the veep header. If the header has already been
+ * read, returns it without touching the input.
+ *
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return The header, or nil if the veep has no header or an error occurred
+ *         (in which case errorPtr is filled in).
+ **/
+- (nullable VPKPVeepHeader *)readHeader:(NSError **)errorPtr;
+
+/**
+ * Decodes the next track element, reading the header first if it has not yet
+ * been read.
+ *
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return The next track element, or nil at the end of the input (errorPtr is
+ *         set to nil) or if an error occurred (errorPtr is filled in).
+ **/
+- (nullable VPKPVeepTrackElement *)readTrackElement:(NSError **)errorPtr;
+
+/**
+ * Decodes up to maxCount track elements.
+ *
+ * @param maxCount The maximum number of elements to decode.
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return The decoded elements, which is empty only at the end of the input,
+ *         or nil if an error occurred (errorPtr is filled in).
+ **/
+- (nullable NSArray<VPKPVeepTrackElement *> *)readTrackElements:(NSUInteger)maxCount
+                                                          error:(NSError **)errorPtr;
+
+/**
+ * Resolves the track tags of elements that were not decoded by a reader, for
+ * example those of a VPKPVeep parsed whole, the same way a reader would: each
+ * tag against the latest header with its identifier before it in the array.
+ *
+ * @param elements The track elements, in stream order.
+ *
+ * @return The track headers carried by the elements, by identifier.
+ **/
++ (NSDictionary<NSString *, VPKPVeepTrackHeader *> *)resolveTrackHeadersOfElements:
+    (NSArray<VPKPVeepTrackElement *> *)elements;
+
+@end
+
+@interface VPKPVeepTrackElement (VPKPVeepReader)
+
+/**
+ * The track header this element belongs to: its own header if it carries
+ * one, otherwise the header its tag was resolved to by the VPKPVeepReader
+ * that decoded it (or by +[VPKPVeepReader resolveTrackHeadersOfElements:]).
+ * nil if the element has neither, or its tag named no header seen before it.
+ **/
+@property(nonatomic, readonly, nullable) VPKPVeepTrackHeader *resolvedTrackHeader;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,280 @@
+//
+//  VPKPVeepReader.m
+//  dotveep
+//
+
+#import "VPKPVeepReader.h"
+
+#import <objc/runtime.h>
+
+// The address of this variable is used as the key for objc_getAssociatedObject.
+static const char kResolvedTrackHeaderKey = 0;
+
+static NSError *ErrorFromException(NSException *exception) {
+  NSError *error = nil;
+
+  if ([exception.name isEqual:VPKGPBCodedInputStreamException]) {
+    NSDictionary *exceptionInfo = exception.userInfo;
+    error = exceptionInfo[VPKGPBCodedInputStreamUnderlyingErrorKey];
+  }
+
+  if (!error) {
+    NSString *reason = exception.reason;
+    NSDictionary *userInfo = nil;
+    if ([reason length]) {
+      userInfo = @{VPKGPBErrorReasonKey : reason};
+    }
+
+    error = [NSError errorWithDomain:VPKGPBMessageErrorDomain
+                                code:VPKGPBMessageErrorCodeOther
+                            userInfo:userInfo];
+  }
+  return error;
+}
+
+@implementation VPKPVeepReader {
+  VPKGPBCodedInputStream *input_;
+  VPKPVeepHeader *header_;
+  NSMutableDictionary<NSString *, VPKPVeepTrackHeader *> *trackHeaders_;
+  NSError *error_;
+  // A tag already consumed from input_ whose field has not been read yet.
+  int32_t pendingTag_;
+  BOOL headerRead_;
+  BOOL atEnd_;
+}
+
+- (instancetype)initWithCodedInputStream:(VPKGPBCodedInputStream *)input {
+  if ((self = [super init])) {
+    input_ = [input retain];
+    trackHeaders_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (instancetype)initWithInputStream:(NSInputStream *)input {
+  VPKGPBCodedInputStream *codedInput = [[VPKGPBCodedInputStream alloc] initWithInputStream:input];
+  self = [self initWithCodedInputStream:codedInput];
+  [codedInput release];
+  return self;
+}
+
+- (instancetype)initWithData:(NSData *)data {
+  VPKGPBCodedInputStream *codedInput = [[VPKGPBCodedInputStream alloc] initWithData:data];
+  self = [self initWithCodedInputStream:codedInput];
+  [codedInput release];
+  return self;
+}
+
+- (void)dealloc {
+  [input_ release];
+  [header_ release];
+  [trackHeaders_ release];
+  [error_ release];
+  [super dealloc];
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+- (VPKPVeepHeader *)header {
+  return header_;
+}
+
+- (BOOL)isAtEnd {
+  return atEnd_;
+}
+
+- (NSDictionary<NSString *, VPKPVeepTrackHeader *> *)trackHeaders {
+  return trackHeaders_;
+}
+
+// Records the header an element carries, or resolves its tag against those
+// recorded so far, so each identifier is hashed once.
+static void ResolveTrackHeader(VPKPVeepTrackElement *element,
+                               NSMutableDictionary<NSString *, VPKPVeepTrackHeader *> *headers) {
+  switch (element.metaOneOfCase) {
+    case VPKPVeepTrackElement_Meta_OneOfCase_Header: {
+      VPKPVeepTrackHeader *header = element.header;
+      if (header.identifier.length) {
+        headers[header.identifier] = header;
+      }
+      break;
+    }
+    case VPKPVeepTrackElement_Meta_OneOfCase_Tag: {
+      NSString *identifier = element.tag.identifier;
+      VPKPVeepTrackHeader *header = identifier.length ? headers[identifier] : nil;
+      objc_setAssociatedObject(element, &kResolvedTrackHeaderKey, header,
+                               OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static int32_t HeaderTag(void) {
+  return (int32_t)VPKGPBWireFormatMakeTag(VPKPVeep_FieldNumber_Header,
+                                          VPKGPBWireFormatLengthDelimited);
+}
+
+static int32_t TrackElementTag(void) {
+  return (int32_t)VPKGPBWireFormatMakeTag(VPKPVeep_FieldNumber_TrackElementsArray,
+                                          VPKGPBWireFormatLengthDelimited);
+}
+
+// Returns the next tag, or 0 at the end of the input. Raises on malformed input.
+static int32_t NextTag(VPKPVeepReader *self) {
+  int32_t tag = self->pendingTag_;
+  if (tag != 0) {
+    self->pendingTag_ = 0;
+    return tag;
+  }
+  tag = [self->input_ readTag];
+  if (tag == 0) {
+    self->atEnd_ = YES;
+  }
+  return tag;
+}
+
+static void ReadHeaderField(VPKPVeepReader *self) {
+  if (self->header_ == nil) {
+    self->header_ = [[VPKPVeepHeader alloc] init];
+  }
+  [self->input_ readMessage:self->header_ extensionRegistry:nil];
+}
+
+// Consumes fields until a track element has been decoded or, when stopAtHeader
+// is set, until the first header has been read. Returns nil at the end of the
+// input. Raises on malformed input.
+static VPKPVeepTrackElement *ReadNext(VPKPVeepReader *self, BOOL stopAtHeader) {
+  const int32_t headerTag = HeaderTag();
+  const int32_t trackElementTag = TrackElementTag();
+  while (!self->atEnd_) {
+    int32_t tag = NextTag(self);
+    if (tag == 0) {
+      break;
+    }
+    if (tag == headerTag) {
+      ReadHeaderField(self);
+      self->headerRead_ = YES;
+      if (stopAtHeader) {
+        break;
+      }
+    } else if (tag == trackElementTag) {
+      if (stopAtHeader) {
+        // The veep has no leading header; leave the element for the next read.
+        self->pendingTag_ = tag;
+        self->headerRead_ = YES;
+        break;
+      }
+      VPKPVeepTrackElement *element = [[[VPKPVeepTrackElement alloc] init] autorelease];
+      [self->input_ readMessage:element extensionRegistry:nil];
+      ResolveTrackHeader(element, self->trackHeaders_);
+      return element;
+    } else if (![self->input_ skipField:tag]) {
+      // A stray end group tag; there is nothing more to read at this level.
+      self->atEnd_ = YES;
+    }
+  }
+  return nil;
+}
+
+static BOOL CheckFailed(VPKPVeepReader *self, NSError **errorPtr) {
+  if (self->error_) {
+    if (errorPtr) {
+      *errorPtr = self->error_;
+    }
+    return YES;
+  }
+  if (errorPtr) {
+    *errorPtr = nil;
+  }
+  return NO;
+}
+
+static void RecordFailure(VPKPVeepReader *self, NSException *exception, NSError **errorPtr) {
+  [self->error_ release];
+  self->error_ = [ErrorFromException(exception) retain];
+  self->atEnd_ = YES;
+  self->pendingTag_ = 0;
+  if (errorPtr) {
+    *errorPtr = self->error_;
+  }
+}
+
+- (VPKPVeepHeader *)readHeader:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return nil;
+  }
+  if (!headerRead_) {
+    @try {
+      ReadNext(self, YES);
+    } @catch (NSException *exception) {
+      RecordFailure(self, exception, errorPtr);
+      return nil;
+    }
+  }
+  return header_;
+}
+
+- (VPKPVeepTrackElement *)readTrackElement:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return nil;
+  }
+  @try {
+    return ReadNext(self, NO);
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return nil;
+  }
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)readTrackElements:(NSUInteger)maxCount
+                                                 error:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return nil;
+  }
+  NSMutableArray<VPKPVeepTrackElement *> *elements = [NSMutableArray array];
+  @try {
+    while (elements.count < maxCount) {
+      VPKPVeepTrackElement *element = ReadNext(self, NO);
+      if (element == nil) {
+        break;
+      }
+      [elements addObject:element];
+    }
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return nil;
+  }
+  return elements;
+}
+
++ (NSDictionary<NSString *, VPKPVeepTrackHeader *> *)resolveTrackHeadersOfElements:
+    (NSArray<VPKPVeepTrackElement *> *)elements {
+  NSMutableDictionary<NSString *, VPKPVeepTrackHeader *> *headers =
+      [NSMutableDictionary dictionary];
+  for (VPKPVeepTrackElement *element in elements) {
+    ResolveTrackHeader(element, headers);
+  }
+  return headers;
+}
+
+#pragma clang diagnostic pop
+
+@end
+
+@implementation VPKPVeepTrackElement (VPKPVeepReader)
+
+- (VPKPVeepTrackHeader *)resolvedTrackHeader {
+  switch (self.metaOneOfCase) {
+    case VPKPVeepTrackElement_Meta_OneOfCase_Header:
+      return self.header;
+    case VPKPVeepTrackElement_Meta_OneOfCase_Tag:
+      return objc_getAssociatedObject(self, &kResolvedTrackHeaderKey);
+    default:
+      return nil;
+  }
+}
+
+@end
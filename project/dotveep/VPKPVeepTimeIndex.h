@@ -0,0 +1,149 @@
+//
+//  VPKPVeepTimeIndex.h
+//  dotveep
+//
+
+#import <Foundation/Foundation.h>
+
+#import "Veep.pbobjc.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class VPKPVeepTimeIndexCursor;
+
+/**
+ * Immutable index of the track elements of a veep by the time range of their
+ * discreteTimeRangeRect, for finding the elements active at a given time
+ * without scanning them all.
+ *
+ * An element is active at time t when start <= t < start + duration, as with
+ * CMTimeRangeContainsTime(). Elements without a discreteTimeRangeRect, or
+ * whose start or duration has no positive timescale or whose duration is
+ * negative, are not indexed.
+ *
+ * Every start and end is converted once, when the index is built, to int64
+ * ticks of a single timescale, so lookups compare plain integers whatever mix
+ * of timescales the elements use.
+ *
+ * The time line is cut into windows, each listing the elements active
+ * somewhere in it, with no list longer than twice the number of elements
+ * active at any time in its window (or than two). A lookup finds the window
+ * by binary search and filters its list, and the lists take O(n) memory in
+ * all.
+ *
+ * The index reflects the elements as they were when it was built; changing
+ * an element's time range afterwards does not update it. An index and its
+ * cursors may be used from any thread, but a single cursor may not be used
+ * from several threads at once.
+ **/
+@interface VPKPVeepTimeIndex : NSObject
+
+/** The track elements the index was built from, indexed or not. */
+@property(nonatomic, readonly) NSArray<VPKPVeepTrackElement *> *trackElements;
+
+/** The number of elements with a usable time range, which are indexed. */
+@property(nonatomic, readonly) NSUInteger count;
+
+/**
+ * The timescale of the ticks the index holds its times in. This is the least
+ * common multiple of the elements' timescales, which keeps every time exact,
+ * unless that or one of the times would not fit in int64. The index then
+ * falls back to the largest of the timescales, widening each element outward
+ * to whole ticks, and drops elements whose times still do not fit.
+ **/
+@property(nonatomic, readonly) int64_t timescale;
+
+/**
+ * Builds an index over the track elements of the given veep.
+ *
+ * @param veep The veep to index.
+ **/
+- (instancetype)initWithVeep:(VPKPVeep *)veep;
+
+/**
+ * Builds an index over the given track elements.
+ *
+ * @param trackElements The elements to index.
+ **/
+- (instancetype)initWithTrackElements:(NSArray<VPKPVeepTrackElement *> *)trackElements
+    NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Returns the elements active at the given time, in O(log n + k) for k
+ * results.
+ *
+ * @param time The time to look up.
+ *
+ * @return The active elements, ordered by start time (ties keep their order
+ *         in trackElements). Empty if time has no positive timescale.
+ **/
+- (NSArray<VPKPVeepTrackElement *> *)elementsActiveAtTime:(VPKPDiscreteTime *)time;
+
+/**
+ * Returns the elements active at some point in the given time range, in
+ * O(log n + k) for k results. An empty range finds the elements active at its
+ * start.
+ *
+ * @param timeRange The time range to look up.
+ *
+ * @return The elements, ordered by start time (ties keep their order in
+ *         trackElements). Empty if timeRange is not a usable time range.
+ **/
+- (NSArray<VPKPVeepTrackElement *> *)elementsIntersectingTimeRange:
+    (VPKPDiscreteTimeRange *)timeRange;
+
+/**
+ * Returns a new cursor over the index, for tracking the active elements as
+ * playback moves forward.
+ **/
+- (VPKPVeepTimeIndexCursor *)cursor;
+
+@end
+
+/**
+ * Tracks the elements of a VPKPVeepTimeIndex active at a current time.
+ *
+ * Moving the cursor forward only visits the elements that start or end
+ * between the old and the new time, which for playback advancing frame by
+ * frame is amortized O(1) per move. Moving it backward looks the new time up
+ * from scratch, in O(log n + k).
+ **/
+@interface VPKPVeepTimeIndexCursor : NSObject
+
+/** The index the cursor runs over. */
+@property(nonatomic, readonly) VPKPVeepTimeIndex *index;
+
+/** The number of elements active at the current time. */
+@property(nonatomic, readonly) NSUInteger activeElementCount;
+
+/**
+ * The elements active at the current time, in no particular order. Empty
+ * until the cursor is first moved.
+ **/
+@property(nonatomic, readonly) NSArray<VPKPVeepTrackElement *> *activeElements;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Moves the cursor to the given time. A time without a positive timescale
+ * leaves no elements active.
+ *
+ * @param time The new current time.
+ **/
+- (void)moveToTime:(VPKPDiscreteTime *)time;
+
+/**
+ * Calls block for each element active at the current time, in no particular
+ * order, without building an array.
+ *
+ * @param block The block to call with each element and its index in the
+ *              index's trackElements. Set *stop to YES to stop early.
+ **/
+- (void)enumerateActiveElementsUsingBlock:
+    (void(NS_NOESCAPE ^)(VPKPVeepTrackElement *element, NSUInteger idx, BOOL *stop))block;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,684 @@
+//
+//  VPKPVeepTimeIndex.m
+//  dotveep
+//
+
+#import "VPKPVeepTimeIndex_PackagePrivate.h"
+
+// A window's list holds at most this many times the number of intervals
+// active at any time in the window (or this many, if none are), which bounds
+// a lookup's scan by its results. Larger factors make fewer windows with
+// longer lists. Each window is closed only once enough of its intervals start
+// or end inside it, so all the lists together hold at most
+// 2 * factor / (factor - 1) positions per interval (Chazelle's filtering
+// search).
+#define kWindowDensity 2
+
+// A time range as it appears in a VPKPDiscreteTimeRange, timescales positive.
+typedef struct VPKPTimeRange {
+  int64_t startValue;
+  int64_t startTimescale;
+  int64_t durationValue;
+  int64_t durationTimescale;
+} VPKPTimeRange;
+
+// An element's [start, end) in ticks and where it is in the index's
+// trackElements.
+typedef struct VPKPTickInterval {
+  int64_t start;
+  int64_t end;
+  NSUInteger elementIndex;
+} VPKPTickInterval;
+
+static BOOL TimeRangeFromDiscreteTimeRange(VPKPDiscreteTimeRange *timeRange,
+                                           VPKPTimeRange *range) {
+  VPKPDiscreteTime *start = timeRange.start;
+  VPKPDiscreteTime *duration = timeRange.duration;
+  if (start.timescale <= 0 || duration.timescale <= 0 || duration.value < 0) {
+    return NO;
+  }
+  range->startValue = start.value;
+  range->startTimescale = start.timescale;
+  range->durationValue = duration.value;
+  range->durationTimescale = duration.timescale;
+  return YES;
+}
+
+static int64_t GreatestCommonDivisor(int64_t a, int64_t b) {
+  while (b) {
+    int64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// Folds |timescale| into the least common multiple in |*multiple|. Returns NO
+// if the result does not fit.
+static BOOL AccumulateCommonMultiple(int64_t timescale, int64_t *multiple) {
+  int64_t factor = timescale / GreatestCommonDivisor(*multiple, timescale);
+  return !__builtin_mul_overflow(*multiple, factor, multiple);
+}
+
+// Returns floor(value * timescale / fromTimescale), storing the remainder of
+// the division in |*remainder|. value * timescale always fits in 128 bits.
+static __int128 ScaleToTicks(int64_t value, int64_t fromTimescale, int64_t timescale,
+                             int64_t *remainder) {
+  __int128 scaled = (__int128)value * timescale;
+  __int128 quotient = scaled / fromTimescale;
+  __int128 rest = scaled % fromTimescale;
+  if (rest < 0) {
+    --quotient;
+    rest += fromTimescale;
+  }
+  *remainder = (int64_t)rest;
+  return quotient;
+}
+
+// Converts |range| to ticks of |timescale|, rounding its start down and its
+// end up so the ticks cover it. Both are exact when |timescale| is a multiple
+// of the range's timescales.
+static void RangeToTicks(const VPKPTimeRange *range, int64_t timescale, __int128 *start,
+                         __int128 *end) {
+  int64_t startRemainder;
+  int64_t durationRemainder;
+  *start = ScaleToTicks(range->startValue, range->startTimescale, timescale, &startRemainder);
+  *end = *start + ScaleToTicks(range->durationValue, range->durationTimescale, timescale,
+                               &durationRemainder);
+  // The two fractional parts add up to numerator / denominator, in [0, 2).
+  // Both timescales came from int32 fields, so none of this overflows.
+  int64_t numerator =
+      startRemainder * range->durationTimescale + durationRemainder * range->startTimescale;
+  int64_t denominator = range->startTimescale * range->durationTimescale;
+  if (numerator > denominator) {
+    *end += 2;
+  } else if (numerator > 0) {
+    *end += 1;
+  }
+}
+
+static BOOL FitsInTicks(__int128 ticks) {
+  return ticks >= INT64_MIN && ticks <= INT64_MAX;
+}
+
+static int64_t ClampToTicks(__int128 ticks) {
+  return ticks > INT64_MAX ? INT64_MAX : ticks < INT64_MIN ? INT64_MIN : (int64_t)ticks;
+}
+
+// Converts the ranges to tick intervals of |timescale|, dropping those that
+// do not fit. Returns the number kept, or NSNotFound if |stopOnOverflow| and
+// one did not fit.
+static NSUInteger RangesToTickIntervals(const VPKPTimeRange *ranges,
+                                        const NSUInteger *elementIndices, NSUInteger count,
+                                        int64_t timescale, BOOL stopOnOverflow,
+                                        VPKPTickInterval *intervals) {
+  NSUInteger kept = 0;
+  for (NSUInteger i = 0; i < count; ++i) {
+    __int128 start;
+    __int128 end;
+    RangeToTicks(&ranges[i], timescale, &start, &end);
+    if (!FitsInTicks(start) || !FitsInTicks(end)) {
+      if (stopOnOverflow) {
+        return NSNotFound;
+      }
+      continue;
+    }
+    intervals[kept].start = (int64_t)start;
+    intervals[kept].end = (int64_t)end;
+    intervals[kept].elementIndex = elementIndices[i];
+    ++kept;
+  }
+  return kept;
+}
+
+@interface VPKPVeepTimeIndexCursor ()
+- (instancetype)initWithIndex:(VPKPVeepTimeIndex *)index;
+@end
+
+@implementation VPKPVeepTimeIndex {
+ @package
+  NSArray<VPKPVeepTrackElement *> *trackElements_;
+  NSUInteger count_;
+  int64_t timescale_;
+  // The intervals sorted by start, then by element index, split into
+  // parallel arrays so scans only touch the ticks they compare.
+  int64_t *starts_;
+  int64_t *ends_;
+  NSUInteger *elementIndices_;
+  // Positions in the sorted intervals ordered by end, for cursors.
+  NSUInteger *byEnd_;
+  // The time line cut into windows, window i covering the ticks from
+  // windowStarts_[i] up to the next window's start; the first starts at
+  // INT64_MIN. Window i lists, in windowPositions_ from
+  // windowOffsets_[i] to windowOffsets_[i + 1], the positions of the
+  // non-empty intervals active somewhere in it, in ascending order. Every
+  // list is at most kWindowDensity times longer than the number of intervals
+  // active at any time in its window (or kWindowDensity long), so filtering
+  // one finds the intervals active at a time in O(1 + k) for k results.
+  NSUInteger windowCount_;
+  int64_t *windowStarts_;
+  NSUInteger *windowOffsets_;
+  NSUInteger *windowPositions_;
+}
+
+@synthesize trackElements = trackElements_;
+@synthesize count = count_;
+@synthesize timescale = timescale_;
+
+- (instancetype)initWithVeep:(VPKPVeep *)veep {
+  return [self initWithTrackElements:veep.trackElementsArray];
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+// A growable list of positions, for building the windows.
+typedef struct VPKPPositionList {
+  NSUInteger *positions;
+  NSUInteger count;
+  NSUInteger capacity;
+} VPKPPositionList;
+
+static BOOL PositionListReserve(VPKPPositionList *list, NSUInteger extra) {
+  if (list->capacity - list->count >= extra) {
+    return YES;
+  }
+  NSUInteger capacity = MAX(list->capacity * 2, list->count + extra);
+  NSUInteger *positions = realloc(list->positions, capacity * sizeof(NSUInteger));
+  if (!positions) {
+    return NO;
+  }
+  list->positions = positions;
+  list->capacity = capacity;
+  return YES;
+}
+
+// Sorts the list of the window being closed and records where it ends.
+static void CloseWindow(VPKPVeepTimeIndex *self, VPKPPositionList *lists) {
+  NSUInteger begin = self->windowOffsets_[self->windowCount_];
+  qsort_b(lists->positions + begin, lists->count - begin, sizeof(NSUInteger),
+          ^int(const void *a, const void *b) {
+            NSUInteger lhs = *(const NSUInteger *)a;
+            NSUInteger rhs = *(const NSUInteger *)b;
+            return (lhs > rhs) - (lhs < rhs);
+          });
+  self->windowOffsets_[++self->windowCount_] = lists->count;
+}
+
+// Builds the windows by sweeping the distinct starts and ends in order,
+// keeping the set of active intervals. A window grows while its list, the
+// intervals active at its start plus those starting inside it, stays within
+// kWindowDensity times the fewest intervals active at any time in it; the
+// first time that would fail a new window starts, listing the intervals
+// active there. Returns NO if an allocation failed.
+static BOOL BuildWindows(VPKPVeepTimeIndex *self) {
+  NSUInteger count = self->count_;
+  const int64_t *starts = self->starts_;
+  const int64_t *ends = self->ends_;
+  const NSUInteger *byEnd = self->byEnd_;
+  // Each distinct start or end can begin a window, plus the first one.
+  NSUInteger maxWindows = 2 * count + 1;
+  self->windowStarts_ = malloc(maxWindows * sizeof(int64_t));
+  self->windowOffsets_ = malloc((maxWindows + 1) * sizeof(NSUInteger));
+  NSUInteger *active = malloc(MAX(count, (NSUInteger)1) * sizeof(NSUInteger));
+  NSUInteger *activeSlots = malloc(MAX(count, (NSUInteger)1) * sizeof(NSUInteger));
+  VPKPPositionList lists = {NULL, 0, 0};
+  BOOL ok = self->windowStarts_ && self->windowOffsets_ && active && activeSlots &&
+            PositionListReserve(&lists, count);
+  if (ok) {
+    NSUInteger activeCount = 0;
+    NSUInteger fewestActive = 0;
+    self->windowStarts_[0] = INT64_MIN;
+    self->windowOffsets_[0] = 0;
+    NSUInteger nextStart = 0;
+    NSUInteger nextEnd = 0;
+    while (ok && (nextStart < count || nextEnd < count)) {
+      int64_t ticks = nextStart < count ? starts[nextStart] : INT64_MAX;
+      if (nextEnd < count) {
+        ticks = MIN(ticks, ends[byEnd[nextEnd]]);
+      }
+      // Intervals ending here stop being active before those starting here
+      // start. An empty interval is never active, so never listed.
+      for (; nextEnd < count && ends[byEnd[nextEnd]] == ticks; ++nextEnd) {
+        NSUInteger position = byEnd[nextEnd];
+        if (starts[position] < ends[position]) {
+          NSUInteger slot = activeSlots[position];
+          NSUInteger last = active[--activeCount];
+          active[slot] = last;
+          activeSlots[last] = slot;
+        }
+      }
+      NSUInteger listCount = lists.count;
+      for (; nextStart < count && starts[nextStart] == ticks; ++nextStart) {
+        if (ends[nextStart] > ticks) {
+          if (!PositionListReserve(&lists, 1)) {
+            ok = NO;
+            break;
+          }
+          activeSlots[nextStart] = activeCount;
+          active[activeCount++] = nextStart;
+          lists.positions[lists.count++] = nextStart;
+        }
+      }
+      if (!ok) {
+        break;
+      }
+      NSUInteger windowLength = lists.count - self->windowOffsets_[self->windowCount_];
+      NSUInteger fewest = MIN(fewestActive, activeCount);
+      if (windowLength <= kWindowDensity * MAX(fewest, (NSUInteger)1)) {
+        fewestActive = fewest;
+        continue;
+      }
+      // Too sparse: end the window before |ticks| and start the next one at
+      // it with just the intervals active there.
+      lists.count = listCount;
+      CloseWindow(self, &lists);
+      self->windowStarts_[self->windowCount_] = ticks;
+      ok = PositionListReserve(&lists, activeCount);
+      if (ok) {
+        memcpy(lists.positions + lists.count, active, activeCount * sizeof(NSUInteger));
+        lists.count += activeCount;
+      }
+      fewestActive = activeCount;
+    }
+    if (ok) {
+      CloseWindow(self, &lists);
+    }
+  }
+  free(active);
+  free(activeSlots);
+  self->windowPositions_ = lists.positions;
+  return ok;
+}
+
+- (instancetype)initWithTrackElements:(NSArray<VPKPVeepTrackElement *> *)trackElements {
+  if ((self = [super init])) {
+    trackElements_ = [trackElements copy];
+    NSUInteger elementCount = trackElements_.count;
+    NSUInteger capacity = MAX(elementCount, (NSUInteger)1);
+    VPKPTimeRange *ranges = malloc(capacity * sizeof(VPKPTimeRange));
+    NSUInteger *rangeElementIndices = malloc(capacity * sizeof(NSUInteger));
+    VPKPTickInterval *intervals = malloc(capacity * sizeof(VPKPTickInterval));
+    if (!ranges || !rangeElementIndices || !intervals) {
+      free(ranges);
+      free(rangeElementIndices);
+      free(intervals);
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the time index"];
+    }
+
+    // Pick the tick base: the least common multiple of every timescale, so
+    // all ticks are exact, unless it or some tick would not fit in int64.
+    NSUInteger rangeCount = 0;
+    int64_t commonMultiple = 1;
+    int64_t largestTimescale = 1;
+    BOOL haveCommonMultiple = YES;
+    for (NSUInteger i = 0; i < elementCount; ++i) {
+      VPKPVeepTrackElement *element = trackElements_[i];
+      if (element.dataOneOfCase != VPKPVeepTrackElement_Data_OneOfCase_DiscreteTimeRangeRect ||
+          !element.discreteTimeRangeRect.hasTimeRange) {
+        continue;
+      }
+      VPKPTimeRange *range = &ranges[rangeCount];
+      if (!TimeRangeFromDiscreteTimeRange(element.discreteTimeRangeRect.timeRange, range)) {
+        continue;
+      }
+      rangeElementIndices[rangeCount++] = i;
+      largestTimescale = MAX(largestTimescale, MAX(range->startTimescale, range->durationTimescale));
+      haveCommonMultiple = haveCommonMultiple &&
+                           AccumulateCommonMultiple(range->startTimescale, &commonMultiple) &&
+                           AccumulateCommonMultiple(range->durationTimescale, &commonMultiple);
+    }
+    NSUInteger count = NSNotFound;
+    if (haveCommonMultiple) {
+      timescale_ = commonMultiple;
+      count = RangesToTickIntervals(ranges, rangeElementIndices, rangeCount, timescale_, YES,
+                                    intervals);
+    }
+    if (count == NSNotFound) {
+      timescale_ = largestTimescale;
+      count = RangesToTickIntervals(ranges, rangeElementIndices, rangeCount, timescale_, NO,
+                                    intervals);
+    }
+    free(ranges);
+    free(rangeElementIndices);
+    count_ = count;
+
+    qsort_b(intervals, count, sizeof(VPKPTickInterval), ^int(const void *a, const void *b) {
+      const VPKPTickInterval *lhs = a;
+      const VPKPTickInterval *rhs = b;
+      if (lhs->start != rhs->start) {
+        return lhs->start < rhs->start ? -1 : 1;
+      }
+      return (lhs->elementIndex > rhs->elementIndex) - (lhs->elementIndex < rhs->elementIndex);
+    });
+
+    capacity = MAX(count, (NSUInteger)1);
+    starts_ = malloc(capacity * sizeof(int64_t));
+    ends_ = malloc(capacity * sizeof(int64_t));
+    elementIndices_ = malloc(capacity * sizeof(NSUInteger));
+    byEnd_ = malloc(capacity * sizeof(NSUInteger));
+    if (!starts_ || !ends_ || !elementIndices_ || !byEnd_) {
+      free(intervals);
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the time index"];
+    }
+    for (NSUInteger i = 0; i < count; ++i) {
+      starts_[i] = intervals[i].start;
+      ends_[i] = intervals[i].end;
+      elementIndices_[i] = intervals[i].elementIndex;
+      byEnd_[i] = i;
+    }
+    free(intervals);
+    const int64_t *ends = ends_;
+    qsort_b(byEnd_, count, sizeof(NSUInteger), ^int(const void *a, const void *b) {
+      NSUInteger lhs = *(const NSUInteger *)a;
+      NSUInteger rhs = *(const NSUInteger *)b;
+      if (ends[lhs] != ends[rhs]) {
+        return ends[lhs] < ends[rhs] ? -1 : 1;
+      }
+      return (lhs > rhs) - (lhs < rhs);
+    });
+    if (!BuildWindows(self)) {
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the time index"];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [trackElements_ release];
+  free(starts_);
+  free(ends_);
+  free(elementIndices_);
+  free(byEnd_);
+  free(windowStarts_);
+  free(windowOffsets_);
+  free(windowPositions_);
+  [super dealloc];
+}
+
+// Returns |time| in ticks, rounded down, which keeps start <= time < end
+// exact for whole tick starts and ends. Returns NO if |time| has no positive
+// timescale.
+static BOOL TicksForTime(VPKPVeepTimeIndex *self, VPKPDiscreteTime *time, int64_t *ticks) {
+  if (time.timescale <= 0) {
+    return NO;
+  }
+  int64_t remainder;
+  *ticks = ClampToTicks(ScaleToTicks(time.value, time.timescale, self->timescale_, &remainder));
+  return YES;
+}
+
+// Returns how many intervals start at or before |ticks|, which is also the
+// position of the first one starting after it.
+static NSUInteger CountStartsThrough(VPKPVeepTimeIndex *self, int64_t ticks) {
+  const int64_t *starts = self->starts_;
+  NSUInteger lo = 0;
+  NSUInteger hi = self->count_;
+  while (lo < hi) {
+    NSUInteger mid = lo + (hi - lo) / 2;
+    if (starts[mid] <= ticks) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Calls |report|, in ascending order, with the position of every interval
+// active at |ticks|: a binary search for the window holding |ticks|, then a
+// filter of its list, in O(log n + k) for k results.
+static void StabIntervals(VPKPVeepTimeIndex *self, int64_t ticks,
+                          void (^report)(NSUInteger position)) {
+  const int64_t *windowStarts = self->windowStarts_;
+  NSUInteger lo = 1;
+  NSUInteger hi = self->windowCount_;
+  while (lo < hi) {
+    NSUInteger mid = lo + (hi - lo) / 2;
+    if (windowStarts[mid] <= ticks) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  NSUInteger window = lo - 1;
+  const int64_t *starts = self->starts_;
+  const int64_t *ends = self->ends_;
+  const NSUInteger *positions = self->windowPositions_;
+  for (NSUInteger i = self->windowOffsets_[window]; i < self->windowOffsets_[window + 1]; ++i) {
+    NSUInteger position = positions[i];
+    if (starts[position] <= ticks && ends[position] > ticks) {
+      report(position);
+    }
+  }
+}
+
+static NSArray<VPKPVeepTrackElement *> *ElementsInIntervals(VPKPVeepTimeIndex *self,
+                                                            int64_t after, int64_t lastStart) {
+  NSMutableArray<VPKPVeepTrackElement *> *result = [NSMutableArray array];
+  NSArray<VPKPVeepTrackElement *> *trackElements = self->trackElements_;
+  const NSUInteger *elementIndices = self->elementIndices_;
+  const int64_t *starts = self->starts_;
+  const int64_t *ends = self->ends_;
+  // The intervals active at |after| all start at or before it, so they come
+  // before those starting after it, all of which end after it too unless
+  // they are empty, which are never active.
+  StabIntervals(self, after, ^(NSUInteger position) {
+    [result addObject:trackElements[elementIndices[position]]];
+  });
+  NSUInteger end = CountStartsThrough(self, lastStart);
+  for (NSUInteger position = CountStartsThrough(self, after); position < end; ++position) {
+    if (starts[position] < ends[position]) {
+      [result addObject:trackElements[elementIndices[position]]];
+    }
+  }
+  return result;
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)elementsActiveAtTime:(VPKPDiscreteTime *)time {
+  int64_t ticks;
+  if (!TicksForTime(self, time, &ticks)) {
+    return @[];
+  }
+  return ElementsInIntervals(self, ticks, ticks);
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)elementsIntersectingTimeRange:
+    (VPKPDiscreteTimeRange *)timeRange {
+  VPKPTimeRange range;
+  if (!TimeRangeFromDiscreteTimeRange(timeRange, &range)) {
+    return @[];
+  }
+  __int128 start;
+  __int128 end;
+  RangeToTicks(&range, timescale_, &start, &end);
+  int64_t after = ClampToTicks(start);
+  if (range.durationValue == 0) {
+    return ElementsInIntervals(self, after, after);
+  }
+  // The range rounds out to whole ticks, and an interval starting before
+  // ceil(end) starts before end itself.
+  return ElementsInIntervals(self, after, ClampToTicks(end - 1));
+}
+
+- (const int64_t *)startTicks {
+  return starts_;
+}
+
+- (const int64_t *)endTicks {
+  return ends_;
+}
+
+- (const NSUInteger *)elementIndices {
+  return elementIndices_;
+}
+
+- (BOOL)getTicks:(int64_t *)ticks forTime:(VPKPDiscreteTime *)time {
+  return TicksForTime(self, time, ticks);
+}
+
+- (VPKPVeepTimeIndexCursor *)cursor {
+  return [[[VPKPVeepTimeIndexCursor alloc] initWithIndex:self] autorelease];
+}
+
+#pragma clang diagnostic pop
+
+@end
+
+@implementation VPKPVeepTimeIndexCursor {
+  VPKPVeepTimeIndex *index_;
+  int64_t ticks_;
+  BOOL hasTime_;
+  // How many intervals, in start order, start at or before ticks_.
+  NSUInteger startsPassed_;
+  // How many intervals, in end order, end at or before ticks_.
+  NSUInteger endsPassed_;
+  // The positions of the active intervals, unordered, and where each
+  // interval is in it (or NSNotFound), so either end of an interval is O(1).
+  NSUInteger *active_;
+  NSUInteger activeCount_;
+  NSUInteger *activeSlots_;
+}
+
+@synthesize index = index_;
+@synthesize activeElementCount = activeCount_;
+
+- (instancetype)initWithIndex:(VPKPVeepTimeIndex *)index {
+  if ((self = [super init])) {
+    index_ = [index retain];
+    NSUInteger count = MAX(index.count, (NSUInteger)1);
+    active_ = malloc(count * sizeof(NSUInteger));
+    activeSlots_ = malloc(count * sizeof(NSUInteger));
+    if (!active_ || !activeSlots_) {
+      [self release];
+      [NSException raise:NSMallocException format:@"Failed to allocate the time index cursor"];
+    }
+    for (NSUInteger i = 0; i < index.count; ++i) {
+      activeSlots_[i] = NSNotFound;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [index_ release];
+  free(active_);
+  free(activeSlots_);
+  [super dealloc];
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+static void AddActive(VPKPVeepTimeIndexCursor *self, NSUInteger position) {
+  self->activeSlots_[position] = self->activeCount_;
+  self->active_[self->activeCount_++] = position;
+}
+
+static void RemoveActive(VPKPVeepTimeIndexCursor *self, NSUInteger position) {
+  NSUInteger slot = self->activeSlots_[position];
+  NSUInteger last = self->active_[--self->activeCount_];
+  self->active_[slot] = last;
+  self->activeSlots_[last] = slot;
+  self->activeSlots_[position] = NSNotFound;
+}
+
+static void ClearActive(VPKPVeepTimeIndexCursor *self) {
+  for (NSUInteger i = 0; i < self->activeCount_; ++i) {
+    self->activeSlots_[self->active_[i]] = NSNotFound;
+  }
+  self->activeCount_ = 0;
+}
+
+// Looks |ticks| up from scratch: binary searches both orders for how many
+// intervals it has passed and queries the index for the active ones.
+static void SeekToTicks(VPKPVeepTimeIndexCursor *self, int64_t ticks) {
+  VPKPVeepTimeIndex *index = self->index_;
+  const int64_t *ends = index->ends_;
+  const NSUInteger *byEnd = index->byEnd_;
+  self->startsPassed_ = CountStartsThrough(index, ticks);
+  NSUInteger lo = 0;
+  NSUInteger hi = index->count_;
+  while (lo < hi) {
+    NSUInteger mid = lo + (hi - lo) / 2;
+    if (ends[byEnd[mid]] <= ticks) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  self->endsPassed_ = lo;
+  ClearActive(self);
+  StabIntervals(index, ticks, ^(NSUInteger position) {
+    AddActive(self, position);
+  });
+}
+
+// Moves forward to |ticks|: intervals starting by then become active unless
+// they have also ended, and active intervals ending by then are dropped.
+static void AdvanceToTicks(VPKPVeepTimeIndexCursor *self, int64_t ticks) {
+  VPKPVeepTimeIndex *index = self->index_;
+  const int64_t *starts = index->starts_;
+  const int64_t *ends = index->ends_;
+  const NSUInteger *byEnd = index->byEnd_;
+  NSUInteger count = index->count_;
+  while (self->startsPassed_ < count && starts[self->startsPassed_] <= ticks) {
+    NSUInteger position = self->startsPassed_++;
+    if (ends[position] > ticks) {
+      AddActive(self, position);
+    }
+  }
+  while (self->endsPassed_ < count && ends[byEnd[self->endsPassed_]] <= ticks) {
+    NSUInteger position = byEnd[self->endsPassed_++];
+    if (self->activeSlots_[position] != NSNotFound) {
+      RemoveActive(self, position);
+    }
+  }
+}
+
+- (void)moveToTime:(VPKPDiscreteTime *)time {
+  int64_t ticks;
+  if (!TicksForTime(index_, time, &ticks)) {
+    ClearActive(self);
+    hasTime_ = NO;
+    return;
+  }
+  if (hasTime_ && ticks >= ticks_) {
+    AdvanceToTicks(self, ticks);
+  } else {
+    SeekToTicks(self, ticks);
+  }
+  ticks_ = ticks;
+  hasTime_ = YES;
+}
+
+- (void)enumerateActiveElementsUsingBlock:
+    (void(NS_NOESCAPE ^)(VPKPVeepTrackElement *element, NSUInteger idx, BOOL *stop))block {
+  NSArray<VPKPVeepTrackElement *> *trackElements = index_->trackElements_;
+  const NSUInteger *elementIndices = index_->elementIndices_;
+  BOOL stop = NO;
+  for (NSUInteger i = 0; i < activeCount_; ++i) {
+    NSUInteger elementIndex = elementIndices[active_[i]];
+    block(trackElements[elementIndex], elementIndex, &stop);
+    if (stop) {
+      break;
+    }
+  }
+}
+
+- (NSArray<VPKPVeepTrackElement *> *)activeElements {
+  NSMutableArray<VPKPVeepTrackElement *> *result =
+      [NSMutableArray arrayWithCapacity:activeCount_];
+  [self enumerateActiveElementsUsingBlock:^(VPKPVeepTrackElement *element,
+                                            __unused NSUInteger idx, __unused BOOL *stop) {
+    [result addObject:element];
+  }];
+  return result;
+}
+
+#pragma clang diagnostic pop
+
+@end
@@ -0,0 +1,25 @@
+//
+//  VPKPVeepTimeIndex_PackagePrivate.h
+//  dotveep
+//
+
+#import "VPKPVeepTimeIndex.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface VPKPVeepTimeIndex ()
+
+// The indexed intervals in ticks of timescale, count entries each, sorted by
+// start. Valid for the lifetime of the index.
+- (const int64_t *)startTicks;
+- (const int64_t *)endTicks;
+// The index in trackElements of each interval's element.
+- (const NSUInteger *)elementIndices;
+
+// Converts time to ticks, rounded down. Returns NO if time has no positive
+// timescale.
+- (BOOL)getTicks:(int64_t *)ticks forTime:(VPKPDiscreteTime *)time;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,143 @@
+//
+//  VPKPVeepWriter.h
+//  dotveep
+//
+
+#import <Foundation/Foundation.h>
+
+#import "Veep.pbobjc.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Incremental writer for the streamable veep layout.
+ *
+ * Writes a VeepHeader and then appends VeepTrackElements as they are
+ * produced. Each write emits exactly the bytes of the matching
+ * VPKPVeepHeaderContainer or VPKPVeepTrackElementContainer, so the complete
+ * output is byte-identical to -data of a VPKPVeep holding the same header and
+ * trackElementsArray. Only one element is sized and encoded at a time and
+ * encoded bytes are handed to the underlying stream as its buffer fills, so
+ * the writer's memory does not grow with the number of elements written.
+ *
+ * When deduplicatesTrackHeaders is set, that holds up to the track headers:
+ * an element repeating a header already written is written with a
+ * VPKPVeepTrackTag naming it instead.
+ *
+ * Once a write fails, every subsequent write returns the same error.
+ **/
+@interface VPKPVeepWriter : NSObject
+
+/**
+ * When non zero, the writer flushes the underlying stream after every
+ * elementsPerFlush appended track elements so a consumer reading the other
+ * end sees them promptly. Defaults to 0, which only writes out data when the
+ * stream's buffer fills or on -flush:.
+ **/
+@property(nonatomic, assign) NSUInteger elementsPerFlush;
+
+/**
+ * When YES, an appended element whose VPKPVeepTrackHeader is equal to the
+ * last header written with the same identifier is written with a
+ * VPKPVeepTrackTag for that identifier in place of the header, which a
+ * VPKPVeepReader resolves back to it. The element passed in is not modified.
+ * Headers without an identifier are always written in full. Defaults to NO.
+ **/
+@property(nonatomic, assign) BOOL deduplicatesTrackHeaders;
+
+/**
+ * The number of distinct track headers remembered for deduplication. Once
+ * full, the header remembered longest ago is forgotten, and is written in
+ * full again the next time it is used. Defaults to 256.
+ **/
+@property(nonatomic, assign) NSUInteger maxRememberedTrackHeaders;
+
+/** The number of track elements appended so far. */
+@property(nonatomic, readonly) NSUInteger trackElementCount;
+
+/**
+ * Creates a writer that emits into the given coded output stream.
+ *
+ * @param output The coded output stream to write the veep to.
+ **/
+- (instancetype)initWithCodedOutputStream:(VPKGPBCodedOutputStream *)output
+    NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Creates a writer that emits into the given output stream. The stream must
+ * already be open.
+ *
+ * @param output The output stream to write the veep to.
+ **/
+- (instancetype)initWithOutputStream:(NSOutputStream *)output;
+
+/**
+ * Creates a writer that emits straight to the given file descriptor,
+ * handing it bufferSize bytes at a time. The descriptor is not closed by the
+ * writer. A failed write is reported with errno's description as the error's
+ * reason.
+ *
+ * @param fd         The file descriptor to write the veep to.
+ * @param bufferSize The number of bytes to buffer between writes, or 0 for a
+ *                   default.
+ **/
+- (instancetype)initWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Writes the veep header. This must be called before any track element is
+ * appended, and at most once; a veep without a header simply skips it.
+ *
+ * @param header   The header to write.
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)writeHeader:(VPKPVeepHeader *)header error:(NSError **)errorPtr;
+
+/**
+ * Appends a track element.
+ *
+ * @param element  The track element to append.
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)appendTrackElement:(VPKPVeepTrackElement *)element error:(NSError **)errorPtr;
+
+/**
+ * Appends several track elements in order.
+ *
+ * @param elements The track elements to append.
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)appendTrackElements:(NSArray<VPKPVeepTrackElement *> *)elements
+                      error:(NSError **)errorPtr;
+
+/**
+ * Writes a whole veep: its header, if it has one, and then its track
+ * elements. Nothing else may have been written yet.
+ *
+ * @param veep     The veep to write.
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)writeVeep:(VPKPVeep *)veep error:(NSError **)errorPtr;
+
+/**
+ * Writes out any buffered bytes to the underlying stream. Call this once the
+ * last element has been appended.
+ *
+ * @param errorPtr An optional error pointer to fill in with a failure reason.
+ *
+ * @return YES on success.
+ **/
+- (BOOL)flush:(NSError **)errorPtr;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,239 @@
+//
+//  VPKPVeepWriter.m
+//  dotveep
+//
+
+#import "VPKPVeepWriter.h"
+
+@implementation VPKPVeepWriter {
+  VPKGPBCodedOutputStream *output_;
+  // Only set when created from an NSOutputStream, to report its streamError.
+  NSOutputStream *outputStream_;
+  NSError *error_;
+  NSUInteger trackElementCount_;
+  NSUInteger elementsSinceFlush_;
+  // Copies of the track headers last written for each identifier, and the
+  // identifiers in the order they were first remembered.
+  NSMutableDictionary<NSString *, VPKPVeepTrackHeader *> *writtenTrackHeaders_;
+  NSMutableArray<NSString *> *writtenTrackHeaderOrder_;
+  BOOL headerWritten_;
+}
+
+@synthesize elementsPerFlush = elementsPerFlush_;
+@synthesize deduplicatesTrackHeaders = deduplicatesTrackHeaders_;
+@synthesize maxRememberedTrackHeaders = maxRememberedTrackHeaders_;
+
+- (instancetype)initWithCodedOutputStream:(VPKGPBCodedOutputStream *)output {
+  if ((self = [super init])) {
+    output_ = [output retain];
+    maxRememberedTrackHeaders_ = 256;
+  }
+  return self;
+}
+
+- (instancetype)initWithOutputStream:(NSOutputStream *)output {
+  VPKGPBCodedOutputStream *codedOutput =
+      [[VPKGPBCodedOutputStream alloc] initWithOutputStream:output];
+  self = [self initWithCodedOutputStream:codedOutput];
+  [codedOutput release];
+  if (self) {
+    outputStream_ = [output retain];
+  }
+  return self;
+}
+
+- (instancetype)initWithFileDescriptor:(int)fd bufferSize:(NSUInteger)bufferSize {
+  VPKGPBCodedOutputStream *codedOutput =
+      [[VPKGPBCodedOutputStream alloc] initWithFileDescriptor:fd bufferSize:bufferSize];
+  self = [self initWithCodedOutputStream:codedOutput];
+  [codedOutput release];
+  return self;
+}
+
+- (void)dealloc {
+  [output_ release];
+  [outputStream_ release];
+  [error_ release];
+  [writtenTrackHeaders_ release];
+  [writtenTrackHeaderOrder_ release];
+  [super dealloc];
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdirect-ivar-access"
+
+- (NSUInteger)trackElementCount {
+  return trackElementCount_;
+}
+
+static BOOL CheckFailed(VPKPVeepWriter *self, NSError **errorPtr) {
+  if (self->error_) {
+    if (errorPtr) {
+      *errorPtr = self->error_;
+    }
+    return YES;
+  }
+  return NO;
+}
+
+static void RecordFailure(VPKPVeepWriter *self, NSException *exception, NSError **errorPtr) {
+  NSError *error = self->outputStream_.streamError;
+  if (!error) {
+    NSString *reason = exception.reason;
+    if (![reason length]) {
+      reason = exception.name;
+    }
+    NSDictionary *userInfo = nil;
+    if ([reason length]) {
+      userInfo = @{VPKGPBErrorReasonKey : reason};
+    }
+    error = [NSError errorWithDomain:VPKGPBMessageErrorDomain
+                                code:VPKGPBMessageErrorCodeOther
+                            userInfo:userInfo];
+  }
+  [self->error_ release];
+  self->error_ = [error retain];
+  if (errorPtr) {
+    *errorPtr = self->error_;
+  }
+}
+
+// Returns YES if |header| equals the one last written for its identifier.
+// Otherwise remembers it, forgetting the oldest identifier if full, and
+// returns NO.
+static BOOL CheckTrackHeaderWritten(VPKPVeepWriter *self, VPKPVeepTrackHeader *header) {
+  NSString *identifier = header.identifier;
+  if (!identifier.length || !self->maxRememberedTrackHeaders_) {
+    return NO;
+  }
+  if (!self->writtenTrackHeaders_) {
+    self->writtenTrackHeaders_ = [[NSMutableDictionary alloc] init];
+    self->writtenTrackHeaderOrder_ = [[NSMutableArray alloc] init];
+  }
+  VPKPVeepTrackHeader *written = self->writtenTrackHeaders_[identifier];
+  if ([written isEqual:header]) {
+    return YES;
+  }
+  if (!written) {
+    while (self->writtenTrackHeaderOrder_.count >= self->maxRememberedTrackHeaders_) {
+      [self->writtenTrackHeaders_ removeObjectForKey:self->writtenTrackHeaderOrder_[0]];
+      [self->writtenTrackHeaderOrder_ removeObjectAtIndex:0];
+    }
+    [self->writtenTrackHeaderOrder_ addObject:identifier];
+  }
+  // A copy, so later changes to the caller's header are still noticed.
+  VPKPVeepTrackHeader *copy = [header copy];
+  self->writtenTrackHeaders_[identifier] = copy;
+  [copy release];
+  return NO;
+}
+
+// Returns a new element with all of |element|'s fields, but a tag for
+// |header| as its meta. Copying the whole element carries over any data case
+// or other field added to the message later.
+static VPKPVeepTrackElement *NewTaggedTrackElement(VPKPVeepTrackElement *element,
+                                                   VPKPVeepTrackHeader *header) {
+  VPKPVeepTrackElement *tagged = [element copy];
+  VPKPVeepTrackTag *tag = [[VPKPVeepTrackTag alloc] init];
+  tag.identifier = header.identifier;
+  // Setting the tag clears the header, the other case of the meta oneof.
+  tagged.tag = tag;
+  [tag release];
+  return tagged;
+}
+
+// Writes one element, flushing every elementsPerFlush_ elements. Raises on
+// failure.
+static void AppendTrackElement(VPKPVeepWriter *self, VPKPVeepTrackElement *element) {
+  if (self->deduplicatesTrackHeaders_ &&
+      element.metaOneOfCase == VPKPVeepTrackElement_Meta_OneOfCase_Header &&
+      CheckTrackHeaderWritten(self, element.header)) {
+    VPKPVeepTrackElement *tagged = NewTaggedTrackElement(element, element.header);
+    @try {
+      [self->output_ writeMessage:VPKPVeep_FieldNumber_TrackElementsArray value:tagged];
+    } @finally {
+      [tagged release];
+    }
+  } else {
+    [self->output_ writeMessage:VPKPVeep_FieldNumber_TrackElementsArray value:element];
+  }
+  ++self->trackElementCount_;
+  if (self->elementsPerFlush_ && ++self->elementsSinceFlush_ >= self->elementsPerFlush_) {
+    [self->output_ flush];
+    self->elementsSinceFlush_ = 0;
+  }
+}
+
+- (BOOL)writeHeader:(VPKPVeepHeader *)header error:(NSError **)errorPtr {
+  if (headerWritten_ || trackElementCount_) {
+    // A header after the elements would not match VPKPVeep's field order.
+    [NSException raise:NSInternalInconsistencyException
+                format:@"%@ must be written once, before any track element.",
+                       [header class]];
+  }
+  if (CheckFailed(self, errorPtr)) {
+    return NO;
+  }
+  @try {
+    [output_ writeMessage:VPKPVeep_FieldNumber_Header value:header];
+    headerWritten_ = YES;
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return NO;
+  }
+  return YES;
+}
+
+- (BOOL)appendTrackElement:(VPKPVeepTrackElement *)element error:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return NO;
+  }
+  @try {
+    AppendTrackElement(self, element);
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return NO;
+  }
+  return YES;
+}
+
+- (BOOL)appendTrackElements:(NSArray<VPKPVeepTrackElement *> *)elements
+                      error:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return NO;
+  }
+  @try {
+    for (VPKPVeepTrackElement *element in elements) {
+      AppendTrackElement(self, element);
+    }
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return NO;
+  }
+  return YES;
+}
+
+- (BOOL)writeVeep:(VPKPVeep *)veep error:(NSError **)errorPtr {
+  if (veep.hasHeader && ![self writeHeader:veep.header error:errorPtr]) {
+    return NO;
+  }
+  return [self appendTrackElements:veep.trackElementsArray error:errorPtr];
+}
+
+- (BOOL)flush:(NSError **)errorPtr {
+  if (CheckFailed(self, errorPtr)) {
+    return NO;
+  }
+  @try {
+    [output_ flush];
+    elementsSinceFlush_ = 0;
+  } @catch (NSException *exception) {
+    RecordFailure(self, exception, errorPtr);
+    return NO;
+  }
+  return YES;
+}
+
+#pragma clang diagnostic pop
+
+@end
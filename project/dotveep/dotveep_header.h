@@ -27,4 +27,7 @@ FOUNDATION_EXPORT const unsigned char dotveepVersionString[];
 // In this header, you should import all the public headers of your framework using statements like #import <dotveep/PublicHeader.h>
 
 #import <dotveep/Veep.pbobjc.h>
-
+#import <dotveep/VPKPVeepReader.h>
+#import <dotveep/VPKPVeepWriter.h>
+#import <dotveep/VPKPVeepTimeIndex.h>
+#import <dotveep/VPKPVeepHitTestIndex.h>